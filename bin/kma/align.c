@@ -30,10 +30,10 @@
 
 AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int q_len, Aln *aligned, Aln *Frag_align, int min, int max, int mq, double scoreT, AlnPoints *points, NWmat *matrices) {
 	
-	int i, j, k, bias, prev, start, stop, t_len, value, end, band, mem_count;
-	int t_l, t_s, t_e, q_s, q_e, score, shifter, kmersize, U, M, **d;
-	long unsigned key, mask;
-	unsigned char nuc;
+	int i, j, k, bias, prev, start, stop, t_len, value, begin, end, len, band;
+	int t_l, t_s, t_e, q_s, q_e, score, shifter, kmersize, U, M, **d, mem_count;
+	long unsigned key, mask, *qComp, *tseq;
+	unsigned char nuc, *mini;
 	AlnScore Stat, NWstat;
 	Penalties *rewards;
 	
@@ -57,9 +57,14 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 	if(points->len) {
 		mem_count = points->len;
 	} else {
+		seedPoint_pack(points, (unsigned char *) qseq, q_len);
+		qComp = points->qComp->seq;
+		tseq = template_index->seq;
+		mini = minimizerW ? seedPoint_minimizers(points, qseq, qComp, q_len, kmersize) : 0;
 		mem_count = 0;
 		i = 0;
 		while(i < q_len) {
+			begin = i;
 			end = charpos(qseq, 4, i, q_len);
 			if(end == -1) {
 				end = q_len;
@@ -74,7 +79,7 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 			
 			while(i < end) {
 				key = ((key << 2) | qseq[i]) & mask;
-				value = hashMap_index_get_bound(template_index, key, min, max, shifter);
+				value = (mini && !mini[i - kmersize + 1]) ? 0 : hashMap_index_get_bound(template_index, key, min, max, shifter);
 				
 				if(value == 0) {
 					++i;
@@ -82,10 +87,9 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 					i -= (kmersize - 1);
 					
 					/* backseed for overlapping seeds */
-					prev = value - 2;
-					for(j = i - 1; 0 <= j && 0 <= prev && qseq[j] == getNuc(template_index->seq, prev); --j) {
-						--prev;
-					}
+					len = matchRev(qComp, i - 1, q_len, tseq, value - 2, t_len, (i - begin < value - 1) ? i - begin : value - 1);
+					j = i - 1 - len;
+					prev = value - 2 - len;
 					
 					/* get start positions */
 					points->qStart[mem_count] = j + 1;
@@ -96,10 +100,9 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 					i += kmersize;
 					
 					/* extend */
-					while(i < end && value < t_len && qseq[i] == getNuc(template_index->seq, value)) {
-						++i;
-						++value;
-					}
+					len = matchFwd(qComp, i, q_len, tseq, value, t_len, (end - i < t_len - value) ? end - i : t_len - value);
+					i += len;
+					value += len;
 					
 					/* get end positions */
 					points->qEnd[mem_count] = i;
@@ -135,10 +138,9 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 						k = i;
 						/* backseed for overlapping seeds */
 						value = abs(template_index->index[stop]);
-						prev = value - 2;
-						for(j = k - 1; 0 <= j && 0 <= prev && qseq[j] == getNuc(template_index->seq, prev); --j) {
-							--prev;
-						}
+						len = matchRev(qComp, k - 1, q_len, tseq, value - 2, t_len, (k - begin < value - 1) ? k - begin : value - 1);
+						j = k - 1 - len;
+						prev = value - 2 - len;
 						
 						/* get start positions */
 						points->qStart[mem_count] = j + 1;
@@ -149,10 +151,9 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 						k += kmersize;
 						
 						/* extend */
-						while(k < end && value < t_len && qseq[k] == getNuc(template_index->seq, value)) {
-							++k;
-							++value;
-						}
+						len = matchFwd(qComp, k, q_len, tseq, value, t_len, (end - k < t_len - value) ? end - k : t_len - value);
+						k += len;
+						value += len;
 						
 						/* get end positions */
 						points->qEnd[mem_count] = k;
@@ -224,6 +225,7 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 	value = points->tStart[start] - 1;
 	Stat.pos = value;
 	i = points->qStart[start];
+	aligned->qStart = i;
 	
 	/* align leading tail */
 	if(i != 0) {
@@ -266,6 +268,11 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 			memcpy(aligned->s, Frag_align->s + bias, NWstat.len);
 			memcpy(aligned->q, Frag_align->q + bias, NWstat.len);
 			Stat.pos -= (NWstat.len - NWstat.gaps);
+			for(j = 0; j < NWstat.len; ++j) {
+				if(aligned->q[j] != 5) {
+					--aligned->qStart;
+				}
+			}
 			Stat.score = NWstat.score;
 			Stat.len = NWstat.len;
 			Stat.gaps = NWstat.gaps;
@@ -403,12 +410,12 @@ AlnScore KMA(const HashMap_index *template_index, const unsigned char *qseq, int
 
 AlnScore KMA_score(const HashMap_index *template_index, const unsigned char *qseq, int q_len, const CompDNA *qseq_comp, int mq, double scoreT, AlnPoints *points, NWmat *matrices) {
 	
-	int i, j, k, l, bias, prev, start, stop, t_len, value, end, band;
+	int i, j, k, l, bias, prev, start, stop, t_len, value, begin, end, len, band;
 	int t_l, t_s, t_e, q_s, q_e, mem_count, score, kmersize;
 	int U, M, **d;
 	unsigned mapQ, shifter;
-	long unsigned key;
-	unsigned char nuc;
+	long unsigned key, *qComp, *tseq;
+	unsigned char nuc, *mini;
 	AlnScore Stat, NWstat;
 	Penalties *rewards;
 	
@@ -422,20 +429,23 @@ AlnScore KMA_score(const HashMap_index *template_index, const unsigned char *qse
 	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (template_index->kmerindex << 1);
 	
 	/* find seeds */
+	qComp = qseq_comp->seq;
+	tseq = template_index->seq;
+	mini = minimizerW ? seedPoint_minimizers(points, qseq, qComp, q_len, kmersize) : 0;
 	mem_count = 0;
 	for(i = 1, j = 0; i <= qseq_comp->N[0]; ++i) {
+		begin = j;
 		end = qseq_comp->N[i] - kmersize + 1;
 		while(j < end) {
-			value = hashMap_index_get(template_index, getKmer(qseq_comp->seq, j, shifter), shifter);
+			value = (mini && !mini[j]) ? 0 : hashMap_index_get(template_index, getKmer(qseq_comp->seq, j, shifter), shifter);
 			
 			if(value == 0) {
 				++j;
 			} else if(0 < value) {
 				/* backseed for ambiguos seeds */
-				prev = value - 2;
-				for(k = j - 1; 0 <= k && 0 <= prev && qseq[k] == getNuc(template_index->seq, prev); --k) {
-					--prev;
-				}
+				len = matchRev(qComp, j - 1, q_len, tseq, value - 2, t_len, (j - begin < value - 1) ? j - begin : value - 1);
+				k = j - 1 - len;
+				prev = value - 2 - len;
 				
 				/* get start positions */
 				points->qStart[mem_count] = k + 1;
@@ -447,12 +457,10 @@ AlnScore KMA_score(const HashMap_index *template_index, const unsigned char *qse
 				j += kmersize;
 				
 				/* extend */
-				end += (kmersize - 1);
-				while(j < end && value < t_len && qseq[j] == getNuc(template_index->seq, value)) {
-					++j;
-					++value;
-				}
-				end -= (kmersize - 1);
+				len = end + kmersize - 1 - j;
+				len = matchFwd(qComp, j, q_len, tseq, value, t_len, (len < t_len - value) ? len : t_len - value);
+				j += len;
+				value += len;
 				
 				/* get end positions */
 				points->qEnd[mem_count] = j;
@@ -478,10 +486,9 @@ AlnScore KMA_score(const HashMap_index *template_index, const unsigned char *qse
 					l = j;
 					/* backseed for overlapping seeds */
 					value = abs(template_index->index[stop]);
-					prev = value - 2;
-					for(k = l - 1; 0 <= k && 0 <= prev && qseq[k] == getNuc(template_index->seq, prev); --k) {
-						--prev;
-					}
+					len = matchRev(qComp, l - 1, q_len, tseq, value - 2, t_len, (l - begin < value - 1) ? l - begin : value - 1);
+					k = l - 1 - len;
+					prev = value - 2 - len;
 					
 					/* get start positions */
 					points->qStart[mem_count] = k + 1;
@@ -492,12 +499,10 @@ AlnScore KMA_score(const HashMap_index *template_index, const unsigned char *qse
 					l += kmersize;
 					
 					/* extend */
-					end += (kmersize - 1);
-					while(l < end && value < t_len && qseq[l] == getNuc(template_index->seq, value)) {
-						++l;
-						++value;
-					}
-					end -= (kmersize - 1);
+					len = end + kmersize - 1 - l;
+					len = matchFwd(qComp, l, q_len, tseq, value, t_len, (len < t_len - value) ? len : t_len - value);
+					l += len;
+					value += len;
 					
 					/* get end positions */
 					points->qEnd[mem_count] = l;
@@ -706,9 +711,10 @@ void intcpy(int *dest, int *src, int size) {
 
 int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len, AlnPoints *points) {
 	
-	int i, j, k, rc, end, stop, score, score_r, value, t_len, prev, bias;
-	int bestScore, mem_count, totMems, shifter, kmersize;
-	long unsigned key, mask;
+	int i, j, k, rc, begin, end, len, stop, score, score_r, value, t_len, prev;
+	int bias, bestScore, mem_count, totMems, shifter, kmersize;
+	long unsigned key, mask, *qComp, *tseq;
+	unsigned char *mini;
 	
 	t_len = template_index->len;
 	kmersize = template_index->kmerindex;
@@ -724,6 +730,7 @@ int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len
 	mem_count = 0;
 	totMems = 0;
 	points->len = 0;
+	tseq = template_index->seq;
 	for(rc = 0; rc < 2; ++rc) {
 		if(rc) {
 			strrc(qseq, q_len);
@@ -732,8 +739,12 @@ int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len
 		}
 		score_r = 0;
 		mem_count = 0;
+		seedPoint_pack(points, qseq, q_len);
+		qComp = points->qComp->seq;
+		mini = minimizerW ? seedPoint_minimizers(points, qseq, qComp, q_len, kmersize) : 0;
 		i = preseed(template_index, qseq, q_len);
 		while(i < q_len) {
+			begin = i;
 			end = charpos(qseq, 4, i, q_len);
 			if(end == -1) {
 				end = q_len;
@@ -747,18 +758,17 @@ int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len
 			
 			while(i < end) {
 				key = ((key << 2) | qseq[i]) & mask;
-				value = hashMap_index_get_bound(template_index, key, 0, t_len, shifter);
+				value = (mini && !mini[i - kmersize + 1]) ? 0 : hashMap_index_get_bound(template_index, key, 0, t_len, shifter);
 				if(value == 0) {
 					++i;
 				} else if(0 < value) {
 					i -= (kmersize - 1);
 					
 					/* backseed for ambiguos seeds */
-					prev = value - 2;
-					for(j = i - 1; 0 <= j && 0 <= prev && qseq[j] == getNuc(template_index->seq, prev); --j) {
-						--prev;
-						++score_r;
-					}
+					len = matchRev(qComp, i - 1, q_len, tseq, value - 2, t_len, (i - begin < value - 1) ? i - begin : value - 1);
+					j = i - 1 - len;
+					prev = value - 2 - len;
+					score_r += len;
 					
 					/* get start positions */
 					points->qStart[totMems] = j + 1;
@@ -770,11 +780,10 @@ int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len
 					score_r += kmersize;
 					
 					/* extend */
-					while(i < end && value < t_len && qseq[i] == getNuc(template_index->seq, value)) {
-						++i;
-						++value;
-						++score_r;
-					}
+					len = matchFwd(qComp, i, q_len, tseq, value, t_len, (end - i < t_len - value) ? end - i : t_len - value);
+					i += len;
+					value += len;
+					score_r += len;
 					
 					/* get end positions */
 					points->qEnd[totMems] = i;
@@ -812,10 +821,9 @@ int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len
 						k = i;
 						/* backseed for overlapping seeds */
 						value = abs(template_index->index[stop]);
-						prev = value - 2;
-						for(j = k - 1; 0 <= j && 0 <= prev && qseq[j] == getNuc(template_index->seq, prev); --j) {
-							--prev;
-						}
+						len = matchRev(qComp, k - 1, q_len, tseq, value - 2, t_len, (k - begin < value - 1) ? k - begin : value - 1);
+						j = k - 1 - len;
+						prev = value - 2 - len;
 						
 						/* get start positions */
 						points->qStart[totMems] = j + 1;
@@ -826,10 +834,9 @@ int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len
 						k += kmersize;
 						
 						/* extend */
-						while(k < end && value < t_len && qseq[k] == getNuc(template_index->seq, value)) {
-							++k;
-							++value;
-						}
+						len = matchFwd(qComp, k, q_len, tseq, value, t_len, (end - k < t_len - value) ? end - k : t_len - value);
+						k += len;
+						value += len;
 						
 						/* get end positions */
 						points->qEnd[totMems] = k;
@@ -884,6 +891,9 @@ int anker_rc(const HashMap_index *template_index, unsigned char *qseq, int q_len
 			intcpy(points->weight, points->weight + points->len, mem_count);
 		}
 		points->len = mem_count;
+		
+		/* a negative score tells that qseq was reverse complemented */
+		bestScore = -bestScore;
 	}
 	
 	return bestScore;
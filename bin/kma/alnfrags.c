@@ -19,12 +19,15 @@
 #define _XOPEN_SOURCE 600
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "align.h"
 #include "alnfrags.h"
 #include "ankers.h"
 #include "chain.h"
+#include "clust.h"
 #include "compdna.h"
 #include "hashmapindex.h"
+#include "indexcache.h"
 #include "pherror.h"
 #include "qseqs.h"
 #include "stdnuc.h"
@@ -32,7 +35,104 @@
 #include "threader.h"
 #include "updatescores.h"
 
-void alnFragsSE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, int rc_flag, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, int q_len, int kmersize, Qseqs *header, int *bestTemplates, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, volatile int *excludeOut, volatile int *excludeDB) {
+static HashMap_index loadingTemplate[1];
+
+HashMap_index * alnFragsLoad(HashMap_index **templates_index, int template, int *template_lengths, int kmersize, int seq_in, int index_in, long *seq_indexes, long *index_indexes) {
+	
+	HashMap_index *dest, * volatile *slot;
+	
+	/*
+	 * bounded cache, loads are serialized with the evictions. Hits take the
+	 * lock as well, trading load throughput for the memory bound.
+	 */
+	if(indexCache) {
+		lock(&indexCache->excludeCache);
+		if((dest = templates_index[template])) {
+			indexCache_hit(indexCache, template);
+		} else {
+			dest = alignLoadPtr(0, seq_in, index_in, template_lengths[template], kmersize, seq_indexes[template], index_indexes[template]);
+			templates_index[template] = dest;
+			indexCache_add(indexCache, templates_index, template);
+		}
+		unlock(&indexCache->excludeCache);
+		return dest;
+	}
+	
+	/* once-initialize the template index, loaders use positioned reads */
+	slot = (HashMap_index * volatile *) (templates_index + template);
+	if((dest = *slot) && dest != loadingTemplate) {
+		return dest;
+	} else if(__sync_bool_compare_and_swap(templates_index + template, 0, loadingTemplate)) {
+		dest = alignLoadPtr(0, seq_in, index_in, template_lengths[template], kmersize, seq_indexes[template], index_indexes[template]);
+		__sync_synchronize();
+		*slot = dest;
+	} else {
+		while((dest = *slot) == loadingTemplate) {
+			usleep(100);
+		}
+	}
+	
+	return dest;
+}
+
+void alnFragsRelease(int template) {
+	
+	if(indexCache) {
+		lock(&indexCache->excludeCache);
+		indexCache_release(indexCache, template);
+		unlock(&indexCache->excludeCache);
+	}
+}
+
+AlnScore alnFragsScore(HashMap_index **templates_index, int template, const unsigned char *qseq, int q_len, const CompDNA *qseq_comp, int *template_lengths, int kmersize, int mq, double scoreT, int seq_in, int index_in, long *seq_indexes, long *index_indexes, AlnPoints *points, NWmat *NWmatrices, ClustAln *clustAln, int bound) {
+	
+	int rep, var;
+	AlnScore Stat;
+	ClustAln tmp;
+	HashMap_index *template_index;
+	Penalties *rewards;
+	
+	if(clustAln && (rep = templateClust->rep[template])) {
+		/* align each mate once to the representative */
+		if(clustAln->rep != rep || clustAln->qseq != qseq) {
+			tmp = clustAln[1];
+			clustAln[1] = *clustAln;
+			*clustAln = tmp;
+			if(clustAln->rep != rep || clustAln->qseq != qseq) {
+				if(clustAln->size <= q_len) {
+					clustAln_realloc(clustAln, q_len << 1);
+				}
+				template_index = alnFragsLoad(templates_index, rep, template_lengths, kmersize, seq_in, index_in, seq_indexes, index_indexes);
+				points->len = 0;
+				clustAln->stat = KMA(template_index, qseq, q_len, clustAln->aligned, clustAln->gap_align, 0, template_lengths[rep], mq, scoreT, points, NWmatrices);
+				alnFragsRelease(rep);
+				clustAln->rep = rep;
+				clustAln->qseq = qseq;
+			}
+		}
+		
+		/* an allele gains at most M - MM per variant over the representative,
+		   so only alleles that cannot reach the bound keep the derived score */
+		Stat = clustAln->stat;
+		rewards = NWmatrices->rewards;
+		var = templateClust->offsets[template + 1] - templateClust->offsets[template];
+		if(Stat.score + var * (rewards->M - rewards->MM) + abs(rewards->W1) < bound) {
+			if(template != rep) {
+				Stat.score += clust_delta(templateClust, template, clustAln->aligned, Stat.pos, template_lengths[template], rewards->d);
+			}
+			return Stat;
+		}
+	}
+	
+	/* align exactly */
+	template_index = alnFragsLoad(templates_index, template, template_lengths, kmersize, seq_in, index_in, seq_indexes, index_indexes);
+	Stat = KMA_score(template_index, qseq, q_len, qseq_comp, mq, scoreT, points, NWmatrices);
+	alnFragsRelease(template);
+	
+	return Stat;
+}
+
+void alnFragsSE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, int rc_flag, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, int q_len, int kmersize, Qseqs *header, int *bestTemplates, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, ClustAln *clustAln, volatile int *excludeOut, int ticket) {
 	
 	int t_i, template, read_score, best_read_score, bestHits, aln_len;
 	int start, end, W1;
@@ -50,6 +150,7 @@ void alnFragsSE(HashMap_index **templates_index, int *matched_templates, int *te
 		qseq_r_comp->N[0]++;
 		qseq_r_comp->N[qseq_r_comp->N[0]] = q_len;
 	}
+	clustAln_reset(clustAln);
 	unCompDNA(qseq_comp, qseq);
 	qseq_comp->N[0]++;
 	qseq_comp->N[qseq_comp->N[0]] = q_len;
@@ -62,20 +163,11 @@ void alnFragsSE(HashMap_index **templates_index, int *matched_templates, int *te
 	for(t_i = 1; t_i <= *matched_templates; ++t_i) {
 		template = matched_templates[t_i];
 		
-		/* check if index DB is loaded */
-		lock(excludeDB);
-		if(template >= 0 && templates_index[template] == 0) {
-			templates_index[template] = alignLoadPtr(templates_index[template], seq_in, index_in, template_lengths[template], kmersize, seq_indexes[template], index_indexes[template]);
-		} else if(template < 0 && templates_index[-template] == 0) {
-			templates_index[-template] = alignLoadPtr(templates_index[-template], seq_in, index_in, template_lengths[-template], kmersize, seq_indexes[-template], index_indexes[-template]);
-		}
-		unlock(excludeDB);
-		
 		/* align qseq */
 		if(template < 0) {
-			alnStat = KMA_score(templates_index[-template], qseq_r, q_len, qseq_r_comp, mq, scoreT, points, NWmatrices);
+			alnStat = alnFragsScore(templates_index, -template, qseq_r, q_len, qseq_r_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, best_read_score);
 		} else {
-			alnStat = KMA_score(templates_index[template], qseq, q_len, qseq_comp, mq, scoreT, points, NWmatrices);
+			alnStat = alnFragsScore(templates_index, template, qseq, q_len, qseq_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, best_read_score);
 		}
 		
 		/* get read score */
@@ -126,13 +218,12 @@ void alnFragsSE(HashMap_index **templates_index, int *matched_templates, int *te
 		}
 	}
 	if(best_read_score > kmersize) {
-		lock(excludeOut);
+		lockTurn(excludeOut, ticket);
 		update_Scores(qseq, q_len, bestHits, best_read_score, best_start_pos, best_end_pos, bestTemplates, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
-		unlock(excludeOut);
 	}
 }
 
-void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, Qseqs *header, Qseqs *header_r, int kmersize, int *bestTemplates, int *bestTemplates_r, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, volatile int *excludeOut, volatile int *excludeDB) {
+void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, Qseqs *header, Qseqs *header_r, int kmersize, int *bestTemplates, int *bestTemplates_r, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, ClustAln *clustAln, volatile int *excludeOut, int ticket) {
 	
 	int t_i, template, read_score, best_read_score, best_read_score_r;
 	int compScore, bestHits, bestHits_r, aln_len, start, end, rc, W1;
@@ -140,6 +231,7 @@ void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, in
 	AlnScore alnStat;
 	
 	/* unpack qseqs */
+	clustAln_reset(clustAln);
 	unCompDNA(qseq_comp, qseq);
 	qseq_comp->N[0]++;
 	qseq_comp->N[qseq_comp->N[0]] = qseq_comp->seqlen;
@@ -169,23 +261,16 @@ void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, in
 				
 				strrc(qseq, qseq_comp->seqlen);
 				strrc(qseq_r, qseq_r_comp->seqlen);
+				clustAln_reset(clustAln);
 				
 				rc = 0;
 			}
 		}
 		
-		lock(excludeDB);
-		if(0 <= template && templates_index[template] == 0) {
-			templates_index[template] = alignLoadPtr(templates_index[template], seq_in, index_in, template_lengths[template], kmersize, seq_indexes[template], index_indexes[template]);
-		} else if(template < 0 && templates_index[-template] == 0) {
-			templates_index[-template] = alignLoadPtr(templates_index[-template], seq_in, index_in, template_lengths[-template], kmersize, seq_indexes[-template], index_indexes[-template]);
-		}
-		unlock(excludeDB);
-		
 		template = abs(template);
 		
 		/* align qseqs */
-		alnStat = KMA_score(templates_index[template], qseq, qseq_comp->seqlen, qseq_comp, mq, scoreT, points, NWmatrices);
+		alnStat = alnFragsScore(templates_index, template, qseq, qseq_comp->seqlen, qseq_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, best_read_score);
 		
 		/* get read score */
 		if(0 < alnStat.score) {
@@ -215,7 +300,7 @@ void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, in
 			best_end_pos[t_i] = -1;
 		}
 		
-		alnStat = KMA_score(templates_index[template], qseq_r, qseq_r_comp->seqlen, qseq_r_comp, mq, scoreT, points, NWmatrices);
+		alnStat = alnFragsScore(templates_index, template, qseq_r, qseq_r_comp->seqlen, qseq_r_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, MIN(best_read_score_r, compScore - bestTemplates[t_i] - abs(W1)));
 		/* get read score */
 		if(0 < alnStat.score) {
 			aln_len = alnStat.len;
@@ -283,17 +368,15 @@ void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, in
 				for(t_i = 0; t_i < bestHits; ++t_i) {
 					bestTemplates[t_i] = -bestTemplates[t_i];
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, ticket);
 				update_Scores_pe(qseq_r, qseq_r_comp->seqlen, qseq, qseq_comp->seqlen, bestHits, compScore, best_start_pos, best_end_pos, bestTemplates, header_r, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
-				unlock(excludeOut);
 			} else {
 				if(!rc) {
 					strrc(qseq, qseq_comp->seqlen);
 					strrc(qseq_r, qseq_r_comp->seqlen);
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, ticket);
 				update_Scores_pe(qseq, qseq_comp->seqlen, qseq_r, qseq_r_comp->seqlen, bestHits, compScore, best_start_pos, best_end_pos, bestTemplates, header, header_r, alignment_scores, uniq_alignment_scores, frag_out_raw);
-				unlock(excludeOut);
 			}
 		} else {
 			/* unmaided pair */
@@ -312,25 +395,19 @@ void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, in
 					++bestHits_r;
 				}
 			}
-			/* check direction of qseqs */
-			if(*bestTemplates < 0) {
-				for(t_i = 0; t_i < bestHits; ++t_i) {
-					bestTemplates[t_i] = -bestTemplates[t_i];
-				}
-			} else if(!rc) {
+			/* write the reads in their input orientation, the template signs
+			   give the strand, and the mate was stored reverse complemented */
+			if(rc) {
+				strrc(qseq_r, qseq_r_comp->seqlen);
+			} else {
 				strrc(qseq, qseq_comp->seqlen);
 			}
-			if(*bestTemplates_r < 0) {
-				for(t_i = 0; t_i < bestHits; ++t_i) {
-					bestTemplates_r[t_i] = -bestTemplates_r[t_i];
-				}
-			} else if(!rc) {
-				strrc(qseq_r, qseq_r_comp->seqlen);
+			for(t_i = 0; t_i < bestHits_r; ++t_i) {
+				bestTemplates_r[t_i] = -bestTemplates_r[t_i];
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, ticket);
 			update_Scores(qseq, qseq_comp->seqlen, bestHits, best_read_score, best_start_pos, best_end_pos, bestTemplates, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
 			update_Scores(qseq_r, qseq_r_comp->seqlen, bestHits_r, best_read_score_r, best_start_pos, best_end_pos, bestTemplates_r, header_r, alignment_scores, uniq_alignment_scores, frag_out_raw);
-			unlock(excludeOut);
 		}
 	} else if(best_read_score) {
 		bestHits = 0;
@@ -342,17 +419,12 @@ void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, in
 				++bestHits;
 			}
 		}
-		/* check direction of qseqs */
-		if(*bestTemplates < 0) {
-			for(t_i = 0; t_i < bestHits; ++t_i) {
-				bestTemplates[t_i] = -bestTemplates[t_i];
-			}
-		} else if(!rc) {
+		/* write qseq in its input orientation, the template signs give the strand */
+		if(!rc) {
 			strrc(qseq, qseq_comp->seqlen);
 		}
-		lock(excludeOut);
+		lockTurn(excludeOut, ticket);
 		update_Scores(qseq, qseq_comp->seqlen, bestHits, best_read_score, best_start_pos, best_end_pos, bestTemplates, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
-		unlock(excludeOut);
 	} else if(best_read_score_r) {
 		bestHits_r = 0;
 		for(t_i = 1; t_i <= *matched_templates; ++t_i) {
@@ -363,21 +435,19 @@ void alnFragsUnionPE(HashMap_index **templates_index, int *matched_templates, in
 				++bestHits_r;
 			}
 		}
-		/* check direction of qseqs */
-		if(*bestTemplates_r < 0) {
-			for(t_i = 0; t_i < bestHits; ++t_i) {
-				bestTemplates_r[t_i] = -bestTemplates_r[t_i];
-			}
-		} else if(!rc) {
+		/* the mate was stored reverse complemented, write it in its input orientation */
+		if(rc) {
 			strrc(qseq_r, qseq_r_comp->seqlen);
 		}
-		lock(excludeOut);
+		for(t_i = 0; t_i < bestHits_r; ++t_i) {
+			bestTemplates_r[t_i] = -bestTemplates_r[t_i];
+		}
+		lockTurn(excludeOut, ticket);
 		update_Scores(qseq_r, qseq_r_comp->seqlen, bestHits_r, best_read_score_r, best_start_pos, best_end_pos, bestTemplates_r, header_r, alignment_scores, uniq_alignment_scores, frag_out_raw);
-		unlock(excludeOut);
 	}
 }
 
-void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, Qseqs *header, Qseqs *header_r, int kmersize, int *bestTemplates, int *bestTemplates_r, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, volatile int *excludeOut, volatile int *excludeDB) {
+void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, Qseqs *header, Qseqs *header_r, int kmersize, int *bestTemplates, int *bestTemplates_r, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, ClustAln *clustAln, volatile int *excludeOut, int ticket) {
 	
 	int t_i, template, read_score, best_read_score, best_read_score_r;
 	int compScore, bestHits, bestHits_r, aln_len, start, end, rc, W1, PE;
@@ -385,6 +455,7 @@ void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates,
 	AlnScore alnStat;
 	
 	/* unpack qseqs */
+	clustAln_reset(clustAln);
 	unCompDNA(qseq_comp, qseq);
 	qseq_comp->N[0]++;
 	qseq_comp->N[qseq_comp->N[0]] = qseq_comp->seqlen;
@@ -415,23 +486,16 @@ void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates,
 				
 				strrc(qseq, qseq_comp->seqlen);
 				strrc(qseq_r, qseq_r_comp->seqlen);
+				clustAln_reset(clustAln);
 				
 				rc = 0;
 			}
 		}
 		
-		lock(excludeDB);
-		if(0 <= template && templates_index[template] == 0) {
-			templates_index[template] = alignLoadPtr(templates_index[template], seq_in, index_in, template_lengths[template], kmersize, seq_indexes[template], index_indexes[template]);
-		} else if(template < 0 && templates_index[-template] == 0) {
-			templates_index[-template] = alignLoadPtr(templates_index[-template], seq_in, index_in, template_lengths[-template], kmersize, seq_indexes[-template], index_indexes[-template]);
-		}
-		unlock(excludeDB);
-		
 		template = abs(template);
 		
 		/* align qseqs */
-		alnStat = KMA_score(templates_index[template], qseq, qseq_comp->seqlen, qseq_comp, mq, scoreT, points, NWmatrices);
+		alnStat = alnFragsScore(templates_index, template, qseq, qseq_comp->seqlen, qseq_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, best_read_score);
 		
 		/* get read score */
 		if(0 < alnStat.score) {
@@ -461,7 +525,7 @@ void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates,
 			best_end_pos[t_i] = -1;
 		}
 		
-		alnStat = KMA_score(templates_index[template], qseq_r, qseq_r_comp->seqlen, qseq_r_comp, mq, scoreT, points, NWmatrices);
+		alnStat = alnFragsScore(templates_index, template, qseq_r, qseq_r_comp->seqlen, qseq_r_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, MIN(best_read_score_r, compScore - bestTemplates[t_i] - PE));
 		/* get read score */
 		if(0 < alnStat.score) {
 			aln_len = alnStat.len;
@@ -527,17 +591,15 @@ void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates,
 				for(t_i = 0; t_i < bestHits; ++t_i) {
 					bestTemplates[t_i] = -bestTemplates[t_i];
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, ticket);
 				update_Scores_pe(qseq_r, qseq_r_comp->seqlen, qseq, qseq_comp->seqlen, bestHits, compScore, best_start_pos, best_end_pos, bestTemplates, header_r, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
-				unlock(excludeOut);
 			} else {
 				if(!rc) {
 					strrc(qseq, qseq_comp->seqlen);
 					strrc(qseq_r, qseq_r_comp->seqlen);
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, ticket);
 				update_Scores_pe(qseq, qseq_comp->seqlen, qseq_r, qseq_r_comp->seqlen, bestHits, compScore, best_start_pos, best_end_pos, bestTemplates, header, header_r, alignment_scores, uniq_alignment_scores, frag_out_raw);
-				unlock(excludeOut);
 			}
 		} else {
 			/* unmaided pair */
@@ -556,25 +618,19 @@ void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates,
 					++bestHits_r;
 				}
 			}
-			/* check direction of qseqs */
-			if(*bestTemplates < 0) {
-				for(t_i = 0; t_i < bestHits; ++t_i) {
-					bestTemplates[t_i] = -bestTemplates[t_i];
-				}
-			} else if(!rc) {
+			/* write the reads in their input orientation, the template signs
+			   give the strand, and the mate was stored reverse complemented */
+			if(rc) {
+				strrc(qseq_r, qseq_r_comp->seqlen);
+			} else {
 				strrc(qseq, qseq_comp->seqlen);
 			}
-			if(*bestTemplates_r < 0) {
-				for(t_i = 0; t_i < bestHits; ++t_i) {
-					bestTemplates_r[t_i] = -bestTemplates_r[t_i];
-				}
-			} else if(!rc) {
-				strrc(qseq_r, qseq_r_comp->seqlen);
+			for(t_i = 0; t_i < bestHits_r; ++t_i) {
+				bestTemplates_r[t_i] = -bestTemplates_r[t_i];
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, ticket);
 			update_Scores(qseq, qseq_comp->seqlen, bestHits, best_read_score, best_start_pos, best_end_pos, bestTemplates, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
 			update_Scores(qseq_r, qseq_r_comp->seqlen, bestHits_r, best_read_score_r, best_start_pos, best_end_pos, bestTemplates_r, header_r, alignment_scores, uniq_alignment_scores, frag_out_raw);
-			unlock(excludeOut);
 		}
 	} else if(best_read_score) {
 		bestHits = 0;
@@ -586,17 +642,12 @@ void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates,
 				++bestHits;
 			}
 		}
-		/* check direction of qseqs */
-		if(*bestTemplates < 0) {
-			for(t_i = 0; t_i < bestHits; ++t_i) {
-				bestTemplates[t_i] = -bestTemplates[t_i];
-			}
-		} else if(!rc) {
+		/* write qseq in its input orientation, the template signs give the strand */
+		if(!rc) {
 			strrc(qseq, qseq_comp->seqlen);
 		}
-		lock(excludeOut);
+		lockTurn(excludeOut, ticket);
 		update_Scores(qseq, qseq_comp->seqlen, bestHits, best_read_score, best_start_pos, best_end_pos, bestTemplates, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
-		unlock(excludeOut);
 	} else if(best_read_score_r) {
 		bestHits_r = 0;
 		for(t_i = 1; t_i <= *matched_templates; ++t_i) {
@@ -607,21 +658,19 @@ void alnFragsPenaltyPE(HashMap_index **templates_index, int *matched_templates,
 				++bestHits_r;
 			}
 		}
-		/* check direction of qseqs */
-		if(*bestTemplates_r < 0) {
-			for(t_i = 0; t_i < bestHits; ++t_i) {
-				bestTemplates_r[t_i] = -bestTemplates_r[t_i];
-			}
-		} else if(!rc) {
+		/* the mate was stored reverse complemented, write it in its input orientation */
+		if(rc) {
 			strrc(qseq_r, qseq_r_comp->seqlen);
 		}
-		lock(excludeOut);
+		for(t_i = 0; t_i < bestHits_r; ++t_i) {
+			bestTemplates_r[t_i] = -bestTemplates_r[t_i];
+		}
+		lockTurn(excludeOut, ticket);
 		update_Scores(qseq_r, qseq_r_comp->seqlen, bestHits_r, best_read_score_r, best_start_pos, best_end_pos, bestTemplates_r, header_r, alignment_scores, uniq_alignment_scores, frag_out_raw);
-		unlock(excludeOut);
 	}
 }
 
-void alnFragsForcePE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, Qseqs *header, Qseqs *header_r, int kmersize, int *bestTemplates, int *bestTemplates_r, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, volatile int *excludeOut, volatile int *excludeDB) {
+void alnFragsForcePE(HashMap_index **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, Qseqs *header, Qseqs *header_r, int kmersize, int *bestTemplates, int *bestTemplates_r, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int seq_in, int index_in, long *seq_indexes, long *index_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, ClustAln *clustAln, volatile int *excludeOut, int ticket) {
 	
 	int t_i, template, read_score, best_read_score, bestHits, aln_len, W1;
 	int start, end, rc;
@@ -629,6 +678,7 @@ void alnFragsForcePE(HashMap_index **templates_index, int *matched_templates, in
 	AlnScore alnStat, alnStat_r;
 	
 	/* unpack qseqs */
+	clustAln_reset(clustAln);
 	unCompDNA(qseq_comp, qseq);
 	qseq_comp->N[0]++;
 	qseq_comp->N[qseq_comp->N[0]] = qseq_comp->seqlen;
@@ -657,25 +707,18 @@ void alnFragsForcePE(HashMap_index **templates_index, int *matched_templates, in
 				
 				strrc(qseq, qseq_comp->seqlen);
 				strrc(qseq_r, qseq_r_comp->seqlen);
+				clustAln_reset(clustAln);
 				
 				rc = 0;
 			}
 		}
 		
-		lock(excludeDB);
-		if(0 <= template && templates_index[template] == 0) {
-			templates_index[template] = alignLoadPtr(templates_index[template], seq_in, index_in, template_lengths[template], kmersize, seq_indexes[template], index_indexes[template]);
-		} else if(template < 0 && templates_index[-template] == 0) {
-			templates_index[-template] = alignLoadPtr(templates_index[-template], seq_in, index_in, template_lengths[-template], kmersize, seq_indexes[-template], index_indexes[-template]);
-		}
-		unlock(excludeDB);
-		
 		template = abs(template);
 		
 		/* align qseq */
-		alnStat = KMA_score(templates_index[template], qseq, qseq_comp->seqlen, qseq_comp, mq, scoreT, points, NWmatrices);
+		alnStat = alnFragsScore(templates_index, template, qseq, qseq_comp->seqlen, qseq_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, best_read_score - NWmatrices->rewards->M * qseq_r_comp->seqlen);
 		if(0 < alnStat.score) {
-			alnStat_r = KMA_score(templates_index[template], qseq_r, qseq_r_comp->seqlen, qseq_r_comp, mq, scoreT, points, NWmatrices);
+			alnStat_r = alnFragsScore(templates_index, template, qseq_r, qseq_r_comp->seqlen, qseq_r_comp, template_lengths, kmersize, mq, scoreT, seq_in, index_in, seq_indexes, index_indexes, points, NWmatrices, clustAln, best_read_score - alnStat.score);
 			
 			/* get read score */
 			if(0 < alnStat_r.score) {
@@ -734,26 +777,25 @@ void alnFragsForcePE(HashMap_index **templates_index, int *matched_templates, in
 			for(t_i = 0; t_i < bestHits; ++t_i) {
 				bestTemplates[t_i] = -bestTemplates[t_i];
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, ticket);
 			update_Scores_pe(qseq_r, qseq_r_comp->seqlen, qseq, qseq_comp->seqlen, bestHits, best_read_score, best_start_pos, best_end_pos, bestTemplates, header_r, header, alignment_scores, uniq_alignment_scores, frag_out_raw);
-			unlock(excludeOut);
 		} else {
 			if(!rc) {
 				strrc(qseq, qseq_comp->seqlen);
 				strrc(qseq_r, qseq_r_comp->seqlen);
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, ticket);
 			update_Scores_pe(qseq, qseq_comp->seqlen, qseq_r, qseq_r_comp->seqlen, bestHits, best_read_score, best_start_pos, best_end_pos, bestTemplates, header, header_r, alignment_scores, uniq_alignment_scores, frag_out_raw);
-			unlock(excludeOut);
 		}
 	}
 }
 
 void * alnFrags_threaded(void * arg) {
 	
-	static volatile int excludeIn[1] = {0}, excludeOut[1] = {0}, excludeDB[1] = {0};
+	static volatile int excludeIn[1] = {0}, excludeOut[1] = {1};
+	static int readNum = 0;
 	Aln_thread *thread = arg;
-	int rc_flag, read_score, delta, index_in, seq_in, kmersize, mq;
+	int ticket, rc_flag, read_score, delta, index_in, seq_in, kmersize, mq, size, bestSize;
 	int *matched_templates, *bestTemplates, *bestTemplates_r;
 	int *best_start_pos, *best_end_pos, *template_lengths;
 	long *index_indexes, *seq_indexes;
@@ -764,6 +806,7 @@ void * alnFrags_threaded(void * arg) {
 	Qseqs *qseq, *qseq_r, *header, *header_r;
 	AlnPoints *points;
 	NWmat *NWmatrices;
+	ClustAln *clustAln;
 	HashMap_index **templates_index;
 	
 	/* get input */
@@ -772,6 +815,8 @@ void * alnFrags_threaded(void * arg) {
 	bestTemplates_r = thread->bestTemplates_r;
 	best_start_pos = thread->best_start_pos;
 	best_end_pos = thread->best_end_pos;
+	size = thread->size;
+	bestSize = size;
 	alignment_scores = thread->alignment_scores;
 	uniq_alignment_scores = thread->uniq_alignment_scores;
 	index_indexes = thread->index_indexes;
@@ -788,6 +833,7 @@ void * alnFrags_threaded(void * arg) {
 	header_r = thread->header_r;
 	points = thread->points;
 	NWmatrices = thread->NWmatrices;
+	clustAln = thread->clustAln;
 	kmersize = thread->kmersize;
 	mq = thread->mq;
 	scoreT = thread->scoreT;
@@ -798,17 +844,32 @@ void * alnFrags_threaded(void * arg) {
 	read_score = 0;
 	//lock(excludeIn);
 	lockTime(excludeIn, 65536);
-	while((rc_flag = get_ankers(matched_templates, qseq_comp, header, inputfile)) != 0) {
+	while((rc_flag = get_ankers(&matched_templates, &size, qseq_comp, header, inputfile)) != 0) {
 		if(*matched_templates) { // SE
 			read_score = 0;
 		} else { // PE
-			read_score = get_ankers(matched_templates, qseq_r_comp, header_r, inputfile);
+			read_score = get_ankers(&matched_templates, &size, qseq_r_comp, header_r, inputfile);
 			read_score = labs(read_score);
 			qseq_r->len = qseq_r_comp->seqlen;
 		}
+		/* frags are committed in the order they were loaded */
+		ticket = ++readNum;
 		unlock(excludeIn);
 		qseq->len = qseq_comp->seqlen;
 		
+		/* candidate buffers follow the hits per read */
+		if(bestSize < size) {
+			bestSize = size;
+			free(bestTemplates);
+			free(bestTemplates_r);
+			free(best_start_pos);
+			free(best_end_pos);
+			bestTemplates = smalloc(bestSize * sizeof(int));
+			bestTemplates_r = smalloc(bestSize * sizeof(int));
+			best_start_pos = smalloc(bestSize * sizeof(int));
+			best_end_pos = smalloc(bestSize * sizeof(int));
+		}
+		
 		if(delta <= MAX(qseq->len, qseq_r->len)) {
 			delta = MAX(qseq->len, qseq_r->len);
 			delta <<= 1;
@@ -825,14 +886,23 @@ void * alnFrags_threaded(void * arg) {
 		
 		if(kmersize <= qseq->len) {
 			if(read_score && kmersize <= qseq_r->len) { // PE
-				alnFragsPE(templates_index, matched_templates, template_lengths, mq, scoreT, qseq_comp, qseq_r_comp, qseq->seq, qseq_r->seq, header, header_r, kmersize, bestTemplates, bestTemplates_r, alignment_scores, uniq_alignment_scores, best_start_pos, best_end_pos, seq_in, index_in, seq_indexes, index_indexes, frag_out_raw, points, NWmatrices, excludeOut, excludeDB);
+				alnFragsPE(templates_index, matched_templates, template_lengths, mq, scoreT, qseq_comp, qseq_r_comp, qseq->seq, qseq_r->seq, header, header_r, kmersize, bestTemplates, bestTemplates_r, alignment_scores, uniq_alignment_scores, best_start_pos, best_end_pos, seq_in, index_in, seq_indexes, index_indexes, frag_out_raw, points, NWmatrices, clustAln, excludeOut, ticket);
 			} else { // SE
-				alnFragsSE(templates_index, matched_templates, template_lengths, mq, scoreT, rc_flag, qseq_comp, qseq_r_comp, qseq->seq, qseq_r->seq, qseq->len, kmersize, header, bestTemplates, alignment_scores, uniq_alignment_scores, best_start_pos, best_end_pos, seq_in, index_in, seq_indexes, index_indexes, frag_out_raw, points, NWmatrices, excludeOut, excludeDB);
+				alnFragsSE(templates_index, matched_templates, template_lengths, mq, scoreT, rc_flag, qseq_comp, qseq_r_comp, qseq->seq, qseq_r->seq, qseq->len, kmersize, header, bestTemplates, alignment_scores, uniq_alignment_scores, best_start_pos, best_end_pos, seq_in, index_in, seq_indexes, index_indexes, frag_out_raw, points, NWmatrices, clustAln, excludeOut, ticket);
 			}
 		}
+		unlockTurn(excludeOut, ticket);
 		lock(excludeIn);
 	}
 	unlock(excludeIn);
 	
+	/* hand back buffers */
+	thread->matched_templates = matched_templates;
+	thread->bestTemplates = bestTemplates;
+	thread->bestTemplates_r = bestTemplates_r;
+	thread->best_start_pos = best_start_pos;
+	thread->best_end_pos = best_end_pos;
+	thread->size = size;
+	
 	return NULL;
 }
@@ -150,17 +150,22 @@ void printPair(int *out_Tem, CompDNA *qseq, int bestScore, const Qseqs *header,
 	printPtr(out_Tem, qseq_r, bestScore_r, header_r);
 }
 
-int get_ankers(int *out_Tem, CompDNA *qseq, Qseqs *header, FILE *inputfile) {
+int get_ankers(int **out_Tem, int *out_size, CompDNA *qseq, Qseqs *header, FILE *inputfile) {
 	
 	int infoSize[6];
 	
 	if(fread(infoSize, sizeof(int), 6, inputfile)) {
 		qseq->seqlen = infoSize[0];
 		qseq->complen = infoSize[1];
-		*out_Tem = infoSize[4];
 		header->len = infoSize[5];
 		
 		/* reallocate */
+		if(*out_size <= infoSize[4]) {
+			free(*out_Tem);
+			*out_size = (infoSize[4] + 1) << 1;
+			*out_Tem = smalloc(*out_size * sizeof(int));
+		}
+		**out_Tem = infoSize[4];
 		if(qseq->size <= qseq->seqlen) {
 			free(qseq->N);
 			free(qseq->seq);
@@ -190,7 +195,7 @@ int get_ankers(int *out_Tem, CompDNA *qseq, Qseqs *header, FILE *inputfile) {
 		
 		fread(qseq->seq, sizeof(long unsigned), qseq->complen, inputfile);
 		fread(qseq->N + 1, sizeof(int), qseq->N[0], inputfile);
-		fread(out_Tem + 1, sizeof(int), *out_Tem, inputfile);
+		fread(*out_Tem + 1, sizeof(int), **out_Tem, inputfile);
 		fread(header->seq, 1, header->len, inputfile);
 	} else {
 		infoSize[3] = 0;
@@ -30,4 +30,4 @@ int find_contamination2(int *out_Tem, const int contamination);
 void deConPrint(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header);
 void deConPrintPair(int *out_Tem, CompDNA *qseq, int bestScore, const Qseqs *header, CompDNA *qseq_r, int bestScore_r, const Qseqs *header_r);
 void printPair(int *out_Tem, CompDNA *qseq, int bestScore, const Qseqs *header, CompDNA *qseq_r, int bestScore_r, const Qseqs *header_r);
-int get_ankers(int *out_Tem, CompDNA *qseq, Qseqs *header, FILE *inputfile);
+int get_ankers(int **out_Tem, int *out_size, CompDNA *qseq, Qseqs *header, FILE *inputfile);
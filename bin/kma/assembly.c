@@ -27,11 +27,12 @@
 #include "assembly.h"
 #include "chain.h"
 #include "filebuff.h"
+#include "frags.h"
 #include "hashmapindex.h"
-#include "kmapipe.h"
 #include "nw.h"
 #include "pherror.h"
 #include "qseqs.h"
+#include "sam.h"
 #include "stdnuc.h"
 #include "stdstat.h"
 #include "threader.h"
@@ -139,11 +140,11 @@ void updateMatrix(FileBuff *dest, char *template_name, long unsigned *template_s
 
 
 int significantNuc(int X, int Y, double evalue) {
-	return (p_chisqr(pow(X - Y, 2) / (X + Y)) <= evalue && Y < X);
+	return (p_chisqr_count(X, Y) <= evalue && Y < X);
 }
 
 int significantAnd90Nuc(int X, int Y, double evalue) {
-	return (p_chisqr(pow(X - Y, 2) / (X + Y)) <= evalue && (9 * (X + Y) <= 10 * X));
+	return (p_chisqr_count(X, Y) <= evalue && (9 * (X + Y) <= 10 * X));
 }
 
 int significantAndSupport(int X, int Y, double evalue) {
@@ -154,7 +155,7 @@ int significantAndSupport(int X, int Y, double evalue) {
 		support = evalue;
 	}
 	
-	return (p_chisqr(pow(X - Y, 2) / (X + Y)) <= evalue && (support * (X + Y) <= X));
+	return (p_chisqr_count(X, Y) <= evalue && (support * (X + Y) <= X));
 }
 
 unsigned char baseCaller(unsigned char bestNuc, unsigned char tNuc, int bestScore, int depthUpdate, double evalue, Assembly *calls) {
@@ -276,17 +277,17 @@ void * assemble_KMA_threaded(void *arg) {
 	Assemble_thread *thread = arg;
 	int i, j, t_len, aln_len, start, end, bias, myBias, gaps, pos, asm_len;
 	int read_score, depthUpdate, bestBaseScore, bestScore, template, spin;
-	int nextTemplate, file_i, file_count, delta, thread_num, mq, status, bcd;
+	int delta, thread_num, mq, bcd, flag, rc, ticket;
 	int stats[4], buffer[7];
 	unsigned coverScore;
 	long unsigned depth, depthVar;
 	const char bases[] = "ACGTN-";
 	double score, scoreT, evalue;
 	unsigned char bestNuc;
-	FILE **files, *file;
 	AlnScore alnStat;
 	Assembly *assembly;
 	FileBuff *frag_out;
+	FragIn *frags;
 	Assem *aligned_assem;
 	Aln *aligned, *gap_align;
 	Qseqs *qseq, *header;
@@ -296,8 +297,7 @@ void * assemble_KMA_threaded(void *arg) {
 	
 	/* get input */
 	template = thread->template;
-	file_count = thread->file_count;
-	files = thread->files;
+	frags = thread->frags;
 	frag_out = thread->frag_out;
 	aligned_assem = thread->aligned_assem;
 	aligned = thread->aligned;
@@ -354,6 +354,13 @@ void * assemble_KMA_threaded(void *arg) {
 		/* circularize */
 		assembly[t_len - 1].next = 0;
 		
+		/* point reads to this template, and restart numbering */
+		if(frags->index) {
+			frags->next = frags->index[template];
+		}
+		frags->ticket = 0;
+		*(frags->turn) = 0;
+		
 		/* start threads */
 		aligned_assem->score = 0;
 		mainTemplate = template;
@@ -377,199 +384,156 @@ void * assemble_KMA_threaded(void *arg) {
 		}
 		
 		/* load reads of this template */
-		file_i = 0;
-		while(file_i < file_count) {
-			lockTime(excludeIn, spin);
-			file = files[file_i];
-			if(file != 0) {
-				fread(buffer, sizeof(int), 7, file);
-				if((nextTemplate = buffer[0]) == template) {
-					/* load frag */
-					qseq->len = buffer[1];
-					stats[0] = buffer[2];
-					read_score = buffer[3];
-					stats[2] = buffer[4];
-					stats[3] = buffer[5];
-					header->len = buffer[6];
-					
-					if(qseq->size < qseq->len) {
-						free(qseq->seq);
-						qseq->size = qseq->len << 1;
-						qseq->seq = malloc(qseq->size);
-						if(!qseq->seq) {
-							ERROR();
-						}
-					}
-					if(header->size < header->len) {
-						header->size = header->len + 1;
-						free(header->seq);
-						header->seq = malloc(header->size);
-						if(!header->seq) {
-							ERROR();
-						}
-					}
-					fread(qseq->seq, 1, qseq->len, file);
-					fread(header->seq, 1, header->len, file);
-					unlock(excludeIn);
-					
-					if(delta < qseq->len) {
-						delta = qseq->len << 1;
-						free(aligned->t);
-						free(aligned->s);
-						free(aligned->q);
-						free(gap_align->t);
-						free(gap_align->s);
-						free(gap_align->q);
-						aligned->t = smalloc((delta + 1) << 1);
-						aligned->s = smalloc((delta + 1) << 1);
-						aligned->q = smalloc((delta + 1) << 1);
-						gap_align->t = smalloc((delta + 1) << 1);
-						gap_align->s = smalloc((delta + 1) << 1);
-						gap_align->q = smalloc((delta + 1) << 1);
+		while(loadFrag(frags, template, buffer, qseq, header, spin, &ticket)) {
+			stats[0] = abs(buffer[2]);
+			read_score = buffer[3];
+			flag = buffer[2] < 0 ? 16 : 0;
+			stats[2] = buffer[4];
+			stats[3] = buffer[5];
+			
+			if(delta < qseq->len) {
+				delta = qseq->len << 1;
+				free(aligned->t);
+				free(aligned->s);
+				free(aligned->q);
+				free(gap_align->t);
+				free(gap_align->s);
+				free(gap_align->q);
+				aligned->t = smalloc((delta + 1) << 1);
+				aligned->s = smalloc((delta + 1) << 1);
+				aligned->q = smalloc((delta + 1) << 1);
+				gap_align->t = smalloc((delta + 1) << 1);
+				gap_align->s = smalloc((delta + 1) << 1);
+				gap_align->q = smalloc((delta + 1) << 1);
+			}
+			
+			/* Update assembly with read, anker_rc tells if it reversed qseq */
+			rc = read_score ? 1 : anker_rc(template_index, qseq->seq, qseq->len, points);
+			if(rc) {
+				if(rc < 0) {
+					flag ^= 16;
+				}
+				/* Start with alignment */
+				if(stats[3] <= stats[2]) {
+					stats[2] = 0;
+					stats[3] = t_len;
+				}
+				alnStat = KMA(template_index, qseq->seq, qseq->len, aligned, gap_align, stats[2], MIN(t_len, stats[3]), mq, scoreT, points, NWmatrices);
+				
+				/* get read score */
+				aln_len = alnStat.len;
+				start = alnStat.pos;
+				end = start + aln_len - alnStat.gaps;
+				
+				/* Get normed score */
+				read_score = alnStat.score;
+				if(0 < aln_len) {
+					score = 1.0 * read_score / aln_len;
+				} else {
+					score = 0;
+				}
+				
+				if(0 < read_score && scoreT <= score) {
+					stats[1] = read_score;
+					stats[2] = start;
+					stats[3] = end;
+					if(t_len < end) {
+						stats[3] -= t_len;
 					}
+					/* Update backbone and counts, in fragment order */
+					lockTurn(frags->turn, ticket);
+					//lock(excludeMatrix);
+					lockTime(excludeMatrix, 10)
+					aligned_assem->score += read_score;
 					
-					/* Update assembly with read */
-					if(read_score || anker_rc(template_index, qseq->seq, qseq->len, points)) {
-						/* Start with alignment */
-						if(stats[3] <= stats[2]) {
-							stats[2] = 0;
-							stats[3] = t_len;
-						}
-						alnStat = KMA(template_index, qseq->seq, qseq->len, aligned, gap_align, stats[2], MIN(t_len, stats[3]), mq, scoreT, points, NWmatrices);
-						
-						/* get read score */
-						aln_len = alnStat.len;
-						start = alnStat.pos;
-						end = start + aln_len - alnStat.gaps;
-						
-						/* Get normed score */
-						read_score = alnStat.score;
-						if(0 < aln_len) {
-							score = 1.0 * read_score / aln_len;
-						} else {
-							score = 0;
-						}
-						
-						if(0 < read_score && scoreT <= score) {
-							stats[1] = read_score;
-							stats[2] = start;
-							stats[3] = end;
-							if(t_len < end) {
-								stats[3] -= t_len;
-							}
-							/* Update backbone and counts */
-							//lock(excludeMatrix);
-							lockTime(excludeMatrix, 10)
-							aligned_assem->score += read_score;
-							
-							/* diff */
-							i = 0;
-							pos = start;
-							assembly = matrix->assmb;
-							while(i < aln_len) {
-								if(aligned->t[i] == 5) { // Template gap, insertion
-									if(t_len <= pos) {
-										assembly[pos].counts[aligned->q[i]]++;
-										++i;
-										pos = assembly[pos].next;
-									} else {
-										/* get estimate for non insertions */
-										myBias = 0;
-										for(j = 0; j < 6; ++j) {
-											myBias += assembly[pos].counts[j];
-										}
-										if(myBias > 0) {
-											--myBias;
-										}
-										/* find position of insertion */
-										gaps = pos;
-										if(pos != 0) {
-											--pos;
-										} else {
-											pos = t_len - 1;
-										}
-										while(assembly[pos].next != gaps) {
-											pos = assembly[pos].next;
-										}
-										while(i < aln_len && aligned->t[i] == 5) {
-											assembly[pos].next = matrix->len++;
-											if(matrix->len == matrix->size) {
-												matrix->size <<= 1;
-												matrix->assmb = realloc(assembly, matrix->size * sizeof(Assembly));
-												if(!matrix->assmb) {
-													matrix->size >>= 1;
-													matrix->size += 1024;
-													matrix->assmb = realloc(assembly, matrix->size * sizeof(Assembly));
-													if(!matrix->assmb) {
-														ERROR();
-													}
-												}
-												assembly = matrix->assmb;
+					/* diff */
+					i = 0;
+					pos = start;
+					assembly = matrix->assmb;
+					while(i < aln_len) {
+						if(aligned->t[i] == 5) { // Template gap, insertion
+							if(t_len <= pos) {
+								assembly[pos].counts[aligned->q[i]]++;
+								++i;
+								pos = assembly[pos].next;
+							} else {
+								/* get estimate for non insertions */
+								myBias = 0;
+								for(j = 0; j < 6; ++j) {
+									myBias += assembly[pos].counts[j];
+								}
+								if(myBias > 0) {
+									--myBias;
+								}
+								/* find position of insertion */
+								gaps = pos;
+								if(pos != 0) {
+									--pos;
+								} else {
+									pos = t_len - 1;
+								}
+								while(assembly[pos].next != gaps) {
+									pos = assembly[pos].next;
+								}
+								while(i < aln_len && aligned->t[i] == 5) {
+									assembly[pos].next = matrix->len++;
+									if(matrix->len == matrix->size) {
+										matrix->size <<= 1;
+										matrix->assmb = realloc(assembly, matrix->size * sizeof(Assembly));
+										if(!matrix->assmb) {
+											matrix->size >>= 1;
+											matrix->size += 1024;
+											matrix->assmb = realloc(assembly, matrix->size * sizeof(Assembly));
+											if(!matrix->assmb) {
+												ERROR();
 											}
-											pos = assembly[pos].next;
-											assembly[pos].next = gaps;
-											assembly[pos].counts[0] = 0;
-											assembly[pos].counts[1] = 0;
-											assembly[pos].counts[2] = 0;
-											assembly[pos].counts[3] = 0;
-											assembly[pos].counts[4] = 0;
-											assembly[pos].counts[5] = myBias;
-											assembly[pos].counts[aligned->q[i]]++;
-											
-											++i;
 										}
-										pos = assembly[pos].next;
+										assembly = matrix->assmb;
 									}
-								} else if(t_len <= pos) { // Old template gap, not present in this read
-									assembly[pos].counts[5]++;
 									pos = assembly[pos].next;
-								} else {
+									assembly[pos].next = gaps;
+									assembly[pos].counts[0] = 0;
+									assembly[pos].counts[1] = 0;
+									assembly[pos].counts[2] = 0;
+									assembly[pos].counts[3] = 0;
+									assembly[pos].counts[4] = 0;
+									assembly[pos].counts[5] = myBias;
 									assembly[pos].counts[aligned->q[i]]++;
+									
 									++i;
-									pos = assembly[pos].next;
 								}
+								pos = assembly[pos].next;
 							}
-							
-							unlock(excludeMatrix);
-							
-							/* Convert fragment */
-							for(i = 0; i < qseq->len; ++i) {
-								 qseq->seq[i] = bases[qseq->seq[i]];
-							}
-							qseq->seq[qseq->len] = 0;
-							
-							/* Save fragment */
-							//lock(excludeOut);
-							lockTime(excludeOut, 10);
-							updateFrags(frag_out, qseq, header, template_name, stats);
-							unlock(excludeOut);
-							//fprintf(frag_out, "%s\t%d\t%d\t%d\t%d\t%s\t%s\n", qseq->seq, stats[0], stats[1], stats[2], stats[3], template_names[template], header->seq);
+						} else if(t_len <= pos) { // Old template gap, not present in this read
+							assembly[pos].counts[5]++;
+							pos = assembly[pos].next;
+						} else {
+							assembly[pos].counts[aligned->q[i]]++;
+							++i;
+							pos = assembly[pos].next;
 						}
 					}
-				} else if(nextTemplate == -1) {
-					if(template) {
-						fclose(file);
-					} else {
-						kmaPipe(0, 0, file, &status);
-						errno |= status;
+					
+					unlock(excludeMatrix);
+					
+					/* Convert fragment */
+					for(i = 0; i < qseq->len; ++i) {
+						 qseq->seq[i] = bases[qseq->seq[i]];
 					}
-					files[file_i] = 0;
-					unlock(excludeIn);
-					++file_i;
-				} else if(nextTemplate < template) {
-					/* Move pointer forward */
-					fseek(file, buffer[1] + buffer[6], SEEK_CUR);
-					unlock(excludeIn);
-				} else {
-					/* Move pointer back */
-					fseek(file, (-7) * sizeof(int), SEEK_CUR);
-					unlock(excludeIn);
-					++file_i;
+					qseq->seq[qseq->len] = 0;
+					
+					/* Save fragment */
+					//lock(excludeOut);
+					lockTime(excludeOut, 10);
+					if(samOut) {
+						samwrite(samOut, qseq, header, template_name, aligned, start, t_len, flag, read_score);
+					}
+					updateFragsPtr(frag_out, qseq, header, template_name, stats);
+					unlock(excludeOut);
+					//fprintf(frag_out, "%s\t%d\t%d\t%d\t%d\t%s\t%s\n", qseq->seq, stats[0], stats[1], stats[2], stats[3], template_names[template], header->seq);
 				}
-			} else {
-				unlock(excludeIn);
-				++file_i;
 			}
+			unlockTurn(frags->turn, ticket);
 		}
 		lock(excludeIn);
 		--thread_wait;
@@ -577,6 +541,9 @@ void * assemble_KMA_threaded(void *arg) {
 	} while(thread->num != 0);
 	
 	wait_atomic(thread_wait);
+	if(samOut) {
+		samFlush(samOut);
+	}
 	
 	if(aligned_assem->score == 0) {
 		aligned_assem->cover = 0;
@@ -706,18 +673,18 @@ void * assemble_KMA_dense_threaded(void *arg) {
 	static char *template_name;
 	static HashMap_index *template_index;
 	Assemble_thread *thread = arg;
-	int i, j, t_len, aln_len, start, end, file_i, file_count, template, spin;
-	int pos, read_score, bestScore, depthUpdate, bestBaseScore, nextTemplate;
-	int thread_num, mq, status, bcd, stats[4], buffer[7];
+	int i, j, t_len, aln_len, start, end, template, spin;
+	int pos, read_score, bestScore, depthUpdate, bestBaseScore;
+	int thread_num, mq, bcd, flag, rc, ticket, stats[4], buffer[7];
 	unsigned coverScore, delta;
 	long unsigned depth, depthVar;
 	const char bases[] = "ACGTN-";
 	double score, scoreT, evalue;
 	unsigned char bestNuc;
-	FILE **files, *file;
 	AlnScore alnStat;
 	Assembly *assembly;
 	FileBuff *frag_out;
+	FragIn *frags;
 	Assem *aligned_assem;
 	Aln *aligned, *gap_align;
 	Qseqs *qseq, *header;
@@ -727,8 +694,7 @@ void * assemble_KMA_dense_threaded(void *arg) {
 	
 	/* get input */
 	template = thread->template;
-	file_count = thread->file_count;
-	files = thread->files;
+	frags = thread->frags;
 	frag_out = thread->frag_out;
 	aligned_assem = thread->aligned_assem;
 	aligned = thread->aligned;
@@ -801,6 +767,13 @@ void * assemble_KMA_dense_threaded(void *arg) {
 		/* circularize */
 		assembly[t_len - 1].next = 0;
 		
+		/* point reads to this template, and restart numbering */
+		if(frags->index) {
+			frags->next = frags->index[template];
+		}
+		frags->ticket = 0;
+		*(frags->turn) = 0;
+		
 		/* start threads */
 		aligned_assem->score = 0;
 		mainTemplate = template;
@@ -825,143 +798,101 @@ void * assemble_KMA_dense_threaded(void *arg) {
 		}
 		
 		/* load reads of this template */
-		file_i = 0;
-		while(file_i < file_count) {
-			lockTime(excludeIn, spin);
-			file = files[file_i];
-			if(file != 0) {
-				fread(buffer, sizeof(int), 7, file);
-				if((nextTemplate = buffer[0]) == template) {
-					/* load frag */
-					qseq->len = buffer[1];
-					stats[0] = buffer[2];
-					read_score = buffer[3];
-					stats[2] = buffer[4];
-					stats[3] = buffer[5];
-					header->len = buffer[6];
-					if(qseq->size < qseq->len) {
-						free(qseq->seq);
-						qseq->size = qseq->len << 1;
-						qseq->seq = malloc(qseq->size);
-						if(!qseq->seq) {
-							ERROR();
-						}
-					}
-					if(header->size < header->len) {
-						header->size = header->len + 1;
-						free(header->seq);
-						header->seq = malloc(header->size);
-						if(!header->seq) {
-							ERROR();
-						}
+		while(loadFrag(frags, template, buffer, qseq, header, spin, &ticket)) {
+			stats[0] = abs(buffer[2]);
+			read_score = buffer[3];
+			flag = buffer[2] < 0 ? 16 : 0;
+			stats[2] = buffer[4];
+			stats[3] = buffer[5];
+			
+			if(delta < qseq->size) {
+				delta = qseq->size;
+				free(aligned->t);
+				free(aligned->s);
+				free(aligned->q);
+				free(gap_align->t);
+				free(gap_align->s);
+				free(gap_align->q);
+				aligned->t = malloc((delta + 1) << 1);
+				aligned->s = malloc((delta + 1) << 1);
+				aligned->q = malloc((delta + 1) << 1);
+				gap_align->t = malloc((delta + 1) << 1);
+				gap_align->s = malloc((delta + 1) << 1);
+				gap_align->q = malloc((delta + 1) << 1);
+				if(!aligned->t || !aligned->s || !aligned->q || !gap_align->t || !gap_align->s || !gap_align->q) {
+					ERROR();
+				}
+			}
+			
+			/* Update assembly with read, anker_rc tells if it reversed qseq */
+			rc = read_score ? 1 : anker_rc(template_index, qseq->seq, qseq->len, points);
+			if(rc) {
+				if(rc < 0) {
+					flag ^= 16;
+				}
+				if(stats[3] <= stats[2]) {
+					stats[2] = 0;
+					stats[3] = t_len;
+				}
+				/* Start with alignment */
+				alnStat = KMA(template_index, qseq->seq, qseq->len, aligned, gap_align, stats[2], MIN(t_len, stats[3]), mq, scoreT, points, NWmatrices);
+				
+				/* get read score */
+				aln_len = alnStat.len;
+				start = alnStat.pos;
+				end = start + aln_len - alnStat.gaps;
+				
+				/* Get normed score */
+				read_score = alnStat.score;
+				if(0 < aln_len) {
+					score = 1.0 * read_score / aln_len;
+				} else {
+					score = 0;
+					read_score = 0;
+				}
+				
+				if(0 < read_score && scoreT <= score) {
+					
+					stats[1] = read_score;
+					stats[2] = start;
+					stats[3] = end;
+					if(t_len < end) {
+						stats[3] -= t_len;
 					}
-					fread(qseq->seq, 1, qseq->len, file);
-					fread(header->seq, 1, header->len, file);
-					unlock(excludeIn);
+					/* Update backbone and counts, in fragment order */
+					lockTurn(frags->turn, ticket);
+					//lock(excludeMatrix);
+					lockTime(excludeMatrix, 10)
+					aligned_assem->score += read_score;
 					
-					if(delta < qseq->size) {
-						delta = qseq->size;
-						free(aligned->t);
-						free(aligned->s);
-						free(aligned->q);
-						free(gap_align->t);
-						free(gap_align->s);
-						free(gap_align->q);
-						aligned->t = malloc((delta + 1) << 1);
-						aligned->s = malloc((delta + 1) << 1);
-						aligned->q = malloc((delta + 1) << 1);
-						gap_align->t = malloc((delta + 1) << 1);
-						gap_align->s = malloc((delta + 1) << 1);
-						gap_align->q = malloc((delta + 1) << 1);
-						if(!aligned->t || !aligned->s || !aligned->q || !gap_align->t || !gap_align->s || !gap_align->q) {
-							ERROR();
+					/* diff */
+					for(i = 0, pos = start; i < aln_len; ++i) {
+						if(aligned->t[i] == aligned_assem->t[pos]) {
+							assembly[pos].counts[aligned->q[i]]++;
+							pos = assembly[pos].next;
 						}
 					}
+					unlock(excludeMatrix);
 					
-					/* Update assembly with read */
-					if(read_score || anker_rc(template_index, qseq->seq, qseq->len, points)) {
-						if(stats[3] <= stats[2]) {
-							stats[2] = 0;
-							stats[3] = t_len;
-						}
-						/* Start with alignment */
-						alnStat = KMA(template_index, qseq->seq, qseq->len, aligned, gap_align, stats[2], MIN(t_len, stats[3]), mq, scoreT, points, NWmatrices);
-						
-						/* get read score */
-						aln_len = alnStat.len;
-						start = alnStat.pos;
-						end = start + aln_len - alnStat.gaps;
-						
-						/* Get normed score */
-						read_score = alnStat.score;
-						if(0 < aln_len) {
-							score = 1.0 * read_score / aln_len;
-						} else {
-							score = 0;
-							read_score = 0;
-						}
-						
-						if(0 < read_score && scoreT <= score) {
-							
-							stats[1] = read_score;
-							stats[2] = start;
-							stats[3] = end;
-							if(t_len < end) {
-								stats[3] -= t_len;
-							}
-							/* Update backbone and counts */
-							//lock(excludeMatrix);
-							lockTime(excludeMatrix, 10)
-							aligned_assem->score += read_score;
-							
-							/* diff */
-							for(i = 0, pos = start; i < aln_len; ++i) {
-								if(aligned->t[i] == aligned_assem->t[pos]) {
-									assembly[pos].counts[aligned->q[i]]++;
-									pos = assembly[pos].next;
-								}
-							}
-							unlock(excludeMatrix);
-							
-							/* Convert fragment */
-							for(i = 0; i < qseq->len; ++i) {
-								 qseq->seq[i] = bases[qseq->seq[i]];
-							}
-							qseq->seq[qseq->len] = 0;
-							
-							/* Save fragment */
-							//lock(excludeOut);
-							lockTime(excludeOut, 10);
-							updateFrags(frag_out, qseq, header, template_name, stats);
-							unlock(excludeOut);
-							
-							//fprintf(frag_out, "%s\t%d\t%d\t%d\t%d\t%s\t%s\n", qseq->seq, stats[0], stats[1], stats[2], stats[3], template_names[template], header->seq);
-						}
+					/* Convert fragment */
+					for(i = 0; i < qseq->len; ++i) {
+						 qseq->seq[i] = bases[qseq->seq[i]];
 					}
-				} else if (nextTemplate == -1) {
-					if(template) {
-						fclose(file);
-					} else {
-						kmaPipe(0, 0, file, &status);
-						errno |= status;
+					qseq->seq[qseq->len] = 0;
+					
+					/* Save fragment */
+					//lock(excludeOut);
+					lockTime(excludeOut, 10);
+					if(samOut) {
+						samwrite(samOut, qseq, header, template_name, aligned, start, t_len, flag, read_score);
 					}
-					files[file_i] = 0;
-					unlock(excludeIn);
-					++file_i;
-				} else if(nextTemplate < template) {
-					/* Move pointer forward */
-					fseek(file, buffer[1] + buffer[6], SEEK_CUR);
-					unlock(excludeIn);
-				} else {
-					/* Move pointer back */
-					fseek(file, (-7) * sizeof(int), SEEK_CUR);
-					unlock(excludeIn);
-					++file_i;
+					updateFragsPtr(frag_out, qseq, header, template_name, stats);
+					unlock(excludeOut);
+					
+					//fprintf(frag_out, "%s\t%d\t%d\t%d\t%d\t%s\t%s\n", qseq->seq, stats[0], stats[1], stats[2], stats[3], template_names[template], header->seq);
 				}
-			} else {
-				unlock(excludeIn);
-				++file_i;
 			}
+			unlockTurn(frags->turn, ticket);
 		}
 		
 		lock(excludeIn);
@@ -971,6 +902,9 @@ void * assemble_KMA_dense_threaded(void *arg) {
 	} while(thread->num != 0);
 	
 	wait_atomic(thread_wait);
+	if(samOut) {
+		samFlush(samOut);
+	}
 	
 	if(aligned_assem->score == 0) {
 		aligned_assem->cover = 0;
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include "chain.h"
 #include "filebuff.h"
+#include "frags.h"
 #include "hashmapindex.h"
 #include "nw.h"
 #include "qseqs.h"
@@ -59,7 +60,6 @@ struct assemble_thread {
 	pthread_t id;
 	int num;
 	int template;
-	int file_count;
 	int spin;
 	int mq;
 	int bcd;
@@ -67,7 +67,7 @@ struct assemble_thread {
 	double scoreT;
 	double evalue;
 	char *template_name;
-	FILE **files;
+	FragIn *frags;
 	FileBuff *frag_out;
 	Assem *aligned_assem;
 	Aln *aligned, *gap_align;
@@ -82,8 +82,10 @@ struct assemble_thread {
 #endif
 
 void * (*assembly_KMA_Ptr)(void *);
+void (*updateFragsPtr)(FileBuff *, Qseqs *, Qseqs *, char *, int *);
 int (*significantBase)(int, int, double);
 unsigned char (*baseCall)(unsigned char, unsigned char, int, int, double, Assembly*);
+void updateFrags(FileBuff *dest, Qseqs *qseq, Qseqs *header, char *template_name, int *stats);
 void updateMatrix(FileBuff *dest, char *template_name, long unsigned *template_seq, AssemInfo *matrix, int t_len);
 int significantNuc(int X, int Y, double evalue);
 int significantAnd90Nuc(int X, int Y, double evalue);
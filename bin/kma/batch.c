@@ -0,0 +1,253 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#ifndef _WIN32
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/types.h>
+#else
+typedef int key_t;
+#define ftok(charPtr, integer) (0)
+#define shmget(key, size, permission) ((size != 0) ? (-1) : (-key))
+#define shmdt(dest) fprintf(stderr, "sysV not available on Windows.\n")
+#define shmctl(shmid, cmd, buf) fprintf(stderr, "sysV not available on Windows.\n")
+#endif
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "hashmapkma.h"
+#include "kmapipe.h"
+#include "pherror.h"
+#include "shm.h"
+
+/* ids of the shared DB parts, removed at exit or on a fatal signal */
+static int batchShmids[5];
+static volatile int batchShmNum = 0;
+
+static void batch_keepSHM(const char *filename, const char *ids) {
+	
+	int shmid;
+	
+	while(*ids) {
+		if(0 <= (shmid = shmget(ftok(filename, *ids), 0, 0666))) {
+			batchShmids[batchShmNum++] = shmid;
+		}
+		++ids;
+	}
+}
+
+static void batch_removeSHM(void) {
+	
+	/* only shmctl, so it is safe from a signal handler */
+	while(batchShmNum) {
+		shmctl(batchShmids[--batchShmNum], IPC_RMID, NULL);
+	}
+}
+
+static void batch_signalSHM(int sig) {
+	
+	batch_removeSHM();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static unsigned batch_setupSHM(char *templatefilename, unsigned shmLvl) {
+	
+	/* put the requested DB parts in shared memory, dropping parts that fail */
+	int file_len, *lengths;
+	FILE *file;
+	HashMapKMA templates[1];
+	
+	file_len = strlen(templatefilename);
+	
+	/* *.comp.b / *.decon.comp.b */
+	if(shmLvl & 3) {
+		strcat(templatefilename, (shmLvl & 2) ? ".decon.comp.b" : ".comp.b");
+		if(!(file = fopen(templatefilename, "rb"))) {
+			shmLvl &= ~3;
+		} else if(hashMapKMA_setupSHM(templates, file, templatefilename)) {
+			hashMap_shm_detach(templates);
+			rewind(file);
+			hashMapKMA_destroySHM(templates, file, templatefilename);
+			shmLvl &= ~3;
+		} else {
+			hashMap_shm_detach(templates);
+			batch_keepSHM(templatefilename, "evki");
+		}
+		if(file) {
+			fclose(file);
+		}
+		templatefilename[file_len] = 0;
+	}
+	
+	/* *.length.b */
+	if(shmLvl & 4) {
+		strcat(templatefilename, ".length.b");
+		if(!(file = fopen(templatefilename, "rb"))) {
+			shmLvl &= ~4;
+		} else {
+			if((lengths = length_setupSHM(file, templatefilename))) {
+				shmdt(lengths);
+				batch_keepSHM(templatefilename, "l");
+			} else {
+				shmLvl &= ~4;
+			}
+			fclose(file);
+		}
+		templatefilename[file_len] = 0;
+	}
+	
+	return shmLvl;
+}
+
+static char * batch_quote(char *dest, const char *src) {
+	
+	/* single quote src for sh, closing the quote around single quotes */
+	*dest++ = ' ';
+	*dest++ = '\'';
+	while(*src) {
+		if(*src == '\'') {
+			memcpy(dest, "'\\''", 4);
+			dest += 4;
+		} else {
+			*dest++ = *src;
+		}
+		++src;
+	}
+	*dest++ = '\'';
+	*dest = 0;
+	
+	return dest;
+}
+
+static char * batch_getLine(char **line, int *size, FILE *file) {
+	
+	int len;
+	
+	len = 0;
+	while(fgets(*line + len, *size - len, file)) {
+		len += strlen(*line + len);
+		if((*line)[len - 1] == '\n') {
+			break;
+		} else if(len == *size - 1) {
+			*size <<= 1;
+			*line = realloc(*line, *size);
+			if(!*line) {
+				ERROR();
+			}
+		}
+	}
+	if(len == 0) {
+		return 0;
+	}
+	
+	/* chomp */
+	while(len && ((*line)[len - 1] == '\n' || (*line)[len - 1] == '\r')) {
+		(*line)[--len] = 0;
+	}
+	
+	return *line;
+}
+
+int runKMA_batch(char *batchfilename, char *templatefilename, char *exeBasic, unsigned shm, unsigned shmLvl) {
+	
+	/*
+	 * Every line of the batch file holds a sample: "output<TAB>input[<TAB>mate]".
+	 * The DB is put in shared memory once, and each sample is then mapped by
+	 * a normal kma run attached to it, unless the user already shares the DB
+	 * through kma_shm.
+	 */
+	int i, size, lineNum, fileNum, status, sampleStatus;
+	char *line, *cmd, *fields[4], *ptr;
+	char buff[4096];
+	FILE *batchfile, *sampleOut;
+	
+	batchfile = sfopen(batchfilename, "rb");
+	if(shm == 0 && shmLvl) {
+		shm = batch_setupSHM(templatefilename, shmLvl);
+		if(shm == 0) {
+			fprintf(stderr, "# Could not share the DB, it will be loaded for each sample.\n");
+		} else {
+			/* do not leak the segments if kma stops early */
+			atexit(&batch_removeSHM);
+			signal(SIGINT, &batch_signalSHM);
+			signal(SIGTERM, &batch_signalSHM);
+			signal(SIGHUP, &batch_signalSHM);
+		}
+	}
+	
+	size = 1024;
+	line = smalloc(size);
+	cmd = 0;
+	lineNum = 0;
+	status = 0;
+	while(batch_getLine(&line, &size, batchfile)) {
+		++lineNum;
+		if(*line == 0 || *line == '#') {
+			continue;
+		}
+		
+		/* split fields */
+		fileNum = 0;
+		ptr = line;
+		while(ptr && fileNum < 4) {
+			fields[fileNum++] = ptr;
+			if((ptr = strchr(ptr, '\t'))) {
+				*ptr++ = 0;
+			}
+		}
+		if(fileNum < 2 || 3 < fileNum) {
+			fprintf(stderr, "Invalid sample on line %d in batch file:\t%s\n", lineNum, batchfilename);
+			status = 1;
+			break;
+		}
+		
+		/* map sample, with the fields quoted against the shell */
+		cmd = realloc(cmd, strlen(exeBasic) + (size << 2) + 64);
+		if(!cmd) {
+			ERROR();
+		}
+		ptr = cmd + sprintf(cmd, "%s-o", exeBasic);
+		ptr = batch_quote(ptr, fields[0]);
+		ptr += sprintf(ptr, fileNum == 2 ? " -i" : " -ipe");
+		for(i = 1; i < fileNum; ++i) {
+			ptr = batch_quote(ptr, fields[i]);
+		}
+		sprintf(ptr, " -shm %u", shm);
+		fprintf(stderr, "# Sample:\t%s\n", fields[0]);
+		sampleOut = kmaPipe(cmd, "rb", 0, 0);
+		while((fileNum = fread(buff, 1, sizeof(buff), sampleOut))) {
+			sfwrite(buff, 1, fileNum, stdout);
+		}
+		kmaPipe(0, 0, sampleOut, &sampleStatus);
+		if(sampleStatus) {
+			fprintf(stderr, "# Sample failed:\t%s\n", fields[0]);
+			status |= sampleStatus;
+		}
+	}
+	fclose(batchfile);
+	free(line);
+	free(cmd);
+	
+	batch_removeSHM();
+	
+	return status;
+}
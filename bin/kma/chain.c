@@ -19,9 +19,13 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "chain.h"
+#include "compdna.h"
+#include "hashmapindex.h"
 #include "penalties.h"
 #include "pherror.h"
+#include "stdnuc.h"
 #include "stdstat.h"
 
 AlnPoints * seedPoint_init(int size, Penalties *rewards) {
@@ -39,6 +43,10 @@ AlnPoints * seedPoint_init(int size, Penalties *rewards) {
 	dest->weight = smalloc(size);
 	dest->score = smalloc(size);
 	dest->next = smalloc(size);
+	dest->qComp = smalloc(sizeof(CompDNA));
+	allocComp(dest->qComp, 1024);
+	dest->miniSize = 1024;
+	dest->minimizers = smalloc(dest->miniSize);
 	dest->rewards = rewards;
 	
 	return dest;
@@ -60,6 +68,38 @@ void seedPoint_realloc(AlnPoints *dest, int size) {
 	}
 }
 
+void seedPoint_pack(AlnPoints *dest, unsigned char *qseq, int q_len) {
+	
+	/* 2-bit pack the query for word-wise seed extension */
+	if(dest->qComp->size <= q_len) {
+		freeComp(dest->qComp);
+		allocComp(dest->qComp, q_len << 1);
+	}
+	resetComp(dest->qComp);
+	compDNA(dest->qComp, qseq, q_len);
+}
+
+unsigned char * seedPoint_minimizers(AlnPoints *dest, const unsigned char *qseq, const long unsigned *qComp, int q_len, int kmersize) {
+	
+	int begin, end;
+	
+	/* mark query minimizers, windows do not cross N's */
+	if(dest->miniSize <= q_len) {
+		free(dest->minimizers);
+		dest->miniSize = q_len << 1;
+		dest->minimizers = smalloc(dest->miniSize);
+	}
+	memset(dest->minimizers, 0, q_len);
+	for(begin = 0; begin < q_len; begin = end + 1) {
+		if((end = charpos(qseq, 4, begin, q_len)) == -1) {
+			end = q_len;
+		}
+		minimizerMark(qComp, begin, end - kmersize + 1, kmersize, minimizerW, dest->minimizers);
+	}
+	
+	return dest->minimizers;
+}
+
 void seedPoint_free(AlnPoints *src) {
 	
 	free(src->tStart);
@@ -69,10 +109,17 @@ void seedPoint_free(AlnPoints *src) {
 	free(src->weight);
 	free(src->score);
 	free(src->next);
+	freeComp(src->qComp);
+	free(src->qComp);
+	free(src->minimizers);
 	src->rewards = 0;
 	free(src);
 }
 
+/*
+ Backward DP over the seeds in query order, linking each seed to the best
+ of the CHAIN_BAND following seeds, O(CHAIN_BAND * n).
+*/
 int chainSeeds(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *mapQ) {
 	
 	int i, j, nMems, weight, gap, score, bestScore, secondScore, bestPos;
@@ -108,8 +155,8 @@ int chainSeeds(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *
 		}
 		score += weight;
 		
-		/* 64 is the bandwidth */
-		nMin = MIN(nMems, i + 64);
+		/* band of following seeds */
+		nMin = MIN(nMems, i + CHAIN_BAND);
 		
 		/* find best link */
 		for(j = i + 1; j < nMin; ++j) {
@@ -243,8 +290,8 @@ int chainSeeds_circular(AlnPoints *points, int q_len, int t_len, int kmersize, u
 		}
 		score += weight;
 		
-		/* 64 is the bandwidth */
-		nMin = MIN(nMems, i + 64);
+		/* band of following seeds */
+		nMin = MIN(nMems, i + CHAIN_BAND);
 		
 		/* find best link */
 		for(j = i + 1; j < nMin; ++j) {
@@ -17,6 +17,7 @@
  * limitations under the License.
 */
 
+#include "compdna.h"
 #include "penalties.h"
 
 #ifndef CHAIN
@@ -31,17 +32,25 @@ struct alnPoints {
 	int *weight;
 	int *score;
 	int *next;
+	CompDNA *qComp;
+	int miniSize;
+	unsigned char *minimizers;
 	Penalties *rewards;
 };
 #define CHAIN 1
 #endif
 
+/* number of following seeds a seed may link to */
+#define CHAIN_BAND 64
+
 /* pointer to chaining method */
 int (*chainSeedsPtr)(AlnPoints *, int, int, int, unsigned *);
 
 /* FUNCTIONS */
 AlnPoints * seedPoint_init(int size, Penalties *rewards);
 void seedPoint_realloc(AlnPoints *dest, int size);
+void seedPoint_pack(AlnPoints *dest, unsigned char *qseq, int q_len);
+unsigned char * seedPoint_minimizers(AlnPoints *dest, const unsigned char *qseq, const long unsigned *qComp, int q_len, int kmersize);
 void seedPoint_free(AlnPoints *src);
 int chainSeeds(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *mapQ);
 int chainSeeds_circular(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *mapQ);
\ No newline at end of file
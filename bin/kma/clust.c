@@ -0,0 +1,324 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clust.h"
+#include "nw.h"
+#include "pherror.h"
+#include "stdnuc.h"
+
+/*
+ Allele clusters, *.clust.b:
+ int DB_size, int rep[DB_size], int n[DB_size],
+ followed by the n variants of each template against its representative.
+ Only templates of equal length differing by substitutions are clustered.
+*/
+
+int clustFlag = 0;
+TemplateClust *templateClust = 0;
+
+static int cmpKey(const void *a, const void *b) {
+	
+	long unsigned A, B;
+	
+	A = *((long unsigned *) a);
+	B = *((long unsigned *) b);
+	
+	return (A > B) - (A < B);
+}
+
+int clust_dist(const long unsigned *seq1, const long unsigned *seq2, int len, int maxVar) {
+	
+	int i, end, dist;
+	long unsigned diff;
+	
+	/* count differing bases, 32 at a time */
+	end = len >> 5;
+	dist = 0;
+	for(i = 0; i <= end && dist <= maxVar; ++i) {
+		diff = seq1[i] ^ seq2[i];
+		if(i == end) {
+			diff = (len & 31) ? diff & (0xFFFFFFFFFFFFFFFF << (64 - ((len & 31) << 1))) : 0;
+		}
+		diff = (diff | (diff >> 1)) & 0x5555555555555555;
+		dist += __builtin_popcountl(diff);
+	}
+	
+	return dist;
+}
+
+void clust_make(char *filename, int maxVar) {
+	
+	int i, j, k, n, w, file_len, DB_size, len, repNum, *lengths, *rep, *nVar;
+	int *reps;
+	long unsigned *seq, *keys, *seq1, *seq2, diff, total;
+	long *offsets;
+	unsigned *var;
+	FILE *file;
+	
+	/* load lengths */
+	file_len = strlen(filename);
+	strcat(filename, ".length.b");
+	file = sfopen(filename, "rb");
+	filename[file_len] = 0;
+	sfread(&DB_size, sizeof(int), 1, file);
+	lengths = smalloc(DB_size * sizeof(int));
+	sfread(lengths, sizeof(int), DB_size, file);
+	fclose(file);
+	
+	/* load packed templates */
+	offsets = smalloc((DB_size + 1) * sizeof(long));
+	*offsets = 0;
+	offsets[1] = 0;
+	for(i = 2; i <= DB_size; ++i) {
+		offsets[i] = offsets[i - 1] + (lengths[i - 1] >> 5) + 1;
+	}
+	total = offsets[DB_size];
+	seq = smalloc(total * sizeof(long unsigned));
+	strcat(filename, ".seq.b");
+	file = sfopen(filename, "rb");
+	filename[file_len] = 0;
+	sfread(seq, sizeof(long unsigned), total, file);
+	fclose(file);
+	
+	/* order templates by length */
+	keys = smalloc(DB_size * sizeof(long unsigned));
+	for(i = 1; i < DB_size; ++i) {
+		keys[i - 1] = ((long unsigned)(lengths[i]) << 32) | i;
+	}
+	qsort(keys, DB_size - 1, sizeof(long unsigned), cmpKey);
+	
+	/* assign alleles to the first representative within maxVar */
+	rep = calloc(DB_size, sizeof(int));
+	nVar = calloc(DB_size, sizeof(int));
+	reps = smalloc(DB_size * sizeof(int));
+	if(!rep || !nVar) {
+		ERROR();
+	}
+	repNum = 0;
+	for(i = 0; i < DB_size - 1; i = j) {
+		len = keys[i] >> 32;
+		n = 0;
+		for(j = i; j < DB_size - 1 && (keys[j] >> 32) == len; ++j) {
+			seq1 = seq + offsets[keys[j] & 0xFFFFFFFF];
+			for(k = 0; k < n; ++k) {
+				seq2 = seq + offsets[reps[k]];
+				if((nVar[keys[j] & 0xFFFFFFFF] = clust_dist(seq1, seq2, len, maxVar)) <= maxVar) {
+					rep[keys[j] & 0xFFFFFFFF] = reps[k];
+					rep[reps[k]] = reps[k];
+					break;
+				}
+			}
+			if(k == n) {
+				nVar[keys[j] & 0xFFFFFFFF] = 0;
+				reps[n++] = keys[j] & 0xFFFFFFFF;
+			}
+		}
+	}
+	for(i = 1; i < DB_size; ++i) {
+		if(rep[i] == i) {
+			++repNum;
+		} else if(rep[i] == 0) {
+			nVar[i] = 0;
+		}
+	}
+	
+	/* dump clusters and variants */
+	strcat(filename, ".clust.b");
+	file = sfopen(filename, "wb");
+	filename[file_len] = 0;
+	cfwrite(&DB_size, sizeof(int), 1, file);
+	cfwrite(rep, sizeof(int), DB_size, file);
+	cfwrite(nVar, sizeof(int), DB_size, file);
+	var = smalloc((maxVar + 1) * sizeof(unsigned));
+	for(i = 1, k = 0; i < DB_size; ++i) {
+		if(rep[i] && rep[i] != i) {
+			seq1 = seq + offsets[i];
+			seq2 = seq + offsets[rep[i]];
+			n = 0;
+			for(w = 0; w <= (lengths[i] >> 5); ++w) {
+				diff = seq1[w] ^ seq2[w];
+				if(w == (lengths[i] >> 5)) {
+					diff = (lengths[i] & 31) ? diff & (0xFFFFFFFFFFFFFFFF << (64 - ((lengths[i] & 31) << 1))) : 0;
+				}
+				diff = (diff | (diff >> 1)) & 0x5555555555555555;
+				while(diff) {
+					j = __builtin_clzl(diff);
+					len = (w << 5) + (j >> 1);
+					var[n++] = (len << 3) | getNuc(seq1, len);
+					diff ^= 1UL << (63 - j);
+				}
+			}
+			cfwrite(var, sizeof(unsigned), n, file);
+			++k;
+		}
+	}
+	fclose(file);
+	fprintf(stderr, "# Clustered %d alleles on %d representatives.\n", k, repNum);
+	
+	free(lengths);
+	free(offsets);
+	free(seq);
+	free(keys);
+	free(rep);
+	free(nVar);
+	free(reps);
+	free(var);
+}
+
+TemplateClust * clust_load(char *filename, int DB_size) {
+	
+	int i, file_len, *nVar;
+	FILE *file;
+	TemplateClust *dest;
+	
+	file_len = strlen(filename);
+	strcat(filename, ".clust.b");
+	file = sfopen(filename, "rb");
+	filename[file_len] = 0;
+	
+	dest = smalloc(sizeof(TemplateClust));
+	sfread(&dest->DB_size, sizeof(int), 1, file);
+	if(dest->DB_size != DB_size) {
+		/* templates were added since *.clust.b was made */
+		fprintf(stderr, "*.clust.b holds %d templates, while the database holds %d, rebuild it with kma_index -clust.\n", dest->DB_size, DB_size);
+		exit(1);
+	}
+	dest->rep = smalloc(dest->DB_size * sizeof(int));
+	dest->offsets = smalloc((dest->DB_size + 1) * sizeof(long));
+	nVar = smalloc(dest->DB_size * sizeof(int));
+	sfread(dest->rep, sizeof(int), dest->DB_size, file);
+	sfread(nVar, sizeof(int), dest->DB_size, file);
+	*dest->offsets = 0;
+	for(i = 0; i < dest->DB_size; ++i) {
+		dest->offsets[i + 1] = dest->offsets[i] + nVar[i];
+	}
+	fseek(file, 0, SEEK_END);
+	if(ftell(file) != (1 + 2 * (long) DB_size) * sizeof(int) + dest->offsets[DB_size] * sizeof(unsigned)) {
+		fprintf(stderr, "Corrupted *.clust.b, rebuild it with kma_index -clust.\n");
+		exit(1);
+	}
+	fseek(file, (1 + 2 * (long) DB_size) * sizeof(int), SEEK_SET);
+	dest->var = smalloc((dest->offsets[dest->DB_size] + 1) * sizeof(unsigned));
+	sfread(dest->var, sizeof(unsigned), dest->offsets[dest->DB_size], file);
+	fclose(file);
+	free(nVar);
+	
+	return dest;
+}
+
+int clust_delta(const TemplateClust *src, int template, const Aln *aligned, int pos, int t_len, int **d) {
+	
+	int i, delta;
+	unsigned *var, *start, *end;
+	
+	/* swap the scores of representative columns hit by a variant */
+	start = src->var + src->offsets[template];
+	end = src->var + src->offsets[template + 1];
+	var = start;
+	delta = 0;
+	for(i = 0; i < aligned->len; ++i) {
+		if(aligned->t[i] != 5) {
+			if(pos == t_len) {
+				/* circular */
+				pos = 0;
+				var = start;
+			}
+			while(var < end && (*var >> 3) < pos) {
+				++var;
+			}
+			if(var < end && (*var >> 3) == pos && aligned->q[i] != 5) {
+				delta += d[*var & 7][aligned->q[i]] - d[aligned->t[i]][aligned->q[i]];
+			}
+			++pos;
+		}
+	}
+	
+	return delta;
+}
+
+static void clustAln_alloc(Aln *dest, int size) {
+	
+	dest->t = smalloc((size + 1) << 1);
+	dest->s = smalloc((size + 1) << 1);
+	dest->q = smalloc((size + 1) << 1);
+}
+
+ClustAln * clustAln_init(int size) {
+	
+	int i;
+	ClustAln *dest;
+	
+	/* one representative alignment per mate */
+	dest = smalloc(2 * sizeof(ClustAln));
+	for(i = 0; i < 2; ++i) {
+		dest[i].rep = 0;
+		dest[i].size = size;
+		dest[i].qseq = 0;
+		dest[i].aligned = smalloc(sizeof(Aln));
+		dest[i].gap_align = smalloc(sizeof(Aln));
+		clustAln_alloc(dest[i].aligned, size);
+		clustAln_alloc(dest[i].gap_align, size);
+	}
+	
+	return dest;
+}
+
+void clustAln_realloc(ClustAln *dest, int size) {
+	
+	free(dest->aligned->t);
+	free(dest->aligned->s);
+	free(dest->aligned->q);
+	free(dest->gap_align->t);
+	free(dest->gap_align->s);
+	free(dest->gap_align->q);
+	clustAln_alloc(dest->aligned, size);
+	clustAln_alloc(dest->gap_align, size);
+	dest->size = size;
+}
+
+void clustAln_reset(ClustAln *dest) {
+	
+	if(dest) {
+		dest[0].rep = 0;
+		dest[1].rep = 0;
+	}
+}
+
+void clustAln_destroy(ClustAln *dest) {
+	
+	int i;
+	
+	if(!dest) {
+		return;
+	}
+	for(i = 0; i < 2; ++i) {
+		free(dest[i].aligned->t);
+		free(dest[i].aligned->s);
+		free(dest[i].aligned->q);
+		free(dest[i].gap_align->t);
+		free(dest[i].gap_align->s);
+		free(dest[i].gap_align->q);
+		free(dest[i].aligned);
+		free(dest[i].gap_align);
+	}
+	free(dest);
+}
@@ -0,0 +1,52 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include "nw.h"
+
+#ifndef CLUST
+typedef struct templateClust TemplateClust;
+typedef struct clustAln ClustAln;
+struct templateClust {
+	int DB_size;
+	int *rep; /* representative, 0 for unclustered templates */
+	long *offsets; /* start of the variants of each template */
+	unsigned *var; /* variant position << 3 | nucleotide */
+};
+struct clustAln {
+	int rep;
+	int size;
+	const unsigned char *qseq;
+	AlnScore stat;
+	Aln *aligned;
+	Aln *gap_align;
+};
+#define CLUST 1
+#endif
+
+extern int clustFlag;
+extern TemplateClust *templateClust;
+
+int clust_dist(const long unsigned *seq1, const long unsigned *seq2, int len, int maxVar);
+void clust_make(char *filename, int maxVar);
+TemplateClust * clust_load(char *filename, int DB_size);
+int clust_delta(const TemplateClust *src, int template, const Aln *aligned, int pos, int t_len, int **d);
+ClustAln * clustAln_init(int size);
+void clustAln_realloc(ClustAln *dest, int size);
+void clustAln_reset(ClustAln *dest);
+void clustAln_destroy(ClustAln *dest);
@@ -0,0 +1,326 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "count.h"
+#include "filebuff.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "seqparse.h"
+#include "threader.h"
+
+/* files to count, handed out one at a time */
+static CountFile *countFiles;
+static int countNum, countNext;
+static volatile int countLock[1] = {0};
+
+static void countQual(CountFile *dest, Qseqs *qual, int phredCut, int fiveClip) {
+	
+	/* trim as run_input does, keeping reads longer than its k-mer size */
+	int start, end;
+	unsigned char *seq;
+	
+	seq = qual->seq;
+	end = qual->len - 1;
+	if(0 <= end && seq[end] == '\r') {
+		--end;
+	}
+	while(end >= 0 && seq[end] < phredCut) {
+		--end;
+	}
+	++end;
+	start = fiveClip;
+	while(start < end && seq[start] < phredCut) {
+		++start;
+	}
+	if(16 < end - start) {
+		++dest->trimReads;
+		dest->trimBases += end - start;
+	}
+	qual->len = 0;
+}
+
+void countFile(CountFile *dest, FileBuff *inputfile, Qseqs *qual, int minPhred, int fiveClip, int trim) {
+	
+	int len, lineNum, header, phredCut;
+	unsigned char *buff, *end, *nl;
+	FILE *file;
+	
+	/* openAndDetermine sets the global reader, which is not used here */
+	lock(countLock);
+	dest->format = openAndDetermine(inputfile, dest->filename);
+	unlock(countLock);
+	phredCut = (trim && (dest->format & 1)) ? getPhredFileBuff(inputfile) + minPhred : 0;
+	
+	/* scan lines with memchr, which is vectorized by the libc */
+	lineNum = 0;
+	header = 0;
+	qual->len = 0;
+	len = 0;
+	if(!(dest->format & 3)) {
+		inputfile->bytes = 0;
+	}
+	while(inputfile->bytes) {
+		buff = inputfile->next;
+		end = buff + inputfile->bytes;
+		while(buff < end) {
+			nl = memchr(buff, '\n', end - buff);
+			len = (nl ? nl : end) - buff;
+			if(dest->format & 1) {
+				/* header, sequence, separator, quality */
+				if(lineNum == 1) {
+					dest->bases += len;
+				} else if(lineNum == 3 && trim) {
+					if(qual->size <= qual->len + len) {
+						while(qual->size <= qual->len + len) {
+							qual->size <<= 1;
+						}
+						qual->seq = realloc(qual->seq, qual->size);
+						if(!qual->seq) {
+							ERROR();
+						}
+					}
+					memcpy(qual->seq + qual->len, buff, len);
+					qual->len += len;
+				}
+			} else if(header == 0 && *buff == '>' && len) {
+				header = 1;
+				++dest->reads;
+			} else if(header != 1) {
+				header = 2;
+				dest->bases += len;
+			}
+			if(!nl) {
+				break;
+			}
+			
+			/* end of line */
+			if(0 < len && nl[-1] == '\r' && ((dest->format & 1) ? lineNum == 1 : header == 2)) {
+				--dest->bases;
+			}
+			if(dest->format & 1) {
+				if(lineNum == 0) {
+					++dest->reads;
+				} else if(lineNum == 3 && trim) {
+					countQual(dest, qual, phredCut, fiveClip);
+				}
+				lineNum = (lineNum + 1) & 3;
+			}
+			header = 0;
+			len = 0;
+			buff = nl + 1;
+		}
+		if(dest->format & 4) {
+			BuffgzFileBuff(inputfile);
+		} else {
+			buff_FileBuff(inputfile);
+		}
+	}
+	
+	/* unterminated last line */
+	if((dest->format & 1) && lineNum == 3 && trim && qual->len) {
+		countQual(dest, qual, phredCut, fiveClip);
+	}
+	
+	file = inputfile->file;
+	if(dest->format & 4) {
+		gzcloseFileBuff(inputfile);
+		if(file != stdin) {
+			fclose(file);
+		}
+	} else if(file != stdin) {
+		closeFileBuff(inputfile);
+	}
+}
+
+void * count_threaded(void *arg) {
+	
+	int i;
+	Count_thread *thread = arg;
+	
+	while(1) {
+		lock(countLock);
+		i = countNext++;
+		unlock(countLock);
+		if(countNum <= i) {
+			return NULL;
+		}
+		countFile(countFiles + i, thread->inputfile, thread->qual, thread->minPhred, thread->fiveClip, thread->trim);
+	}
+	
+	return NULL;
+}
+
+static void helpMessage(int status) {
+	
+	FILE *out;
+	
+	if(status) {
+		out = stderr;
+	} else {
+		out = stdout;
+	}
+	fprintf(out, "kma count prints the number of reads and bases in the given files as tsv.\n");
+	fprintf(out, "# Options are:\t\tDesc:\t\t\t\tDefault:\tRequirements:\n");
+	fprintf(out, "#\n");
+	fprintf(out, "#\t-i\t\tInput file name(s)\t\tSTDIN\n");
+	fprintf(out, "#\t-o\t\tOutput file\t\t\tSTDOUT\n");
+	fprintf(out, "#\t-mp\t\tAlso count fastq reads kept\n#\t\t\tafter trimming as kma does,\n#\t\t\twith this minimum phred score\tNone\n");
+	fprintf(out, "#\t-5p\t\tCut a constant number of\n#\t\t\tnucleotides from the 5 prime,\n#\t\t\twhen counting trimmed reads\t0\n");
+	fprintf(out, "#\t-t\t\tNumber of threads\t\t1\n");
+	fprintf(out, "#\t-h\t\tShows this help message\n");
+	fprintf(out, "#\n");
+	exit(status);
+}
+
+int count_main(int argc, char *argv[]) {
+	
+	int i, args, minPhred, fiveClip, trim, thread_num, status;
+	char *outputfilename, *errMsg;
+	FILE *out;
+	CountFile *file;
+	Count_thread *threads, *thread;
+	
+	/* SET DEFAULTS */
+	countFiles = 0;
+	countNum = 0;
+	countNext = 0;
+	minPhred = 20;
+	fiveClip = 0;
+	trim = 0;
+	thread_num = 1;
+	outputfilename = 0;
+	
+	/* PARSE COMMAND LINE OPTIONS */
+	args = 1;
+	while(args < argc) {
+		if(strcmp(argv[args], "-i") == 0) {
+			while(++args < argc && (*argv[args] != '-' || strcmp(argv[args], "--") == 0)) {
+				countFiles = realloc(countFiles, (countNum + 1) * sizeof(CountFile));
+				if(!countFiles) {
+					ERROR();
+				}
+				countFiles[countNum++].filename = argv[args];
+			}
+			--args;
+		} else if(strcmp(argv[args], "-o") == 0) {
+			if(++args < argc) {
+				outputfilename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-mp") == 0) {
+			if(++args < argc) {
+				minPhred = strtoul(argv[args], &errMsg, 10);
+				if(*errMsg != 0) {
+					fprintf(stderr, "Invalid minimum phred score parsed\n");
+					exit(4);
+				}
+				trim = 1;
+			}
+		} else if(strcmp(argv[args], "-5p") == 0) {
+			if(++args < argc) {
+				fiveClip = strtoul(argv[args], &errMsg, 10);
+				if(*errMsg != 0) {
+					fprintf(stderr, "Invalid fiveClip parsed\n");
+					exit(4);
+				}
+			}
+		} else if(strcmp(argv[args], "-t") == 0) {
+			if(++args < argc) {
+				thread_num = strtoul(argv[args], &errMsg, 10);
+				if(*errMsg != 0 || thread_num < 1) {
+					fprintf(stderr, "Invalid number of threads parsed\n");
+					exit(4);
+				}
+			}
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			fprintf(stderr, " Invalid option:\t%s\n", argv[args]);
+			fprintf(stderr, " Printing help message:\n");
+			helpMessage(1);
+		}
+		++args;
+	}
+	if(countNum == 0) {
+		countFiles = smalloc(sizeof(CountFile));
+		countFiles->filename = "--";
+		countNum = 1;
+	}
+	for(i = 0, file = countFiles; i < countNum; ++i, ++file) {
+		file->format = 0;
+		file->reads = 0;
+		file->bases = 0;
+		file->trimReads = 0;
+		file->trimBases = 0;
+	}
+	if(countNum < thread_num) {
+		thread_num = countNum;
+	}
+	
+	/* count files in parallel */
+	threads = smalloc(thread_num * sizeof(Count_thread));
+	for(i = 0, thread = threads; i < thread_num; ++i, ++thread) {
+		thread->minPhred = minPhred;
+		thread->fiveClip = fiveClip;
+		thread->trim = trim;
+		thread->inputfile = setFileBuff(CHUNK);
+		thread->qual = setQseqs(1024);
+	}
+	for(i = 1, thread = threads + 1; i < thread_num; ++i, ++thread) {
+		if((errno = pthread_create(&thread->id, NULL, &count_threaded, thread))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			fprintf(stderr, "Will continue with %d threads.\n", i);
+			thread_num = i;
+		}
+	}
+	count_threaded(threads);
+	for(i = 1, thread = threads + 1; i < thread_num; ++i, ++thread) {
+		pthread_join(thread->id, NULL);
+	}
+	for(i = 0, thread = threads; i < thread_num; ++i, ++thread) {
+		destroyFileBuff(thread->inputfile);
+		destroyQseqs(thread->qual);
+	}
+	free(threads);
+	
+	/* print counts */
+	out = outputfilename ? sfopen(outputfilename, "wb") : stdout;
+	status = 0;
+	fprintf(out, "#file\tformat\treads\tbases\ttrimmed_reads\ttrimmed_bases\n");
+	for(i = 0, file = countFiles; i < countNum; ++i, ++file) {
+		fprintf(out, "%s\t%s%s\t%lu\t%lu", file->filename, (file->format & 1) ? "fastq" : (file->format & 2) ? "fasta" : "unknown", (file->format & 4) ? ".gz" : "", file->reads, file->bases);
+		if(!(file->format & 3)) {
+			status = 1;
+		}
+		if(trim && (file->format & 1)) {
+			fprintf(out, "\t%lu\t%lu\n", file->trimReads, file->trimBases);
+		} else {
+			fprintf(out, "\tNA\tNA\n");
+		}
+	}
+	if(out != stdout) {
+		fclose(out);
+	}
+	free(countFiles);
+	
+	return status;
+}
@@ -0,0 +1,50 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include "filebuff.h"
+#include "qseqs.h"
+
+#ifndef COUNT
+typedef struct countFile CountFile;
+typedef struct count_thread Count_thread;
+
+struct countFile {
+	char *filename;
+	int format;
+	long unsigned reads;
+	long unsigned bases;
+	long unsigned trimReads;
+	long unsigned trimBases;
+};
+
+struct count_thread {
+	pthread_t id;
+	int minPhred;
+	int fiveClip;
+	int trim;
+	FileBuff *inputfile;
+	Qseqs *qual;
+};
+#define COUNT 1
+#endif
+
+void countFile(CountFile *dest, FileBuff *inputfile, Qseqs *qual, int minPhred, int fiveClip, int trim);
+void * count_threaded(void *arg);
+int count_main(int argc, char *argv[]);
@@ -17,12 +17,20 @@
  * limitations under the License.
 */
 
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 #include "filebuff.h"
 #include "pherror.h"
 #include "qseqs.h"
+#include "threader.h"
+
+int gzLevel = 1;
+int gzThreads = 1;
 
 int BuffgzFileBuff(FileBuff *dest) {
 	
@@ -117,6 +125,7 @@ FileBuff * setFileBuff(int buffSize) {
 	dest->file = 0;
 	dest->inBuffer = 0;
 	dest->strm = 0;
+	dest->pool = 0;
 	dest->buffSize = buffSize;
 	dest->buffer = smalloc(buffSize);
 	dest->next = dest->buffer;
@@ -160,7 +169,7 @@ int buff_FileBuff(FileBuff *dest) {
 	return dest->bytes;
 }
 
-z_stream * strm_init() {
+z_stream * strm_init(int level) {
 	
 	z_stream *strm;
 	int status;
@@ -170,7 +179,8 @@ z_stream * strm_init() {
 	strm->zfree  = Z_NULL;
 	strm->opaque = Z_NULL;
 	
-	status = deflateInit2(strm, 1, Z_DEFLATED, 31 | GZIP_ENCODING, 9, Z_FILTERED);
+	/* raw deflate, gzip members are framed as BGZF blocks */
+	status = deflateInit2(strm, level, Z_DEFLATED, -15, 9, Z_FILTERED);
 	if(status < 0) {
 		fprintf(stderr, "Gzip error %d\n", status);
 		exit(status);
@@ -179,6 +189,156 @@ z_stream * strm_init() {
 	return strm;
 }
 
+void compressGzBlock(z_stream *strm, GzBlock *src) {
+	
+	int len, status;
+	unsigned crc;
+	unsigned char *in, *out, *header;
+	
+	/* make room for BGZF blocks */
+	len = ((src->len + BGZF_BLOCK - 1) / BGZF_BLOCK) * BGZF_MAX;
+	if(src->outSize < len) {
+		free(src->out);
+		src->outSize = len;
+		src->out = smalloc(len);
+	}
+	
+	/* compress each block as a separate gzip member */
+	in = src->in;
+	out = src->out;
+	while(in < src->in + src->len) {
+		len = src->in + src->len - in;
+		if(BGZF_BLOCK < len) {
+			len = BGZF_BLOCK;
+		}
+		
+		/* header, with block size in the BC extra field */
+		header = out;
+		memcpy(out, "\37\213\10\4\0\0\0\0\0\377\6\0BC\2\0", 16);
+		out += 18;
+		
+		deflateReset(strm);
+		strm->next_in = in;
+		strm->avail_in = len;
+		strm->next_out = out;
+		strm->avail_out = BGZF_MAX - 26;
+		if((status = deflate(strm, Z_FINISH)) != Z_STREAM_END) {
+			fprintf(stderr, "Gzip error %d\n", status);
+			exit(status);
+		}
+		out = strm->next_out;
+		
+		/* footer */
+		crc = crc32(crc32(0, Z_NULL, 0), in, len);
+		out[0] = crc;
+		out[1] = crc >> 8;
+		out[2] = crc >> 16;
+		out[3] = crc >> 24;
+		out[4] = len;
+		out[5] = len >> 8;
+		out[6] = len >> 16;
+		out[7] = len >> 24;
+		out += 8;
+		header[16] = (out - header - 1);
+		header[17] = (out - header - 1) >> 8;
+		in += len;
+	}
+	src->outLen = out - src->out;
+}
+
+void * gzPool_thread(void *arg) {
+	
+	z_stream *strm;
+	GzBlock *block;
+	GzPool *src = arg;
+	
+	strm = strm_init(src->level);
+	pthread_mutex_lock(&src->mutex);
+	while(1) {
+		/* sleep until the next block is queued */
+		while(src->run && src->blocks[src->next].status != 1) {
+			pthread_cond_wait(&src->queued, &src->mutex);
+		}
+		if(!src->run) {
+			break;
+		}
+		
+		/* claim block, and compress it unlocked */
+		block = src->blocks + src->next;
+		block->status = 2;
+		if(++src->next == src->size) {
+			src->next = 0;
+		}
+		pthread_mutex_unlock(&src->mutex);
+		compressGzBlock(strm, block);
+		pthread_mutex_lock(&src->mutex);
+		block->status = 3;
+		pthread_cond_signal(&src->done);
+	}
+	pthread_mutex_unlock(&src->mutex);
+	deflateEnd(strm);
+	free(strm);
+	
+	return NULL;
+}
+
+GzPool * gzPool_init(int level, int thread_num) {
+	
+	int i;
+	GzPool *dest;
+	
+	dest = smalloc(sizeof(GzPool));
+	dest->head = 0;
+	dest->tail = 0;
+	dest->next = 0;
+	dest->size = (thread_num << 1) + 1;
+	dest->level = level;
+	dest->thread_num = thread_num;
+	dest->run = 1;
+	dest->strm = thread_num ? 0 : strm_init(level);
+	dest->blocks = smalloc(dest->size * sizeof(GzBlock));
+	memset(dest->blocks, 0, dest->size * sizeof(GzBlock));
+	dest->threads = smalloc((thread_num + 1) * sizeof(pthread_t));
+	pthread_mutex_init(&dest->mutex, NULL);
+	pthread_cond_init(&dest->queued, NULL);
+	pthread_cond_init(&dest->done, NULL);
+	
+	/* start compressors */
+	for(i = 0; i < thread_num; ++i) {
+		if((errno = pthread_create(dest->threads + i, NULL, &gzPool_thread, dest))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			fprintf(stderr, "Will continue with %d compression threads.\n", i);
+			dest->thread_num = i;
+			if(i == 0) {
+				dest->strm = strm_init(level);
+			}
+			break;
+		}
+	}
+	
+	return dest;
+}
+
+void flushGzPool(GzPool *src, FILE *file) {
+	
+	GzBlock *block;
+	
+	/* write oldest block when compressed */
+	block = src->blocks + src->tail;
+	pthread_mutex_lock(&src->mutex);
+	while(block->status != 3) {
+		pthread_cond_wait(&src->done, &src->mutex);
+	}
+	pthread_mutex_unlock(&src->mutex);
+	sfwrite(block->out, 1, block->outLen, file);
+	pthread_mutex_lock(&src->mutex);
+	block->status = 0;
+	pthread_mutex_unlock(&src->mutex);
+	if(++src->tail == src->size) {
+		src->tail = 0;
+	}
+}
+
 FileBuff * gzInitFileBuff(int size) {
 	
 	FileBuff *dest;
@@ -187,9 +347,10 @@ FileBuff * gzInitFileBuff(int size) {
 	dest->file = 0;
 	dest->bytes = size;
 	dest->buffSize = size;
-	dest->strm = strm_init();
+	dest->strm = 0;
+	dest->pool = gzPool_init(gzLevel, gzThreads);
 	dest->buffer = smalloc(size);
-	dest->inBuffer = smalloc(size);
+	dest->inBuffer = 0;
 	dest->next = dest->buffer;
 	
 	return dest;
@@ -200,53 +361,137 @@ void resetGzFileBuff(FileBuff *dest, int size) {
 	dest->bytes = size;
 	dest->buffSize = size;
 	free(dest->buffer);
-	free(dest->inBuffer);
 	dest->buffer = smalloc(size);
-	dest->inBuffer = smalloc(size);
 	dest->next = dest->buffer;
 }
 
 void writeGzFileBuff(FileBuff *dest) {
 	
-	int check = Z_OK;
-	z_stream *strm = dest->strm;
-	strm->avail_in = dest->buffSize - dest->bytes;
-	strm->next_in = dest->buffer;
-	strm->avail_out = 0;
+	int size;
+	unsigned char *buffer;
+	GzBlock *block;
+	GzPool *pool;
+	
+	pool = dest->pool;
+	if(dest->bytes == dest->buffSize) {
+		return;
+	}
+	
+	/* get free block, writing finished blocks in order */
+	block = pool->blocks + pool->head;
+	while(block->status) {
+		flushGzPool(pool, dest->file);
+	}
 	
-	while(strm->avail_out == 0 && check != Z_STREAM_END) {
-		strm->avail_out = dest->buffSize;
-		strm->next_out = dest->inBuffer;
-		check = deflate(strm, Z_NO_FLUSH);
-		sfwrite(dest->inBuffer, 1, dest->buffSize - strm->avail_out, dest->file);
+	/* swap buffers with block */
+	buffer = block->in;
+	size = block->size;
+	block->in = dest->buffer;
+	block->size = dest->buffSize;
+	block->len = dest->buffSize - dest->bytes;
+	if(size < dest->buffSize) {
+		free(buffer);
+		buffer = smalloc(dest->buffSize);
 	}
+	dest->buffer = buffer;
 	dest->bytes = dest->buffSize;
 	dest->next = dest->buffer;
+	if(++pool->head == pool->size) {
+		pool->head = 0;
+	}
+	
+	/* hand block to compressors */
+	if(pool->thread_num) {
+		pthread_mutex_lock(&pool->mutex);
+		block->status = 1;
+		pthread_cond_signal(&pool->queued);
+		pthread_mutex_unlock(&pool->mutex);
+	} else {
+		compressGzBlock(pool->strm, block);
+		block->status = 3;
+	}
 }
 
 void closeGzFileBuff(FileBuff *dest) {
 	
-	int check = Z_OK;
-	z_stream *strm = dest->strm;
-	strm->avail_in = dest->buffSize - dest->bytes;
-	strm->next_in = dest->buffer;
-	strm->avail_out = 0;
+	int i;
+	GzPool *pool;
 	
-	while(strm->avail_out == 0 && check != Z_STREAM_END) {
-		strm->avail_out = dest->buffSize;
-		strm->next_out = dest->inBuffer;
-		check = deflate(strm, Z_FINISH);
-		sfwrite(dest->inBuffer, 1, dest->buffSize - strm->avail_out, dest->file);
+	/* write remaining blocks, and the BGZF EOF marker */
+	pool = dest->pool;
+	writeGzFileBuff(dest);
+	while(pool->blocks[pool->tail].status) {
+		flushGzPool(pool, dest->file);
 	}
-	deflateEnd(strm);
+	sfwrite("\37\213\10\4\0\0\0\0\0\377\6\0BC\2\0\33\0\3\0\0\0\0\0\0\0\0\0", 1, 28, dest->file);
 	fclose(dest->file);
+	
+	/* stop compressors */
+	pthread_mutex_lock(&pool->mutex);
+	pool->run = 0;
+	pthread_cond_broadcast(&pool->queued);
+	pthread_mutex_unlock(&pool->mutex);
+	for(i = 0; i < pool->thread_num; ++i) {
+		if((errno = pthread_join(pool->threads[i], NULL))) {
+			ERROR();
+		}
+	}
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->queued);
+	pthread_cond_destroy(&pool->done);
+	if(pool->strm) {
+		deflateEnd(pool->strm);
+		free(pool->strm);
+	}
+	for(i = 0; i < pool->size; ++i) {
+		free(pool->blocks[i].in);
+		free(pool->blocks[i].out);
+	}
+	free(pool->blocks);
+	free(pool->threads);
+	free(pool);
+	dest->pool = 0;
+}
+
+FileBuff * initOutFileBuff(int size, int gz) {
+	
+	FileBuff *dest;
+	
+	if(gz) {
+		return gzInitFileBuff(size);
+	}
+	dest = setFileBuff(size);
+	dest->bytes = size;
+	
+	return dest;
+}
+
+void writeFileBuff(FileBuff *dest) {
+	
+	/* flush buffer, through compressors if gzipped */
+	if(dest->pool) {
+		writeGzFileBuff(dest);
+	} else if(dest->bytes != dest->buffSize) {
+		sfwrite(dest->buffer, 1, dest->buffSize - dest->bytes, dest->file);
+		dest->bytes = dest->buffSize;
+		dest->next = dest->buffer;
+	}
+}
+
+void destroyOutFileBuff(FileBuff *dest) {
+	
+	if(dest->pool) {
+		destroyGzFileBuff(dest);
+	} else {
+		writeFileBuff(dest);
+		closeFileBuff(dest);
+		destroyFileBuff(dest);
+	}
 }
 
 void destroyGzFileBuff(FileBuff *dest) {
 	
 	closeGzFileBuff(dest);
-	free(dest->strm);
 	free(dest->buffer);
-	free(dest->inBuffer);
 	free(dest);
 }
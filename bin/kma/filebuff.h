@@ -17,11 +17,15 @@
  * limitations under the License.
 */
 
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include <stdio.h>
 #include <zlib.h>
 
 #ifndef FILEBUFF
 typedef struct fileBuff FileBuff;
+typedef struct gzBlock GzBlock;
+typedef struct gzPool GzPool;
 struct fileBuff {
 	int bytes;
 	int buffSize;
@@ -31,13 +35,43 @@ struct fileBuff {
 	FILE *file;
 	z_stream *strm;
 	int z_err;
+	GzPool *pool;
+};
+struct gzBlock {
+	volatile int status; /* 0: free, 1: queued, 2: compressing, 3: done */
+	int len;
+	int size;
+	int outLen;
+	int outSize;
+	unsigned char *in;
+	unsigned char *out;
+};
+struct gzPool {
+	int head;
+	int tail;
+	int size;
+	int level;
+	int thread_num;
+	int next; /* next block to claim by the compressors */
+	int run;
+	z_stream *strm;
+	pthread_t *threads;
+	GzBlock *blocks;
+	pthread_mutex_t mutex;
+	pthread_cond_t queued; /* signalled when a block is queued */
+	pthread_cond_t done; /* signalled when a block is compressed */
 };
 #define FILEBUFF 1
 #define CHUNK 1048576
 #define GZIP_ENCODING 16
 #define ENABLE_ZLIB_GZIP 32
+#define BGZF_BLOCK 65280
+#define BGZF_MAX 65536
 #endif
 
+extern int gzLevel;
+extern int gzThreads;
+
 int BuffgzFileBuff(FileBuff *dest);
 void init_gzFile(FileBuff *inputfile);
 FileBuff * setFileBuff(int buffSize);
@@ -46,9 +80,16 @@ void closeFileBuff(FileBuff *dest);
 void gzcloseFileBuff(FileBuff *dest);
 void destroyFileBuff(FileBuff *dest);
 int buff_FileBuff(FileBuff *dest);
-z_stream * strm_init();
+z_stream * strm_init(int level);
+void compressGzBlock(z_stream *strm, GzBlock *src);
+void * gzPool_thread(void *arg);
+GzPool * gzPool_init(int level, int thread_num);
+void flushGzPool(GzPool *src, FILE *file);
 FileBuff * gzInitFileBuff(int size);
 void resetGzFileBuff(FileBuff *dest, int size);
 void writeGzFileBuff(FileBuff *dest);
 void closeGzFileBuff(FileBuff *dest);
 void destroyGzFileBuff(FileBuff *dest);
+FileBuff * initOutFileBuff(int size, int gz);
+void writeFileBuff(FileBuff *dest);
+void destroyOutFileBuff(FileBuff *dest);
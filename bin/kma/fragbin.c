@@ -0,0 +1,357 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filebuff.h"
+#include "fragbin.h"
+#include "pherror.h"
+#include "qseqs.h"
+
+/*
+ Binary fragment file, *.frag.b:
+ int version, followed by entries starting with a tag byte.
+ FRAGBIN_TEMPLATE: name length and name, of the template of the
+ following fragments.
+ FRAGBIN_FRAG: number of best templates, score, start (delta to the
+ previous fragment), end (delta to start), read length, number of N's
+ and their positions (delta coded), the read in 2 bits per base, and
+ the header as the length shared with the previous header followed by
+ the remaining length and characters.
+ Numbers are stored as 7-bit varints, signed ones zigzag encoded.
+*/
+
+static FragBin fragBinOut;
+static const unsigned char fragBinCode[256] = {['A'] = 1, ['C'] = 2, ['G'] = 3, ['T'] = 4};
+
+static unsigned char * fragBin_uint(unsigned char *dest, unsigned num) {
+	
+	while(128 <= num) {
+		*dest++ = num | 128;
+		num >>= 7;
+	}
+	*dest++ = num;
+	
+	return dest;
+}
+
+static unsigned char * fragBin_int(unsigned char *dest, int num) {
+	return fragBin_uint(dest, num < 0 ? ~((unsigned) num << 1) : (unsigned) num << 1);
+}
+
+static char * fragBin_grow(char *src, int *size, int len) {
+	
+	if(*size < len) {
+		*size = len << 1;
+		if(!(src = realloc(src, *size))) {
+			ERROR();
+		}
+	}
+	
+	return src;
+}
+
+void initFragBin(FileBuff *dest) {
+	
+	int version;
+	
+	version = FRAGBIN_VERSION;
+	memcpy(dest->next, &version, sizeof(int));
+	dest->next += sizeof(int);
+	dest->bytes -= sizeof(int);
+	fragBinOut.start = 0;
+	fragBinOut.nameLen = -1;
+	fragBinOut.headerLen = 0;
+}
+
+void updateFragsBin(FileBuff *dest, Qseqs *qseq, Qseqs *header, char *template_name, int *stats) {
+	
+	int i, len, nameLen, headerLen, nNum, prefix, check;
+	unsigned char c, *seq, *update;
+	char *head;
+	FragBin *src;
+	
+	src = &fragBinOut;
+	seq = qseq->seq;
+	len = qseq->len;
+	head = (char *) header->seq;
+	headerLen = header->len - 1;
+	nameLen = strlen(template_name);
+	nNum = 0;
+	for(i = 0; i < len; ++i) {
+		if(!fragBinCode[seq[i]]) {
+			++nNum;
+		}
+	}
+	prefix = 0;
+	while(prefix < headerLen && prefix < src->headerLen && head[prefix] == src->header[prefix]) {
+		++prefix;
+	}
+	
+	/* flush buffer */
+	check = 64 + nameLen + 5 * nNum + (len >> 2) + headerLen - prefix;
+	if(dest->bytes < check) {
+		writeFileBuff(dest);
+		
+		/* seq is too big, reallocate buffer */
+		if(dest->bytes < check) {
+			resetGzFileBuff(dest, check << 1);
+		}
+	}
+	update = dest->next;
+	
+	/* template changes */
+	if(nameLen != src->nameLen || strcmp(template_name, src->name) != 0) {
+		src->name = fragBin_grow(src->name, &src->nameSize, nameLen + 1);
+		memcpy(src->name, template_name, nameLen + 1);
+		src->nameLen = nameLen;
+		src->start = 0;
+		*update++ = FRAGBIN_TEMPLATE;
+		update = fragBin_uint(update, nameLen);
+		memcpy(update, template_name, nameLen);
+		update += nameLen;
+	}
+	
+	/* stats */
+	*update++ = FRAGBIN_FRAG;
+	update = fragBin_uint(update, stats[0]);
+	update = fragBin_int(update, stats[1]);
+	update = fragBin_int(update, stats[2] - src->start);
+	update = fragBin_int(update, stats[3] - stats[2]);
+	src->start = stats[2];
+	
+	/* seq */
+	update = fragBin_uint(update, len);
+	update = fragBin_uint(update, nNum);
+	for(i = 0, check = 0; i < len && nNum; ++i) {
+		if(!fragBinCode[seq[i]]) {
+			update = fragBin_uint(update, i - check);
+			check = i;
+		}
+	}
+	for(i = 0; i < len; i += 4) {
+		c = 0;
+		for(check = 0; check < 4 && i + check < len; ++check) {
+			if(fragBinCode[seq[i + check]]) {
+				c |= (fragBinCode[seq[i + check]] - 1) << (check << 1);
+			}
+		}
+		*update++ = c;
+	}
+	
+	/* header, front coded */
+	update = fragBin_uint(update, prefix);
+	update = fragBin_uint(update, headerLen - prefix);
+	memcpy(update, head + prefix, headerLen - prefix);
+	update += headerLen - prefix;
+	src->header = fragBin_grow(src->header, &src->headerSize, headerLen);
+	memcpy(src->header + prefix, head + prefix, headerLen - prefix);
+	src->headerLen = headerLen;
+	
+	dest->bytes -= update - dest->next;
+	dest->next = update;
+}
+
+static unsigned frag2txt_uint(FILE *file) {
+	
+	int c, shift;
+	unsigned num;
+	
+	num = 0;
+	shift = 0;
+	do {
+		if((c = getc(file)) == EOF) {
+			fprintf(stderr, "Truncated fragment file.\n");
+			exit(1);
+		}
+		num |= (unsigned) (c & 127) << shift;
+		shift += 7;
+	} while(c & 128);
+	
+	return num;
+}
+
+static int frag2txt_int(FILE *file) {
+	
+	unsigned num;
+	
+	num = frag2txt_uint(file);
+	
+	return (num & 1) ? (int) ~(num >> 1) : (int) (num >> 1);
+}
+
+static void frag2txt_read(FILE *file, void *dest, int len) {
+	if(len && fread(dest, 1, len, file) != len) {
+		fprintf(stderr, "Truncated fragment file.\n");
+		exit(1);
+	}
+}
+
+static void helpMessage(int status) {
+	
+	FILE *out;
+	
+	if(status) {
+		out = stderr;
+	} else {
+		out = stdout;
+	}
+	fprintf(out, "kma frag2txt converts binary fragments (*.frag.b) to the text format of *.frag.gz.\n");
+	fprintf(out, "# Options are:\t\tDesc:\t\t\t\tDefault:\n");
+	fprintf(out, "#\n");
+	fprintf(out, "#\t-i\t\tInput file\t\t\tSTDIN\n");
+	fprintf(out, "#\t-o\t\tOutput file\t\t\tSTDOUT\n");
+	fprintf(out, "#\t-h\t\tShows this help message\n");
+	fprintf(out, "#\n");
+	exit(status);
+}
+
+int frag2txt_main(int argc, char *argv[]) {
+	
+	int i, args, tag, len, nNum, prefix, size, stats[4], *nPos;
+	char *inputfilename, *outputfilename, *seq, bases[] = "ACGT";
+	unsigned char *packed;
+	FILE *in, *out;
+	FragBin frag;
+	
+	/* PARSE COMMAND LINE OPTIONS */
+	inputfilename = 0;
+	outputfilename = 0;
+	args = 1;
+	while(args < argc) {
+		if(strcmp(argv[args], "-i") == 0) {
+			if(++args < argc) {
+				inputfilename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-o") == 0) {
+			if(++args < argc) {
+				outputfilename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			fprintf(stderr, " Invalid option:\t%s\n", argv[args]);
+			fprintf(stderr, " Printing help message:\n");
+			helpMessage(1);
+		}
+		++args;
+	}
+	in = inputfilename ? sfopen(inputfilename, "rb") : stdin;
+	out = outputfilename ? sfopen(outputfilename, "wb") : stdout;
+	
+	frag2txt_read(in, &tag, sizeof(int));
+	if(tag != FRAGBIN_VERSION) {
+		fprintf(stderr, "Unsupported version of fragment file: %d\n", tag);
+		exit(1);
+	}
+	
+	/* convert entries */
+	frag.start = 0;
+	frag.nameLen = 0;
+	frag.nameSize = 256;
+	frag.name = smalloc(frag.nameSize);
+	*frag.name = 0;
+	frag.headerLen = 0;
+	frag.headerSize = 256;
+	frag.header = smalloc(frag.headerSize);
+	size = 1024;
+	seq = smalloc(size + 1);
+	packed = smalloc((size >> 2) + 1);
+	nPos = smalloc(size * sizeof(int));
+	while((tag = getc(in)) != EOF) {
+		if(tag == FRAGBIN_TEMPLATE) {
+			frag.nameLen = frag2txt_uint(in);
+			frag.name = fragBin_grow(frag.name, &frag.nameSize, frag.nameLen + 1);
+			frag2txt_read(in, frag.name, frag.nameLen);
+			frag.name[frag.nameLen] = 0;
+			frag.start = 0;
+		} else if(tag == FRAGBIN_FRAG) {
+			stats[0] = frag2txt_uint(in);
+			stats[1] = frag2txt_int(in);
+			stats[2] = frag.start + frag2txt_int(in);
+			stats[3] = stats[2] + frag2txt_int(in);
+			frag.start = stats[2];
+			
+			/* seq */
+			len = frag2txt_uint(in);
+			if(size < len) {
+				size = len << 1;
+				free(seq);
+				free(packed);
+				free(nPos);
+				seq = smalloc(size + 1);
+				packed = smalloc((size >> 2) + 1);
+				nPos = smalloc(size * sizeof(int));
+			}
+			nNum = frag2txt_uint(in);
+			if(len < nNum) {
+				fprintf(stderr, "Malformed fragment file.\n");
+				exit(1);
+			}
+			for(i = 0, prefix = 0; i < nNum; ++i) {
+				prefix += frag2txt_uint(in);
+				nPos[i] = prefix;
+			}
+			frag2txt_read(in, packed, (len + 3) >> 2);
+			for(i = 0; i < len; ++i) {
+				seq[i] = bases[(packed[i >> 2] >> ((i & 3) << 1)) & 3];
+			}
+			for(i = 0; i < nNum; ++i) {
+				if(len <= nPos[i]) {
+					fprintf(stderr, "Malformed fragment file.\n");
+					exit(1);
+				}
+				seq[nPos[i]] = 'N';
+			}
+			seq[len] = 0;
+			
+			/* header */
+			prefix = frag2txt_uint(in);
+			if(frag.headerLen < prefix) {
+				fprintf(stderr, "Malformed fragment file.\n");
+				exit(1);
+			}
+			frag.headerLen = prefix + frag2txt_uint(in);
+			frag.header = fragBin_grow(frag.header, &frag.headerSize, frag.headerLen + 1);
+			frag2txt_read(in, frag.header + prefix, frag.headerLen - prefix);
+			frag.header[frag.headerLen] = 0;
+			
+			fprintf(out, "%s\t%d\t%d\t%d\t%d\t%s\t%s\n", seq, stats[0], stats[1], stats[2], stats[3], frag.name, frag.header);
+		} else {
+			fprintf(stderr, "Malformed fragment file.\n");
+			exit(1);
+		}
+	}
+	
+	if(in != stdin) {
+		fclose(in);
+	}
+	if(out != stdout) {
+		fclose(out);
+	}
+	free(frag.name);
+	free(frag.header);
+	free(seq);
+	free(packed);
+	free(nPos);
+	
+	return 0;
+}
@@ -0,0 +1,44 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include "filebuff.h"
+#include "qseqs.h"
+
+#ifndef FRAGBIN
+typedef struct fragBin FragBin;
+struct fragBin {
+	int start;
+	int nameLen;
+	int nameSize;
+	int headerLen;
+	int headerSize;
+	char *name;
+	char *header;
+};
+#define FRAGBIN 1
+#define FRAGBIN_VERSION 1
+#define FRAGBIN_TEMPLATE 1
+#define FRAGBIN_FRAG 2
+#endif
+
+void initFragBin(FileBuff *dest);
+void updateFragsBin(FileBuff *dest, Qseqs *qseq, Qseqs *header, char *template_name, int *stats);
+int frag2txt_main(int argc, char *argv[]);
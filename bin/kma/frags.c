@@ -16,48 +16,357 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "filebuff.h"
 #include "frags.h"
+#include "kmapipe.h"
 #include "pherror.h"
 #include "qseqs.h"
+#include "threader.h"
 
-FILE * printFrags(Frag **alignFrags, int DB_size) {
+FragPool * setFragPool(long unsigned size, int DB_size) {
 	
-	int i;
+	FragPool *dest;
+	
+	/* half the budget goes to the pool, the other half to the spill buffer */
+	dest = smalloc(sizeof(FragPool));
+	dest->size = (size >> 1) & ~(sizeof(long) - 1);
+	if(dest->size < 1024) {
+		dest->size = 1024;
+	}
+	dest->len = 0;
+	dest->heads = smalloc(DB_size * sizeof(long));
+	memset(dest->heads, -1, DB_size * sizeof(long));
+	dest->pool = smalloc(dest->size);
+	dest->out = smalloc(dest->size + sizeof(int));
+	dest->DB_size = DB_size;
+	dest->fileCount = 0;
+	
+	return dest;
+}
+
+void pushFrag(FragPool *dest, int template, Qseqs *qseq, Qseqs *header, int bestHits, int read_score, int start, int end) {
+	
+	long unsigned size;
+	unsigned char *ptr;
+	Frag *frag;
+	
+	/* keep records aligned */
+	size = sizeof(Frag) + qseq->len + header->len;
+	size = (size + sizeof(long) - 1) & ~(sizeof(long) - 1);
+	
+	if(dest->size < dest->len + size) {
+		if(dest->len) {
+			spillFrags(dest);
+		}
+		
+		/* fragment is too big, reallocate pool */
+		if(dest->size < size) {
+			free(dest->pool);
+			free(dest->out);
+			dest->size = size;
+			dest->pool = smalloc(dest->size);
+			dest->out = smalloc(dest->size + sizeof(int));
+		}
+	}
+	
+	/* add record */
+	frag = (Frag *)(dest->pool + dest->len);
+	frag->next = dest->heads[template];
+	dest->heads[template] = dest->len;
+	dest->len += size;
+	frag->buffer[0] = template;
+	frag->buffer[1] = qseq->len;
+	frag->buffer[2] = bestHits;
+	frag->buffer[3] = read_score;
+	frag->buffer[4] = start;
+	frag->buffer[5] = end;
+	frag->buffer[6] = header->len;
+	ptr = (unsigned char *)(frag->buffer + 7);
+	memcpy(ptr, qseq->seq, qseq->len);
+	memcpy(ptr + qseq->len, header->seq, header->len);
+}
+
+FILE * printFrags(FragPool *src, long *index) {
+	
+	int i, len;
+	long next;
+	unsigned char *out;
 	FILE *OUT;
-	Frag *alignFrag, *next;
+	Frag *frag;
 	
 	if(!(OUT = tmpfile())) {
 		fprintf(stderr, "Could not create tmp files.\n");
 		ERROR();
 	}
-	for(i = 0; i < DB_size; ++i) {
-		if(alignFrags[i]) {
-			for(alignFrag = alignFrags[i]; alignFrag != 0; alignFrag = next) {
-				next = alignFrag->next;
-				
-				sfwrite(&i, sizeof(int), 1, OUT);
-				sfwrite(alignFrag->buffer, sizeof(int), 6, OUT);
-				sfwrite(alignFrag->qseq, 1, alignFrag->buffer[0], OUT);
-				sfwrite(alignFrag->header, 1, alignFrag->buffer[5], OUT);
-				
-				free(alignFrag->qseq);
-				free(alignFrag->header);
-				free(alignFrag);
+	
+	/* gather records in template order */
+	out = src->out;
+	for(i = 0; i < src->DB_size; ++i) {
+		if(index) {
+			index[i] = out - src->out;
+		}
+		for(next = src->heads[i]; next != -1; next = frag->next) {
+			frag = (Frag *)(src->pool + next);
+			len = 7 * sizeof(int) + frag->buffer[1] + frag->buffer[6];
+			memcpy(out, frag->buffer, len);
+			out += len;
+		}
+		src->heads[i] = -1;
+	}
+	if(index) {
+		index[i] = out - src->out;
+	}
+	memcpy(out, &(int){-1}, sizeof(int));
+	out += sizeof(int);
+	sfwrite(src->out, 1, out - src->out, OUT);
+	fflush(OUT);
+	rewind(OUT);
+	src->len = 0;
+	
+	return OUT;
+}
+
+FILE * mergeFrags(FILE **files, int fileCount, long *index, int DB_size) {
+	
+	/* k-way merge of template sorted fragment files, runs hold the newest
+	   fragment of a template first, so later files go first to keep the
+	   order independent of where the runs were spilled */
+	int i, t, template, len, size, (*heads)[7];
+	long offset;
+	unsigned char *buff;
+	FILE *OUT;
+	
+	if(!(OUT = tmpfile())) {
+		fprintf(stderr, "Could not create tmp files.\n");
+		ERROR();
+	}
+	heads = smalloc(fileCount * sizeof(*heads));
+	size = 1024;
+	buff = smalloc(size);
+	offset = 0;
+	t = 0;
+	
+	/* get first fragment of each file */
+	for(i = 0; i < fileCount; ++i) {
+		sfread(heads[i], sizeof(int), 1, files[i]);
+		if(heads[i][0] != -1) {
+			sfread(heads[i] + 1, sizeof(int), 6, files[i]);
+		}
+	}
+	
+	do {
+		/* find next template */
+		template = INT_MAX;
+		for(i = 0; i < fileCount; ++i) {
+			if(heads[i][0] != -1 && heads[i][0] < template) {
+				template = heads[i][0];
 			}
-			alignFrags[i] = 0;
 		}
+		
+		/* move fragments of template */
+		if(index) {
+			while(t <= template && t < DB_size) {
+				index[t++] = offset;
+			}
+		}
+		if(template != INT_MAX) {
+			for(i = fileCount - 1; 0 <= i; --i) {
+				while(heads[i][0] == template) {
+					len = heads[i][1] + heads[i][6];
+					if(size < len) {
+						free(buff);
+						size = len << 1;
+						buff = smalloc(size);
+					}
+					sfread(buff, 1, len, files[i]);
+					sfwrite(heads[i], sizeof(int), 7, OUT);
+					sfwrite(buff, 1, len, OUT);
+					offset += 7 * sizeof(int) + len;
+					
+					sfread(heads[i], sizeof(int), 1, files[i]);
+					if(heads[i][0] != -1) {
+						sfread(heads[i] + 1, sizeof(int), 6, files[i]);
+					}
+				}
+			}
+		}
+	} while(template != INT_MAX);
+	if(index) {
+		index[DB_size] = offset;
 	}
 	sfwrite(&(int){-1}, sizeof(int), 1, OUT);
 	fflush(OUT);
 	rewind(OUT);
 	
+	/* clean up */
+	for(i = 0; i < fileCount; ++i) {
+		fclose(files[i]);
+	}
+	free(heads);
+	free(buff);
+	
 	return OUT;
 }
 
+void spillFrags(FragPool *src) {
+	
+	int fileCount;
+	FILE **files;
+	unsigned *levels;
+	
+	/* dump fragments to a new run, and merge trailing runs of equal level
+	   to keep the number of files below FRAGFILES */
+	files = src->files;
+	levels = src->levels;
+	fileCount = src->fileCount;
+	files[fileCount] = printFrags(src, 0);
+	levels[fileCount] = 0;
+	++fileCount;
+	
+	while(FRAGMERGE <= fileCount && levels[fileCount - FRAGMERGE] == levels[fileCount - 1]) {
+		fileCount -= FRAGMERGE;
+		files[fileCount] = mergeFrags(files + fileCount, FRAGMERGE, 0, 0);
+		++levels[fileCount];
+		++fileCount;
+	}
+	src->fileCount = fileCount;
+}
+
+FragIn * closeFragPool(FragPool *src) {
+	
+	long *index;
+	FILE *OUT;
+	
+	/* merge all runs into one file, indexed by template */
+	index = smalloc((src->DB_size + 1) * sizeof(long));
+	if(src->fileCount == 0) {
+		OUT = printFrags(src, index);
+	} else {
+		if(src->len) {
+			spillFrags(src);
+		}
+		OUT = mergeFrags(src->files, src->fileCount, index, src->DB_size);
+	}
+	
+	free(src->heads);
+	free(src->pool);
+	free(src->out);
+	free(src);
+	
+	return setFragIn(OUT, index);
+}
+
+FragIn * setFragIn(FILE *file, long *index) {
+	
+	FragIn *dest;
+	
+	dest = smalloc(sizeof(FragIn));
+	dest->file = file;
+	dest->fd = fileno(file);
+	*(dest->excludeIn) = 0;
+	dest->next = 0;
+	dest->ticket = 0;
+	*(dest->turn) = 0;
+	dest->index = index;
+	
+	return dest;
+}
+
+void setFragSize(Qseqs *qseq, Qseqs *header) {
+	
+	if(qseq->size < qseq->len) {
+		free(qseq->seq);
+		qseq->size = qseq->len << 1;
+		qseq->seq = smalloc(qseq->size);
+	}
+	if(header->size < header->len) {
+		header->size = header->len + 1;
+		free(header->seq);
+		header->seq = smalloc(header->size);
+	}
+}
+
+int loadFrag(FragIn *src, int template, int *buffer, Qseqs *qseq, Qseqs *header, int spin, int *ticket) {
+	
+	int status;
+	long pos;
+	FILE *file;
+	
+	if(src->index) {
+		/* claim next fragment of template, and number it */
+		lockTime(src->excludeIn, spin);
+		if(src->index[template + 1] <= (pos = src->next)) {
+			unlock(src->excludeIn);
+			return 0;
+		}
+		if(pread(src->fd, buffer, 7 * sizeof(int), pos) != 7 * sizeof(int)) {
+			ERROR();
+		}
+		src->next = pos + 7 * sizeof(int) + buffer[1] + buffer[6];
+		*ticket = src->ticket++;
+		unlock(src->excludeIn);
+		
+		/* load frag */
+		qseq->len = buffer[1];
+		header->len = buffer[6];
+		setFragSize(qseq, header);
+		pos += 7 * sizeof(int);
+		if(pread(src->fd, qseq->seq, qseq->len, pos) != qseq->len) {
+			ERROR();
+		}
+		pos += qseq->len;
+		if(pread(src->fd, header->seq, header->len, pos) != header->len) {
+			ERROR();
+		}
+		
+		return 1;
+	}
+	
+	/* streamed fragments */
+	lockTime(src->excludeIn, spin);
+	if(!(file = src->file)) {
+		unlock(src->excludeIn);
+		return 0;
+	}
+	fread(buffer, sizeof(int), 7, file);
+	if(*buffer == template) {
+		qseq->len = buffer[1];
+		header->len = buffer[6];
+		setFragSize(qseq, header);
+		fread(qseq->seq, 1, qseq->len, file);
+		fread(header->seq, 1, header->len, file);
+		*ticket = src->ticket++;
+		unlock(src->excludeIn);
+		return 1;
+	} else if(*buffer == -1) {
+		kmaPipe(0, 0, file, &status);
+		errno |= status;
+		src->file = 0;
+	} else {
+		/* Move pointer back */
+		fseek(file, (-7) * sizeof(int), SEEK_CUR);
+	}
+	unlock(src->excludeIn);
+	
+	return 0;
+}
+
+void destroyFragIn(FragIn *src) {
+	
+	if(src->file) {
+		fclose(src->file);
+	}
+	free(src->index);
+	free(src);
+}
+
 void updateAllFrag(unsigned char *qseq, int q_len, int bestHits, int best_read_score, int *best_start_pos, int *best_end_pos, int *bestTemplates, Qseqs *header, FileBuff *dest) {
 	
 	int i, check, avail;
@@ -21,15 +21,46 @@
 #include "qseqs.h"
 
 #ifndef FRAG
+#define FRAGMERGE 16
+#define FRAGFILES 256
 typedef struct frag Frag;
+typedef struct fragPool FragPool;
+typedef struct fragIn FragIn;
 struct frag {
-	int buffer[6];
-	unsigned char *qseq;
-	unsigned char *header;
-	struct frag *next;
+	long next; /* offset of previous fragment on template */
+	int buffer[7]; /* followed by qseq and header */
+};
+struct fragPool {
+	long unsigned size;
+	long unsigned len;
+	long *heads;
+	unsigned char *pool;
+	unsigned char *out;
+	int DB_size;
+	int fileCount;
+	FILE *files[FRAGFILES];
+	unsigned levels[FRAGFILES];
+};
+struct fragIn {
+	FILE *file;
+	int fd;
+	volatile int excludeIn[1];
+	volatile long next; /* next unread fragment of template */
+	int ticket; /* next fragment number of template */
+	volatile int turn[1]; /* fragment number allowed to write */
+	long *index; /* offset of each template, null when streamed */
 };
 #define FRAG 1
 #endif
 
-FILE * printFrags(Frag **alignFrags, int DB_size);
+FragPool * setFragPool(long unsigned size, int DB_size);
+void pushFrag(FragPool *dest, int template, Qseqs *qseq, Qseqs *header, int bestHits, int read_score, int start, int end);
+FILE * printFrags(FragPool *src, long *index);
+FILE * mergeFrags(FILE **files, int fileCount, long *index, int DB_size);
+void spillFrags(FragPool *src);
+FragIn * closeFragPool(FragPool *src);
+FragIn * setFragIn(FILE *file, long *index);
+void setFragSize(Qseqs *qseq, Qseqs *header);
+int loadFrag(FragIn *src, int template, int *buffer, Qseqs *qseq, Qseqs *header, int spin, int *ticket);
+void destroyFragIn(FragIn *src);
 void updateAllFrag(unsigned char *qseq, int q_len, int bestHits, int best_read_score, int *best_start_pos, int *best_end_pos, int *bestTemplates, Qseqs *header, FileBuff *dest);
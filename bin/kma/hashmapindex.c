@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "hashmapindex.h"
 #include "pherror.h"
 #include "stdnuc.h"
@@ -34,10 +35,61 @@ typedef int key_t;
 #define shmat(shmid, NULL_Ptr, integer) (NULL)
 #endif
 
-void hashMap_index_initialize(HashMap_index *dest, int len, int kmerindex) {
+unsigned minimizerW = 0;
+ssize_t (*seqReadPtr)(int, void *, size_t, off_t) = &pread;
+
+long unsigned hashMap_index_next(int index_in, long unsigned index_index, int len) {
+	
+	int size;
+	
+	/* minimizer tables lead with their size */
+	if(minimizerW) {
+		if(pread(index_in, &size, sizeof(int), index_index) != sizeof(int)) {
+			ERROR();
+		}
+		return index_index + (size + 1) * sizeof(int);
+	}
+	
+	return index_index + (len << 1) * sizeof(int);
+}
+
+long hashMap_index_skip(int index_in, long index_seeker, int len) {
+	
+	int size;
+	
+	/* move to the size of a minimizer table, and skip it from there */
+	if(minimizerW) {
+		lseek(index_in, index_seeker * sizeof(int), SEEK_CUR);
+		if(read(index_in, &size, sizeof(int)) != sizeof(int)) {
+			ERROR();
+		}
+		return size;
+	}
+	
+	return index_seeker + (len << 1);
+}
+
+int hashMap_index_loadHeader(int index_in) {
+	
+	int kmersize;
+	
+	/* kmersize in the low byte, minimizer window above it */
+	read(index_in, &kmersize, sizeof(int));
+	minimizerW = kmersize >> 8;
+	
+	return kmersize & 255;
+}
+
+void hashMap_index_dumpHeader(int kmersize, FILE *index_out) {
+	
+	kmersize |= minimizerW << 8;
+	cfwrite(&kmersize, sizeof(int), 1, index_out);
+}
+
+void hashMap_index_initialize(HashMap_index *dest, int len, unsigned size, int kmerindex) {
 	
 	dest->len = len;
-	dest->size = len << 1;
+	dest->size = size;
 	dest->kmerindex = kmerindex;
 	
 	dest->index = calloc(dest->size, sizeof(int));
@@ -243,10 +295,16 @@ void hashMapIndex_add(HashMap_index *dest, long unsigned key, int newpos) {
 
 HashMap_index * hashMap_index_load(HashMap_index *src, int seq, int index, int len, int kmersize) {
 	
+	unsigned size;
+	
 	if(src == 0) {
 		src = smalloc(sizeof(HashMap_index));
 	}
-	hashMap_index_initialize(src, len, kmersize);
+	size = len << 1;
+	if(minimizerW && read(index, &size, sizeof(int)) != sizeof(int)) {
+		ERROR();
+	}
+	hashMap_index_initialize(src, len, size, kmersize);
 	read(seq, src->seq, ((src->len >> 5) + 1) * sizeof(long unsigned));
 	read(index, src->index, src->size * sizeof(int));
 	
@@ -258,33 +316,56 @@ void hashMap_index_dump(HashMap_index *src, FILE *seq, FILE *index) {
 	cfwrite(src->index, sizeof(int), src->size, index);
 }
 
-HashMap_index * hashMap_index_build(HashMap_index *src, int seq, int len, int kmersize) {
+void hashMap_index_fill(HashMap_index *src) {
 	
 	int i, end, shifter;
 	
-	if(src == 0) {
-		src = smalloc(sizeof(HashMap_index));
-	}
-	hashMap_index_initialize(src, len, kmersize);
 	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (src->kmerindex << 1);
-	
-	read(seq, src->seq, ((src->len >> 5) + 1) * sizeof(long unsigned));
-	
-	end = len - kmersize + 1;
+	end = src->len - src->kmerindex + 1;
 	for(i = 0; i < end; ++i) {
 		hashMap_index_add(src, getKmer(src->seq, i, shifter), i, shifter);
 	}
+}
+
+HashMap_index * hashMap_index_build(HashMap_index *src, int seq, int len, int kmersize) {
+	
+	if(src == 0) {
+		src = smalloc(sizeof(HashMap_index));
+	}
+	hashMap_index_initialize(src, len, len << 1, kmersize);
+	read(seq, src->seq, ((src->len >> 5) + 1) * sizeof(long unsigned));
+	hashMap_index_fill(src);
 	
 	return src;
 }
 
 HashMap_index * alignLoad_fly(HashMap_index *dest, int seq_in, int index_in, int len, int kmersize, long unsigned seq_index, long unsigned index_index) {
 	
-	/* move file pointer */
-	lseek(index_in, index_index, SEEK_SET);
-	lseek(seq_in, seq_index, SEEK_SET);
+	unsigned size;
 	
-	return hashMap_index_load(dest, seq_in, index_in, len, kmersize);
+	/* positioned reads, no shared file pointer to guard */
+	if(dest == 0) {
+		dest = smalloc(sizeof(HashMap_index));
+	}
+	size = len << 1;
+	if(minimizerW) {
+		if(pread(index_in, &size, sizeof(int), index_index) != sizeof(int)) {
+			ERROR();
+		}
+		index_index += sizeof(int);
+	}
+	hashMap_index_initialize(dest, len, size, kmersize);
+	if(seqReadPtr(seq_in, dest->seq, ((dest->len >> 5) + 1) * sizeof(long unsigned), seq_index) != ((dest->len >> 5) + 1) * sizeof(long unsigned)) {
+		if(errno) {
+			ERROR();
+		} else {
+			fprintf(stderr, "Reading error.\n");
+			exit(1);
+		}
+	}
+	pread(index_in, dest->index, dest->size * sizeof(int), index_index);
+	
+	return dest;
 }
 
 HashMap_index * alignLoad_fly_mem(HashMap_index *dest, int seq_in, int index_in, int len, int kmersize, long unsigned seq_index, long unsigned index_index) {
@@ -294,10 +375,22 @@ HashMap_index * alignLoad_fly_mem(HashMap_index *dest, int seq_in, int index_in,
 
 HashMap_index * alignLoad_fly_build(HashMap_index *dest, int seq_in, int index_in, int len, int kmersize, long unsigned seq_index, long unsigned index_index) {
 	
-	/* move file pointer */
-	lseek(seq_in, seq_index, SEEK_SET);
+	/* positioned read, no shared file pointer to guard */
+	if(dest == 0) {
+		dest = smalloc(sizeof(HashMap_index));
+	}
+	hashMap_index_initialize(dest, len, len << 1, kmersize);
+	if(seqReadPtr(seq_in, dest->seq, ((dest->len >> 5) + 1) * sizeof(long unsigned), seq_index) != ((dest->len >> 5) + 1) * sizeof(long unsigned)) {
+		if(errno) {
+			ERROR();
+		} else {
+			fprintf(stderr, "Reading error.\n");
+			exit(1);
+		}
+	}
+	hashMap_index_fill(dest);
 	
-	return hashMap_index_build(dest, seq_in, len, kmersize);
+	return dest;
 }
 
 HashMap_index * alignLoad_fly_build_mem(HashMap_index *dest, int seq_in, int index_in, int len, int kmersize, long unsigned seq_index, long unsigned index_index) {
@@ -316,11 +409,17 @@ HashMap_index * alignLoad_fly_shm(HashMap_index *dest, int seq_in, int index_in,
 		src->seq = dest->seq;
 		src->index = dest->index;
 	} else {
+		if(dest == 0) {
+			dest = smalloc(sizeof(HashMap_index));
+		}
 		dest->len = len;
 		dest->size = len << 1;
 		dest->kmerindex = kmersize;
 		dest->seq = src->seq + (seq_index / sizeof(long unsigned));
 		dest->index = src->index + ((index_index - sizeof(int)) / sizeof(int));
+		if(minimizerW) {
+			dest->size = *dest->index++;
+		}
 	}
 	
 	return dest;
@@ -344,7 +443,7 @@ HashMap_index * alignLoad_shm_initial(char *templatefilename, int file_len, int
 	templatefilename[file_len] = 0;
 	strcat(templatefilename, ".index.b");
 	key = ftok(templatefilename, 'i');
-	read(index_in, &kmersize, sizeof(int));
+	kmersize = hashMap_index_loadHeader(index_in);
 	size = lseek(index_in, 0, SEEK_END) - sizeof(int);
 	shmid = shmget(key, size, 0666);
 	if(shmid < 0) {
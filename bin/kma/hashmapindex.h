@@ -18,6 +18,8 @@
 */
 #define _XOPEN_SOURCE 600
 #include <stdio.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #ifndef HASHMAPINDEX
 typedef struct hashMap_index HashMap_index;
@@ -35,7 +37,14 @@ struct hashMap_index {
 void (*destroyPtr)(HashMap_index *);
 HashMap_index * (*alignLoadPtr)(HashMap_index *, int, int, int, int, long unsigned, long unsigned);
 
-void hashMap_index_initialize(HashMap_index *dest, int len, int kmerindex);
+extern unsigned minimizerW;
+extern ssize_t (*seqReadPtr)(int, void *, size_t, off_t);
+
+long unsigned hashMap_index_next(int index_in, long unsigned index_index, int len);
+long hashMap_index_skip(int index_in, long index_seeker, int len);
+int hashMap_index_loadHeader(int index_in);
+void hashMap_index_dumpHeader(int kmersize, FILE *index_out);
+void hashMap_index_initialize(HashMap_index *dest, int len, unsigned size, int kmerindex);
 void hashMap_index_set(HashMap_index *dest);
 void hashMap_index_destroy(HashMap_index *dest);
 int hashMap_index_get(const HashMap_index *dest, long unsigned key, unsigned shifter);
@@ -46,6 +55,7 @@ void hashMap_index_add(HashMap_index *dest, long unsigned key, int newpos, unsig
 void hashMapIndex_add(HashMap_index *dest, long unsigned key, int newpos);
 HashMap_index * hashMap_index_load(HashMap_index *src, int seq, int index, int len, int kmersize);
 void hashMap_index_dump(HashMap_index *src, FILE *seq, FILE *index);
+void hashMap_index_fill(HashMap_index *src);
 HashMap_index * hashMap_index_build(HashMap_index *src, int seq, int len, int kmersize);
 HashMap_index * alignLoad_fly(HashMap_index *dest, int seq_in, int index_in, int len, int kmersize, long unsigned seq_index, long unsigned index_index);
 HashMap_index * alignLoad_fly_mem(HashMap_index *dest, int seq_in, int index_in, int len, int kmersize, long unsigned seq_index, long unsigned index_index);
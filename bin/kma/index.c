@@ -24,15 +24,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include "clust.h"
 #include "compress.h"
 #include "decon.h"
 #include "hashmap.h"
+#include "hashmapindex.h"
 #include "hashmapkma.h"
 #include "index.h"
 #include "loadupdate.h"
 #include "makeindex.h"
+#include "nameindex.h"
 #include "pherror.h"
 #include "qualcheck.h"
+#include "seqz.h"
+#include "stdnuc.h"
 #include "stdstat.h"
 #include "updateindex.h"
 #include "valueshash.h"
@@ -57,6 +63,7 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "#\t-k\t\tKmersize\t\t\t\t16\n");
 	fprintf(helpOut, "#\t-k_t\t\tKmersize for template identification\t16\n");
 	fprintf(helpOut, "#\t-k_i\t\tKmersize for indexing\t\t\t16\n");
+	fprintf(helpOut, "#\t-mi\t\tMinimizer window for indexing\t\t0/False\n");
 	fprintf(helpOut, "#\t-ML\t\tMinimum length of templates\t\tkmersize (16)\n");
 	fprintf(helpOut, "#\t-CS\t\tStart Chain size\t\t\t1 M\n");
 	fprintf(helpOut, "#\t-ME\t\tMega DB\t\t\t\t\tFalse\n");
@@ -64,6 +71,8 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "#\t-Sparse\t\tMake Sparse DB ('-' for no prefix)\tNone/False\n");
 	fprintf(helpOut, "#\t-ht\t\tHomology template\t\t\t1.0\n");
 	fprintf(helpOut, "#\t-hq\t\tHomology query\t\t\t\t1.0\n");
+	fprintf(helpOut, "#\t-clust\t\tCluster equal length alleles on\n#\t\t\trepresentatives, max. substitutions\t0/False\n");
+	fprintf(helpOut, "#\t-seqz\t\tBlock compress sequences, *.seqz.b\tFalse\n");
 	fprintf(helpOut, "#\t-and\t\tBoth homolgy thresholds\n#\t\t\thas to be reached\t\t\tor\n");
 	fprintf(helpOut, "#\t-v\t\tVersion\n");
 	fprintf(helpOut, "#\t-h\t\tShows this help message\n");
@@ -74,7 +83,7 @@ static void helpMessage(int exeStatus) {
 int index_main(int argc, char *argv[]) {
 	
 	int i, args, stop, filecount, deconcount, sparse_run, size, mapped_cont;
-	int file_len, appender, prefix_len, MinLen, MinKlen;
+	int file_len, appender, prefix_len, MinLen, MinKlen, clustVar, seqz;
 	unsigned kmersize, kmerindex, megaDB, **Values;
 	unsigned *template_lengths, *template_slengths, *template_ulengths;
 	long unsigned initialSize, prefix, mask;
@@ -107,6 +116,8 @@ int index_main(int argc, char *argv[]) {
 	prefix = 0;
 	homQ = 1;
 	homT = 1;
+	clustVar = 0;
+	seqz = 0;
 	cmp = &cmp_or;
 	dumpIndex = &makeIndexing;
 	template_ulengths = 0;
@@ -264,6 +275,28 @@ int index_main(int argc, char *argv[]) {
 					kmerindex = 32;
 				}
 			}
+		} else if(strcmp(argv[args], "-mi") == 0) {
+			++args;
+			if(args < argc) {
+				minimizerW = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || minimizerW == 1) {
+					fprintf(stderr, "# Invalid minimizer window parsed\n");
+					exit(4);
+				} else if(minimizerW > MINIMIZER_MAX) {
+					minimizerW = MINIMIZER_MAX;
+				}
+			}
+		} else if(strcmp(argv[args], "-clust") == 0) {
+			++args;
+			if(args < argc) {
+				clustVar = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || clustVar < 0) {
+					fprintf(stderr, "# Invalid number of cluster variants parsed\n");
+					exit(4);
+				}
+			}
+		} else if(strcmp(argv[args], "-seqz") == 0) {
+			seqz = 1;
 		} else if(strcmp(argv[args], "-CS") == 0) {
 			++args;
 			if(args < argc) {
@@ -632,6 +665,35 @@ int index_main(int argc, char *argv[]) {
 		fprintf(stderr, "# Template database created.\n");
 		t1 = clock();
 		fprintf(stderr, "#\n# Total time used for DB compression: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
+		
+		/* index template names */
+		nameIndex_make(outputfilename);
+		
+		/* cluster alleles */
+		if(clustVar && !sparse_run) {
+			fprintf(stderr, "# Clustering alleles.\n");
+			t0 = clock();
+			clust_make(outputfilename, clustVar);
+			t1 = clock();
+			fprintf(stderr, "#\n# Total time used for allele clustering: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
+		} else if(appender) {
+			/* the clusters do not cover the added templates */
+			strcat(outputfilename, ".clust.b");
+			if(unlink(outputfilename) == 0) {
+				fprintf(stderr, "# Removed outdated *.clust.b, rebuild it with -clust.\n");
+			}
+			outputfilename[file_len] = 0;
+		}
+		
+		/* block compress sequences, and keep an existing *.seqz.b in sync */
+		if(appender && !seqz && !sparse_run) {
+			strcat(outputfilename, ".seqz.b");
+			seqz = access(outputfilename, F_OK) == 0;
+			outputfilename[file_len] = 0;
+		}
+		if(seqz && !sparse_run) {
+			seqz_make(outputfilename, SEQZ_BLOCK);
+		}
 	} else {
 		++finalDB->size;
 	}
@@ -0,0 +1,138 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdlib.h>
+#include <string.h>
+#include "hashmapindex.h"
+#include "indexcache.h"
+#include "pherror.h"
+
+/*
+ LRU of loaded template indexes, bounded by a byte budget.
+ Templates are linked from the most (head) to the least (tail) recently
+ used, and are only evicted when no thread holds a reference to them.
+ Callers hold excludeCache around hit, add and release.
+*/
+
+IndexCache *indexCache = 0;
+
+IndexCache * indexCache_init(long unsigned budget) {
+	
+	IndexCache *dest;
+	
+	dest = smalloc(sizeof(IndexCache));
+	memset(dest, 0, sizeof(IndexCache));
+	dest->budget = budget;
+	dest->head = -1;
+	dest->tail = -1;
+	
+	return dest;
+}
+
+void indexCache_setSize(IndexCache *dest, int DB_size) {
+	
+	dest->DB_size = DB_size;
+	dest->prev = smalloc(DB_size * sizeof(int));
+	dest->next = smalloc(DB_size * sizeof(int));
+	dest->refs = calloc(DB_size, sizeof(int));
+	if(!dest->refs) {
+		ERROR();
+	}
+	dest->head = -1;
+	dest->tail = -1;
+}
+
+long unsigned indexCache_bytes(const HashMap_index *src) {
+	return sizeof(HashMap_index) + ((src->len >> 5) + 1) * sizeof(long unsigned) + src->size * sizeof(int);
+}
+
+static void indexCache_unlink(IndexCache *dest, int template) {
+	
+	if(dest->prev[template] < 0) {
+		dest->head = dest->next[template];
+	} else {
+		dest->next[dest->prev[template]] = dest->next[template];
+	}
+	if(dest->next[template] < 0) {
+		dest->tail = dest->prev[template];
+	} else {
+		dest->prev[dest->next[template]] = dest->prev[template];
+	}
+}
+
+static void indexCache_push(IndexCache *dest, int template) {
+	
+	dest->prev[template] = -1;
+	dest->next[template] = dest->head;
+	if(dest->head < 0) {
+		dest->tail = template;
+	} else {
+		dest->prev[dest->head] = template;
+	}
+	dest->head = template;
+}
+
+void indexCache_hit(IndexCache *dest, int template) {
+	
+	++dest->hits;
+	++dest->refs[template];
+	if(dest->head != template) {
+		indexCache_unlink(dest, template);
+		indexCache_push(dest, template);
+	}
+}
+
+void indexCache_add(IndexCache *dest, HashMap_index **templates_index, int template) {
+	
+	int evict, prev;
+	
+	++dest->misses;
+	++dest->refs[template];
+	indexCache_push(dest, template);
+	dest->bytes += indexCache_bytes(templates_index[template]);
+	
+	/* evict unreferenced templates from the tail, until within budget */
+	evict = dest->tail;
+	while(dest->budget < dest->bytes && 0 <= evict) {
+		prev = dest->prev[evict];
+		if(dest->refs[evict] == 0) {
+			indexCache_unlink(dest, evict);
+			dest->bytes -= indexCache_bytes(templates_index[evict]);
+			destroyPtr(templates_index[evict]);
+			free(templates_index[evict]);
+			templates_index[evict] = 0;
+			++dest->evictions;
+		}
+		evict = prev;
+	}
+}
+
+void indexCache_release(IndexCache *dest, int template) {
+	--dest->refs[template];
+}
+
+void indexCache_destroy(IndexCache *dest) {
+	
+	if(dest) {
+		free(dest->prev);
+		free(dest->next);
+		free(dest->refs);
+		free(dest);
+	}
+}
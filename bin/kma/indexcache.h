@@ -0,0 +1,49 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include "hashmapindex.h"
+
+#ifndef INDEXCACHE
+typedef struct indexCache IndexCache;
+struct indexCache {
+	int DB_size;
+	int head;
+	int tail;
+	int *prev;
+	int *next;
+	int *refs;
+	long unsigned budget;
+	long unsigned bytes;
+	long unsigned hits;
+	long unsigned misses;
+	long unsigned evictions;
+	volatile int excludeCache;
+};
+#define INDEXCACHE 1
+#endif
+
+extern IndexCache *indexCache;
+
+IndexCache * indexCache_init(long unsigned budget);
+void indexCache_setSize(IndexCache *dest, int DB_size);
+long unsigned indexCache_bytes(const HashMap_index *src);
+void indexCache_hit(IndexCache *dest, int template);
+void indexCache_add(IndexCache *dest, HashMap_index **templates_index, int template);
+void indexCache_release(IndexCache *dest, int template);
+void indexCache_destroy(IndexCache *dest);
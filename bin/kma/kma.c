@@ -25,28 +25,39 @@
 #include "align.h"
 #include "alnfrags.h"
 #include "assembly.h"
+#include "batch.h"
 #include "chain.h"
+#include "clust.h"
+#include "filebuff.h"
+#include "fragbin.h"
 #include "hashmapkma.h"
+#include "indexcache.h"
 #include "kma.h"
 #include "kmers.h"
 #include "mt1.h"
 #include "penalties.h"
 #include "pherror.h"
+#include "prefilter.h"
+#include "printconsensus.h"
 #include "qseqs.h"
 #include "runinput.h"
 #include "runkma.h"
+#include "sam.h"
 #include "savekmers.h"
+#include "seqz.h"
 #include "sparse.h"
 #include "spltdb.h"
 #include "stdstat.h"
+#include "subsample.h"
 #include "vcf.h"
 #include "version.h"
 
 char * strjoin(char **strings, int len) {
 	
 	int i, new_len, escape;
-	char *newStr, *stringPtr;
+	char *newStr, *stringPtr, *src;
 	
+	/* file names are single quoted for sh, with their quotes spelled '\'' */
 	new_len = len + 16;
 	escape = 0;
 	for(i = 0; i < len; ++i) {
@@ -54,9 +65,14 @@ char * strjoin(char **strings, int len) {
 			escape = 0;
 		} else if(escape) {
 			new_len += 2;
+			for(src = strings[i]; *src; ++src) {
+				if(*src == '\'') {
+					new_len += 3;
+				}
+			}
 		}
 		new_len += strlen(strings[i]);
-		if(strncmp(strings[i], "-i", 2) == 0) {
+		if(*strings[i] == '-' && (strings[i][1] == 'i' || strings[i][1] == 'o')) {
 			escape = 1;
 		}
 	}
@@ -72,15 +88,20 @@ char * strjoin(char **strings, int len) {
 		}
 		
 		if(escape) {
-			*stringPtr = '\"';
-			++stringPtr;
-		}
-		new_len = strlen(strings[i]);
-		strcpy(stringPtr, strings[i]);
-		stringPtr += new_len;
-		if(escape) {
-			*stringPtr = '\"';
-			++stringPtr;
+			*stringPtr++ = '\'';
+			for(src = strings[i]; *src; ++src) {
+				if(*src == '\'') {
+					memcpy(stringPtr, "'\\''", 4);
+					stringPtr += 4;
+				} else {
+					*stringPtr++ = *src;
+				}
+			}
+			*stringPtr++ = '\'';
+		} else {
+			new_len = strlen(strings[i]);
+			strcpy(stringPtr, strings[i]);
+			stringPtr += new_len;
 		}
 		*stringPtr = ' ';
 		++stringPtr;
@@ -89,10 +110,31 @@ char * strjoin(char **strings, int len) {
 			escape = 1;
 		}
 	}
+	*stringPtr = 0;
 	
 	return newStr;
 }
 
+static long unsigned strtomem(char *src, char **endPtr) {
+	
+	long unsigned size;
+	
+	/* get size in bytes, allowing K, M and G suffixes */
+	size = strtoul(src, endPtr, 10);
+	if(**endPtr == 'K' || **endPtr == 'k') {
+		size <<= 10;
+		++*endPtr;
+	} else if(**endPtr == 'M' || **endPtr == 'm') {
+		size <<= 20;
+		++*endPtr;
+	} else if(**endPtr == 'G' || **endPtr == 'g') {
+		size <<= 30;
+		++*endPtr;
+	}
+	
+	return size;
+}
+
 static void helpMessage(int exeStatus) {
 	FILE *helpOut;
 	if(exeStatus == 0) {
@@ -106,20 +148,34 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "#\t-o\t\tOutput file\t\t\tNone\t\tREQUIRED\n");
 	fprintf(helpOut, "#\t-t_db\t\tTemplate DB\t\t\tNone\t\tREQUIRED\n");
 	fprintf(helpOut, "#\t-i\t\tInput file name(s)\t\tSTDIN\n");
+	fprintf(helpOut, "#\t-batch\t\tMap the samples listed as\n#\t\t\t\"output<TAB>input(s)\" in file,\n#\t\t\tsharing one loaded DB\t\tNone\n");
 	fprintf(helpOut, "#\t-ipe\t\tInput paired end file name(s)\n");
 	fprintf(helpOut, "#\t-int\t\tInput interleaved file name(s)\n");
+	fprintf(helpOut, "#\t-sub\t\tSubsample to num reads / pairs,\n#\t\t\tor to a fraction below 1\t\tNone\n");
+	fprintf(helpOut, "#\t-seed\t\tSeed for subsampling\t\t1\n");
+	fprintf(helpOut, "#\t-pre\t\tOnly map reads or pairs sharing\n#\t\t\t\"num\" k-mers with this DB\tNone / 1\n");
 	fprintf(helpOut, "#\t-k\t\tKmersize\t\t\t%s\n", "DB defined");
 	fprintf(helpOut, "#\t-e\t\tevalue\t\t\t\t0.05\n");
 	fprintf(helpOut, "#\t-ConClave\tConClave version\t\t1\n");
 	fprintf(helpOut, "#\t-mem_mode\tUse kmers to choose best\n#\t\t\ttemplate, and save memory\tFalse\n");
 	fprintf(helpOut, "#\t-ex_mode\tSearh kmers exhaustively\tFalse\n");
+	fprintf(helpOut, "#\t-clust\t\tAlign alleles through their\n#\t\t\tcluster representative, needs\n#\t\t\tkma_index -clust\t\tFalse\n");
+	fprintf(helpOut, "#\t-cache\t\tMB for loaded template indexes,\n#\t\t\tevicting LRU. Every lookup and\n#\t\t\tload takes one global lock\tNone\n");
+	fprintf(helpOut, "#\t-seqz\t\tDecode templates from *.seqz.b,\n#\t\t\twith a cache of given MB\t\t0/False\n");
+	fprintf(helpOut, "#\t-mem\t\tMemory used for buffering\n#\t\t\tfragments before sorting\t1G\n");
+	fprintf(helpOut, "#\t-gz_level\tCompression level of gz output\t1\n");
+	fprintf(helpOut, "#\t-gz_t\t\tThreads compressing gz output\t1\n");
+	fprintf(helpOut, "#\t-gz_aln\t\tGzip .aln and .fsa output\tFalse\n");
 	fprintf(helpOut, "#\t-ef\t\tPrint additional features\tFalse\n");
 	fprintf(helpOut, "#\t-vcf\t\tMake vcf file, 2 to apply FT\tFalse/0\n");
+	fprintf(helpOut, "#\t-sam\t\tMake bgzipped sam file, 2 to sort by position\tFalse/0\n");
 	fprintf(helpOut, "#\t-deCon\t\tRemove contamination\t\tFalse\n");
 	fprintf(helpOut, "#\t-dense\t\tDo not allow insertions\n#\t\t\tin assembly\t\t\tFalse\n");
 	fprintf(helpOut, "#\t-ref_fsa\tConsensus sequnce will\n#\t\t\thave \"n\" instead of gaps\tFalse\n");
 	fprintf(helpOut, "#\t-matrix\t\tPrint assembly matrix\t\tFalse\n");
 	fprintf(helpOut, "#\t-a\t\tPrint all best mappings\t\tFalse\n");
+	fprintf(helpOut, "#\t-bin\t\tPrint columnar binary results\n#\t\t\tto *.res.b\t\t\tFalse\n");
+	fprintf(helpOut, "#\t-frag_bin\tPrint binary fragments to\n#\t\t\t*.frag.b, see kma frag2txt\tFalse\n");
 	fprintf(helpOut, "#\t-mp\t\tMinimum phred score\t\t20\n");
 	fprintf(helpOut, "#\t-5p\t\tCut a constant number of\n#\t\t\tnucleotides from the 5 prime.\t0\n");
 	fprintf(helpOut, "#\t-Sparse\t\tOnly count kmers\t\tFalse\n");
@@ -161,14 +217,16 @@ int kma_main(int argc, char *argv[]) {
 	int i, j, args, exe_len, minPhred, fiveClip, sparse_run, mem_mode, Mt1;
 	int step1, step2, fileCounter, fileCounter_PE, fileCounter_INT, status;
 	int ConClave, extendedFeatures, vcf, targetNum, size, escape, spltDB, mq;
-	int ref_fsa, print_matrix, print_all, one2one, thread_num, kmersize, bcd;
+	int ref_fsa, print_matrix, print_all, print_bin, one2one, thread_num, kmersize, bcd;
+	int batchArg, prefilterMin;
 	int **d, W1, U, M, MM, PE;
-	unsigned shm, exhaustive;
-	long unsigned totFrags;
+	unsigned shm, shmLvl, exhaustive;
+	long unsigned totFrags, memBudget, seqzCache, cacheBudget, subNum, subSeed;
 	char *exeBasic, *outputfilename, *templatefilename, **templatefilenames;
+	char *batchfilename, *prefilterfilename;
 	char **inputfiles, **inputfiles_PE, **inputfiles_INT, *to2Bit;
 	char Date[11], ss;
-	double ID_t, scoreT, evalue, support;
+	double ID_t, scoreT, evalue, support, subFraction;
 	FILE *templatefile;
 	time_t t0, t1;
 	struct tm *tm;
@@ -190,6 +248,7 @@ int kma_main(int argc, char *argv[]) {
 	extendedFeatures = 0;
 	status = 0;
 	assembly_KMA_Ptr = &assemble_KMA_threaded;
+	updateFragsPtr = &updateFrags;
 	cmp = &cmp_or;
 	minPhred = 20;
 	fiveClip = 0;
@@ -201,10 +260,20 @@ int kma_main(int argc, char *argv[]) {
 	templatefilename = 0;
 	print_matrix = 0;
 	print_all = 0;
+	print_bin = 0;
 	ref_fsa = 0;
 	kmersize = 0;
 	evalue = 0.05;
 	exhaustive = 0;
+	seqzCache = 0;
+	cacheBudget = 0;
+	batchfilename = 0;
+	batchArg = 0;
+	prefilterfilename = 0;
+	prefilterMin = 1;
+	subFraction = 0;
+	subNum = 0;
+	subSeed = 1;
 	shm = 0;
 	mq = 0;
 	bcd = 1;
@@ -215,6 +284,7 @@ int kma_main(int argc, char *argv[]) {
 	one2one = 0;
 	ss = 'q';
 	mem_mode = 0;
+	memBudget = 1 << 30;
 	M = 1;
 	MM = -2;
 	W1 = -3;
@@ -446,8 +516,100 @@ int kma_main(int argc, char *argv[]) {
 			mem_mode = 1;
 			alignLoadPtr = &alignLoad_fly_mem;
 			ankerPtr = &ankerAndClean_MEM;
+		} else if(strcmp(argv[args], "-mem") == 0) {
+			++args;
+			if(args < argc) {
+				memBudget = strtomem(argv[args], &exeBasic);
+				if(*exeBasic != 0 || memBudget == 0) {
+					fprintf(stderr, "Invalid argument at \"-mem\".\n");
+					exit(4);
+				}
+			}
+		} else if(strcmp(argv[args], "-gz_level") == 0) {
+			++args;
+			if(args < argc) {
+				gzLevel = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || gzLevel < 0 || 9 < gzLevel) {
+					fprintf(stderr, "Invalid argument at \"-gz_level\".\n");
+					exit(4);
+				}
+			}
+		} else if(strcmp(argv[args], "-gz_t") == 0) {
+			++args;
+			if(args < argc) {
+				gzThreads = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || gzThreads < 0) {
+					fprintf(stderr, "Invalid argument at \"-gz_t\".\n");
+					exit(4);
+				}
+			}
+		} else if(strcmp(argv[args], "-gz_aln") == 0) {
+			alnGz = 1;
 		} else if(strcmp(argv[args], "-ex_mode") == 0) {
 			exhaustive = 1;
+		} else if(strcmp(argv[args], "-clust") == 0) {
+			clustFlag = 1;
+		} else if(strcmp(argv[args], "-cache") == 0) {
+			++args;
+			if(args < argc) {
+				cacheBudget = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || cacheBudget == 0) {
+					fprintf(stderr, "Invalid argument at \"-cache\".\n");
+					exit(4);
+				}
+				cacheBudget <<= 20;
+			}
+		} else if(strcmp(argv[args], "-seqz") == 0) {
+			++args;
+			if(args < argc) {
+				seqzCache = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || seqzCache == 0) {
+					fprintf(stderr, "Invalid argument at \"-seqz\".\n");
+					exit(4);
+				}
+				seqzCache <<= 20;
+			}
+		} else if(strcmp(argv[args], "-batch") == 0) {
+			++args;
+			if(args < argc) {
+				batchfilename = argv[args];
+				batchArg = args - 1;
+			}
+		} else if(strcmp(argv[args], "-pre") == 0) {
+			++args;
+			if(args < argc) {
+				prefilterfilename = argv[args];
+				if((args + 1) < argc && *(argv[args + 1]) != '-') {
+					++args;
+					prefilterMin = strtol(argv[args], &exeBasic, 10);
+					if(*exeBasic != 0 || prefilterMin < 1) {
+						fprintf(stderr, "Invalid argument at \"-pre\".\n");
+						exit(4);
+					}
+				}
+			}
+		} else if(strcmp(argv[args], "-sub") == 0) {
+			++args;
+			if(args < argc) {
+				subFraction = strtod(argv[args], &exeBasic);
+				if(*exeBasic != 0 || subFraction <= 0) {
+					fprintf(stderr, "Invalid argument at \"-sub\".\n");
+					exit(4);
+				} else if(1 <= subFraction) {
+					/* number of reads / read pairs */
+					subNum = subFraction;
+					subFraction = 0;
+				}
+			}
+		} else if(strcmp(argv[args], "-seed") == 0) {
+			++args;
+			if(args < argc) {
+				subSeed = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0) {
+					fprintf(stderr, "Invalid argument at \"-seed\".\n");
+					exit(4);
+				}
+			}
 		} else if(strcmp(argv[args], "-k") == 0) {
 			++args;
 			if(args < argc) {
@@ -493,6 +655,10 @@ int kma_main(int argc, char *argv[]) {
 			assembly_KMA_Ptr = &assemble_KMA_dense_threaded;
 		} else if(strcmp(argv[args], "-matrix") == 0) {
 			print_matrix = 1;
+		} else if(strcmp(argv[args], "-bin") == 0) {
+			print_bin = 1;
+		} else if(strcmp(argv[args], "-frag_bin") == 0) {
+			updateFragsPtr = &updateFragsBin;
 		} else if(strcmp(argv[args], "-a") == 0) {
 			print_all = 1;
 			mem_mode = 1;
@@ -674,6 +840,19 @@ int kma_main(int argc, char *argv[]) {
 					--args;
 				}
 			}
+		} else if(strcmp(argv[args], "-sam") == 0) {
+			samFlag = 1;
+			if(++args < argc) {
+				if(argv[args][0] != '-') {
+					samFlag = strtol(argv[args], &exeBasic, 10);
+					if(*exeBasic != 0 || samFlag < 0 || 2 < samFlag) {
+						fprintf(stderr, "Invalid argument at \"-sam\".\n");
+						exit(4);
+					}
+				} else {
+					--args;
+				}
+			}
 		} else if(strcmp(argv[args], "-cge") == 0) {
 			scoreT = 0.75;
 			M = 1;
@@ -720,12 +899,17 @@ int kma_main(int argc, char *argv[]) {
 		}
 	}
 	
-	if(outputfilename == 0 || templatefilename == 0) {
+	if((outputfilename == 0 && batchfilename == 0) || templatefilename == 0) {
 		fprintf(stderr, " Too few arguments handed\n");
 		fprintf(stderr, " Printing help message:\n");
 		helpMessage(1);
 	}
 	
+	if(batchfilename && (outputfilename || fileCounter || fileCounter_PE || fileCounter_INT)) {
+		fprintf(stderr, "Input and output are given by the batch file.\n");
+		exit(1);
+	}
+	
 	if(fileCounter == 0 && fileCounter_PE == 0 && fileCounter_INT == 0) {
 		inputfiles = malloc(sizeof(char*));
 		if(!inputfiles) {
@@ -944,6 +1128,9 @@ int kma_main(int argc, char *argv[]) {
 				fprintf(stderr, "Interleaved information is not considered in Sparse mode.\n");
 			}
 			
+			if(prefilterfilename || subFraction || subNum) {
+				fprintf(stderr, "Prefiltering and subsampling are not considered in Sparse mode.\n");
+			}
 			run_input_sparse(templates, inputfiles, fileCounter, minPhred, fiveClip, kmersize, to2Bit);
 		} else {
 			if(Mt1) {
@@ -955,6 +1142,12 @@ int kma_main(int argc, char *argv[]) {
 				printFsaMt1(0, &qseq, 0);
 			}
 			kmersize = 16;
+			if(subFraction || subNum) {
+				subsample_init(subFraction, subNum, subSeed);
+			}
+			if(prefilterfilename) {
+				prefilter_init(prefilterfilename, prefilterMin);
+			}
 			
 			/* SE */
 			if(fileCounter > 0) {
@@ -971,6 +1164,13 @@ int kma_main(int argc, char *argv[]) {
 				totFrags += run_input_INT(inputfiles_INT, fileCounter_INT, minPhred, fiveClip, kmersize, to2Bit);
 			}
 			
+			if(prefilterfilename) {
+				prefilter_report(stderr);
+			}
+			if(subFraction || subNum) {
+				subsample_flush(stderr);
+			}
+			
 			if(Mt1) {
 				Mt1 = -1;
 				sfwrite(&Mt1, sizeof(int), 1, stdout);
@@ -1001,11 +1201,35 @@ int kma_main(int argc, char *argv[]) {
 		fflush(stdout);
 		t1 = clock();
 		fprintf(stderr, "#\n# Total time used for converting query: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
+	} else if(batchfilename) {
+		/* drop "-batch <file>" from the sample commands */
+		for(args = batchArg + 2; args < argc; ++args) {
+			argv[args - 2] = argv[args];
+		}
+		exeBasic = strjoin(argv, argc - 2);
+		
+		/* share what the samples would otherwise load each */
+		if(targetNum != 1 || Mt1) {
+			shmLvl = 0;
+		} else {
+			shmLvl = (deConPrintPtr == &deConPrint ? 2 : 1) | 4;
+		}
+		status = runKMA_batch(batchfilename, templatefilename, exeBasic, shm, shmLvl);
+		fflush(stdout);
 	} else if(Mt1) {
+		if(cacheBudget) {
+			fprintf(stderr, "# \"-cache\" is not considered in Mt1 mode.\n");
+		}
+		if(clustFlag) {
+			fprintf(stderr, "# \"-clust\" is not considered in Mt1 mode.\n");
+		}
+		if(seqzCache) {
+			fprintf(stderr, "# \"-seqz\" is not considered in Mt1 mode.\n");
+		}
 		exeBasic = strjoin(argv, argc);
 		strcat(exeBasic, "-s1");
 		
-		runKMA_Mt1(templatefilename, outputfilename, exeBasic, kmersize, rewards, ID_t, mq, scoreT, evalue, bcd, Mt1, ref_fsa, print_matrix, vcf, thread_num);
+		runKMA_Mt1(templatefilename, outputfilename, exeBasic, kmersize, rewards, ID_t, mq, scoreT, evalue, bcd, Mt1, ref_fsa, print_matrix, print_bin, vcf, thread_num);
 		fprintf(stderr, "# Closing files\n");
 		fflush(stdout);
 	} else if(step2) {
@@ -1014,6 +1238,18 @@ int kma_main(int argc, char *argv[]) {
 		status = save_kmers_batch(templatefilename, exeBasic, shm, thread_num, exhaustive, rewards);
 		fflush(stdout);
 	} else if(sparse_run) {
+		if(samFlag) {
+			fprintf(stderr, "# Sparse mode does not align reads, \"-sam\" is ignored.\n");
+		}
+		if(cacheBudget) {
+			fprintf(stderr, "# \"-cache\" is not considered in Sparse mode.\n");
+		}
+		if(clustFlag) {
+			fprintf(stderr, "# \"-clust\" is not considered in Sparse mode.\n");
+		}
+		if(seqzCache) {
+			fprintf(stderr, "# \"-seqz\" is not considered in Sparse mode.\n");
+		}
 		exeBasic = strjoin(argv, argc);
 		strcat(exeBasic, "-s1");
 		status = save_kmers_sparse_batch(templatefilename, outputfilename, exeBasic, ID_t, evalue, ss, shm);
@@ -1024,11 +1260,40 @@ int kma_main(int argc, char *argv[]) {
 		strcat(exeBasic, "-s2");
 		
 		if(spltDB == 0 && targetNum != 1) {
-			status = runKMA_spltDB(templatefilenames, targetNum, outputfilename, argc, argv, ConClave, kmersize, rewards, extendedFeatures, ID_t, mq, scoreT, evalue, bcd, ref_fsa, print_matrix, print_all, vcf, shm, thread_num);
+			if(samFlag) {
+				fprintf(stderr, "# SAM output is not available with several databases, and is skipped.\n");
+			}
+			if(cacheBudget) {
+				fprintf(stderr, "# \"-cache\" is not considered with several databases.\n");
+			}
+			if(clustFlag) {
+				fprintf(stderr, "# \"-clust\" is not considered with several databases.\n");
+			}
+			if(seqzCache) {
+				fprintf(stderr, "# \"-seqz\" is not considered with several databases.\n");
+			}
+			status = runKMA_spltDB(templatefilenames, targetNum, outputfilename, argc, argv, ConClave, kmersize, rewards, extendedFeatures, ID_t, mq, scoreT, evalue, bcd, ref_fsa, print_matrix, print_all, print_bin, vcf, memBudget, shm, thread_num);
 		} else if(mem_mode) {
-			status = runKMA_MEM(templatefilename, outputfilename, exeBasic, ConClave, kmersize, rewards, extendedFeatures, ID_t, mq, scoreT, evalue, bcd, ref_fsa, print_matrix, print_all, vcf, shm, thread_num);
+			if(cacheBudget) {
+				fprintf(stderr, "# \"-cache\" is not considered in mem_mode.\n");
+			}
+			if(clustFlag) {
+				fprintf(stderr, "# \"-clust\" is not considered in mem_mode.\n");
+			}
+			if(seqzCache) {
+				fprintf(stderr, "# \"-seqz\" is not considered in mem_mode.\n");
+			}
+			status = runKMA_MEM(templatefilename, outputfilename, exeBasic, ConClave, kmersize, rewards, extendedFeatures, ID_t, mq, scoreT, evalue, bcd, ref_fsa, print_matrix, print_all, print_bin, vcf, memBudget, shm, thread_num);
 		} else {
-			status = runKMA(templatefilename, outputfilename, exeBasic, ConClave, kmersize, rewards, extendedFeatures, ID_t, mq, scoreT, evalue, bcd, ref_fsa, print_matrix, print_all, vcf, shm, thread_num);
+			if(seqzCache && (shm & 8)) {
+				fprintf(stderr, "# \"-seqz\" is not considered with shared template sequences.\n");
+			} else if(seqzCache) {
+				templateSeqZ = seqz_init(seqzCache);
+			}
+			if(cacheBudget) {
+				indexCache = indexCache_init(cacheBudget);
+			}
+			status = runKMA(templatefilename, outputfilename, exeBasic, ConClave, kmersize, rewards, extendedFeatures, ID_t, mq, scoreT, evalue, bcd, ref_fsa, print_matrix, print_all, print_bin, vcf, memBudget, shm, thread_num);
 		}
 		fprintf(stderr, "# Closing files\n");
 		fflush(stdout);
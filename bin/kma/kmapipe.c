@@ -125,7 +125,8 @@ FILE * kmaPipe(const char *cmd, const char *type, FILE *ioStream, int *status) {
 		while ((pid = waitpid(src->pid, status, 0)) == -1 && errno == EINTR) {
 			usleep(100);
 		}
-		*status = 0;
+		/* exit status of the child, or 1 if it did not exit normally */
+		*status = (pid != -1 && WIFEXITED(*status)) ? WEXITSTATUS(*status) : 1;
 		#else
 		WaitForSingleObject(src->pid, INFINITE);
 		#endif
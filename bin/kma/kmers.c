@@ -48,7 +48,7 @@ typedef int key_t;
 
 int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int thread_num, const int exhaustive, Penalties *rewards) {
 	
-	int i, file_len, shmid, deCon, spltDB, *bestTemplates, *template_lengths;
+	int i, file_len, shmid, deCon, *bestTemplates, *template_lengths;
 	FILE *inputfile, *templatefile;
 	time_t t0, t1;
 	key_t key;
@@ -147,12 +147,6 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 		save_kmers_HMM(templates, 0, &(int){thread_num}, template_lengths, 0, 0, *Qseq, 0, 0, 0, 0, 0);
 	}
 	
-	if(printPtr == &print_ankers_spltDB || printPtr == &print_ankers_Sparse_spltDB) {
-		spltDB = 1;
-	} else {
-		spltDB = 0;
-	}
-	
 	t1 = clock();
 	fprintf(stderr, "#\n# Total time used for DB loading: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
 	t0 = clock();
@@ -179,7 +173,6 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 		thread->header = Header[i];
 		thread->inputfile = inputfile;
 		thread->rewards = rewards;
-		thread->spltDB = spltDB;
 		thread->next = threads;
 		threads = thread;
 		
@@ -213,7 +206,6 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 	thread->inputfile = inputfile;
 	thread->rewards = rewards;
 	thread->exhaustive = exhaustive;
-	thread->spltDB = spltDB;
 	
 	/* start k-mer search */
 	save_kmers_threaded(thread);
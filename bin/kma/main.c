@@ -23,6 +23,8 @@
 #include "shm.h"
 #include "seq2fasta.h"
 #include "update.h"
+#include "count.h"
+#include "fragbin.h"
 
 static int helpmessage() {
 	
@@ -32,6 +34,8 @@ static int helpmessage() {
 	fprintf(stderr, "#\tkma shm -h\n");
 	fprintf(stderr, "#\tkma seq2fasta -h\n");
 	fprintf(stderr, "#\tkma update -h\n");
+	fprintf(stderr, "#\tkma count -h\n");
+	fprintf(stderr, "#\tkma frag2txt -h\n");
 	return 1;
 }
 
@@ -50,6 +54,10 @@ int main(int argc, char *argv[]) {
 			status = seq2fasta_main(argc, argv);
 		} else if(strcmp(*argv, "update") == 0) {
 			status = update_main(argc, argv);
+		} else if(strcmp(*argv, "count") == 0) {
+			status = count_main(argc, argv);
+		} else if(strcmp(*argv, "frag2txt") == 0) {
+			status = frag2txt_main(argc, argv);
 		} else {
 			fprintf(stderr, "Invalid option:\t%s\n", *argv);
 			status = helpmessage();
@@ -25,6 +25,7 @@
 #include "compdna.h"
 #include "filebuff.h"
 #include "hashmap.h"
+#include "hashmapindex.h"
 #include "makeindex.h"
 #include "pherror.h"
 #include "qseqs.h"
@@ -75,13 +76,16 @@ void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount,
 	if(dumpIndex == &makeIndexing) {
 		if(appender) {
 			strcat(outputfilename, ".index.b");
+			index_out = sfopen(outputfilename, "rb");
+			hashMap_index_loadHeader(fileno(index_out));
+			fclose(index_out);
 			index_out = sfopen(outputfilename, "ab");
 			outputfilename[file_len] = 0;
 		} else {
 			strcat(outputfilename, ".index.b");
 			index_out = sfopen(outputfilename, "wb");
 			outputfilename[file_len] = 0;
-			cfwrite(&kmerindex, sizeof(int), 1, index_out);
+			hashMap_index_dumpHeader(kmerindex, index_out);
 		}
 	} else {
 		index_out = 0;
@@ -26,6 +26,8 @@
 #include "chain.h"
 #include "compdna.h"
 #include "filebuff.h"
+#include "fragbin.h"
+#include "frags.h"
 #include "hashmapindex.h"
 #include "kmapipe.h"
 #include "mt1.h"
@@ -34,7 +36,9 @@
 #include "pherror.h"
 #include "printconsensus.h"
 #include "qseqs.h"
+#include "resbin.h"
 #include "runkma.h"
+#include "sam.h"
 #include "stdstat.h"
 #include "vcf.h"
 
@@ -60,19 +64,21 @@ void printFsa_pairMt1(Qseqs *header, Qseqs *qseq, Qseqs *header_r, Qseqs *qseq_r
 	
 }
 
-void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int kmersize, Penalties *rewards, double ID_t, int mq, double scoreT, double evalue, int bcd, int Mt1, int ref_fsa, int print_matrix, int vcf, int thread_num) {
+void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int kmersize, Penalties *rewards, double ID_t, int mq, double scoreT, double evalue, int bcd, int Mt1, int ref_fsa, int print_matrix, int print_bin, int vcf, int thread_num) {
 	
 	int i, j, aln_len, t_len, coverScore, file_len, DB_size, delta;
 	int *template_lengths;
 	long unsigned read_score, seeker;
 	double p_value, id, q_id, cover, q_cover;
 	long double depth;
-	FILE *res_out, *alignment_out, *consensus_out, *template_fragments;
+	FILE *res_out, *frag_in;
 	FILE *DB_file;
 	time_t t0, t1;
-	FileBuff *frag_out, *matrix_out, *vcf_out;
+	FileBuff *alignment_out, *consensus_out, *frag_out, *matrix_out, *vcf_out;
+	FragIn *template_fragments;
 	Aln *aligned, *gap_align;
 	Assem *aligned_assem;
+	ResBin *res_bin;
 	Qseqs *qseq, *header, *template_name;
 	AssemInfo *matrix;
 	AlnPoints *points;
@@ -82,12 +88,13 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	
 	/* open pipe */
 	//template_fragments = popen(exePrev, "r");
-	template_fragments = kmaPipe(exePrev, "rb", 0, 0);
-	if(!template_fragments) {
+	frag_in = kmaPipe(exePrev, "rb", 0, 0);
+	if(!frag_in) {
 		ERROR();
 	} else {
-		setvbuf(template_fragments, NULL, _IOFBF, CHUNK);
+		setvbuf(frag_in, NULL, _IOFBF, CHUNK);
 	}
+	template_fragments = setFragIn(frag_in, 0);
 	
 	file_len = strlen(outputfilename);
 	delta = 1024;
@@ -100,15 +107,31 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 		strcat(outputfilename, ".res");
 		res_out = sfopen(outputfilename, "w");
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".frag.gz");
-		frag_out = gzInitFileBuff(CHUNK);
-		openFileBuff(frag_out, outputfilename, "wb");
+		if(print_bin) {
+			strcat(outputfilename, ".res.b");
+			res_bin = resBin_init(sfopen(outputfilename, "wb"), 1024);
+			outputfilename[file_len] = 0;
+		} else {
+			res_bin = 0;
+		}
+		if(updateFragsPtr == &updateFragsBin) {
+			strcat(outputfilename, ".frag.b");
+			frag_out = initOutFileBuff(CHUNK, 0);
+			openFileBuff(frag_out, outputfilename, "wb");
+			initFragBin(frag_out);
+		} else {
+			strcat(outputfilename, ".frag.gz");
+			frag_out = gzInitFileBuff(CHUNK);
+			openFileBuff(frag_out, outputfilename, "wb");
+		}
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".aln");
-		alignment_out = sfopen(outputfilename, "w");
+		strcat(outputfilename, alnGz ? ".aln.gz" : ".aln");
+		alignment_out = initOutFileBuff(CHUNK, alnGz);
+		openFileBuff(alignment_out, outputfilename, "wb");
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".fsa");
-		consensus_out = sfopen(outputfilename, "w");
+		strcat(outputfilename, alnGz ? ".fsa.gz" : ".fsa");
+		consensus_out = initOutFileBuff(CHUNK, alnGz);
+		openFileBuff(consensus_out, outputfilename, "wb");
 		outputfilename[file_len] = 0;
 		if(print_matrix) {
 			matrix_out = gzInitFileBuff(CHUNK);
@@ -186,6 +209,13 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	nameLoad(template_name, DB_file);
 	fclose(DB_file);
+	if(samFlag) {
+		i = strlen(outputfilename);
+		strcat(outputfilename, ".sam.gz");
+		samOut = samInit(outputfilename, samFlag == 2);
+		outputfilename[i] = 0;
+		samSQ(samOut, (char *) template_name->seq, *template_lengths);
+	}
 	
 	fprintf(stderr, "#\n# Doing local assemblies of found templates, and output results\n");
 	t0 = clock();
@@ -243,8 +273,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 		thread->evalue = evalue;
 		thread->bcd = bcd;
 		thread->template = -2;
-		thread->file_count = 1;
-		thread->files = &template_fragments;
+		thread->frags = template_fragments;
 		thread->frag_out = frag_out;
 		thread->aligned_assem = aligned_assem;
 		thread->aligned = aligned;
@@ -301,8 +330,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	thread->evalue = evalue;
 	thread->bcd = bcd;
 	thread->template = 0;
-	thread->file_count = 1;
-	thread->files = &template_fragments;
+	thread->frags = template_fragments;
 	thread->frag_out = frag_out;
 	thread->aligned_assem = aligned_assem;
 	thread->aligned = aligned;
@@ -351,6 +379,9 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 			/* Output result */
 			fprintf(res_out, "%-12s\t%8lu\t%8d\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n",
 				thread->template_name, read_score, 0, t_len, id, cover, q_id, q_cover, (double) depth, (double) read_score, p_value);
+			if(res_bin) {
+				resBin_add(res_bin, Mt1, thread->template_name, read_score, 0, t_len, read_score, p_value, aligned_assem, 0, 0);
+			}
 			printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
 			/* print matrix */
 			if(matrix_out) {
@@ -375,16 +406,24 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	/* Close files */
+	destroyFragIn(template_fragments);
+	if(res_bin) {
+		closeResBin(res_bin);
+	}
 	fclose(res_out);
-	fclose(alignment_out);
-	fclose(consensus_out);
-	destroyGzFileBuff(frag_out);
+	destroyOutFileBuff(alignment_out);
+	destroyOutFileBuff(consensus_out);
+	destroyOutFileBuff(frag_out);
 	if(matrix_out) {
 		destroyGzFileBuff(matrix_out);
 	}
 	if(vcf) {
 		destroyGzFileBuff(vcf_out);
 	}
+	if(samOut) {
+		samDestroy(samOut);
+		samOut = 0;
+	}
 	
 	t1 = clock();
 	fprintf(stderr, "# Total time used for local assembly: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
@@ -0,0 +1,148 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "nameindex.h"
+#include "pherror.h"
+#include "qseqs.h"
+
+long unsigned * nameIndex_scan(int name_in, int *n) {
+	
+	int size;
+	long unsigned pos, *offsets;
+	ssize_t bytes;
+	unsigned char *buff, *ptr, *next, *end;
+	
+	/* find the newlines of *.name from the start */
+	size = 1024;
+	offsets = smalloc(size * sizeof(long unsigned));
+	*offsets = 0;
+	*n = 0;
+	buff = smalloc(1048576);
+	pos = 0;
+	next = 0;
+	while(0 < (bytes = pread(name_in, buff, 1048576, pos))) {
+		end = buff + bytes;
+		for(ptr = buff; (next = memchr(ptr, '\n', end - ptr)); ptr = next + 1) {
+			if(++*n == size) {
+				size <<= 1;
+				offsets = realloc(offsets, size * sizeof(long unsigned));
+				if(!offsets) {
+					ERROR();
+				}
+			}
+			offsets[*n] = pos + (next - buff) + 1;
+		}
+		pos += bytes;
+	}
+	free(buff);
+	
+	/* unterminated last name */
+	if(offsets[*n] < pos) {
+		if(++*n == size) {
+			offsets = realloc(offsets, (size + 1) * sizeof(long unsigned));
+			if(!offsets) {
+				ERROR();
+			}
+		}
+		offsets[*n] = pos + 1;
+	}
+	
+	return offsets;
+}
+
+void nameIndex_make(char *filename) {
+	
+	int n, file_len;
+	long unsigned *offsets;
+	FILE *name_in, *out;
+	
+	file_len = strlen(filename);
+	strcat(filename, ".name");
+	name_in = sfopen(filename, "rb");
+	filename[file_len] = 0;
+	offsets = nameIndex_scan(fileno(name_in), &n);
+	fclose(name_in);
+	
+	strcat(filename, ".name.idx");
+	out = sfopen(filename, "wb");
+	filename[file_len] = 0;
+	sfwrite(&n, sizeof(int), 1, out);
+	sfwrite(offsets, sizeof(long unsigned), n + 1, out);
+	fclose(out);
+	free(offsets);
+}
+
+long unsigned * nameIndex_load(char *filename, int name_in, int DB_size) {
+	
+	int n, file_len;
+	long unsigned *offsets;
+	struct stat finfo;
+	FILE *file;
+	
+	/* use *.name.idx when it matches *.name, else index it here */
+	file_len = strlen(filename);
+	strcat(filename, ".name.idx");
+	file = fopen(filename, "rb");
+	filename[file_len] = 0;
+	offsets = 0;
+	if(file) {
+		if(fread(&n, sizeof(int), 1, file) == 1 && n == DB_size - 1 && fstat(name_in, &finfo) == 0) {
+			offsets = smalloc((n + 1) * sizeof(long unsigned));
+			if(fread(offsets, sizeof(long unsigned), n + 1, file) != n + 1 || (offsets[n] != finfo.st_size && offsets[n] != finfo.st_size + 1)) {
+				free(offsets);
+				offsets = 0;
+			}
+		}
+		fclose(file);
+	}
+	errno = 0;
+	if(!offsets) {
+		offsets = nameIndex_scan(name_in, &n);
+		if(n < DB_size - 1) {
+			fprintf(stderr, "Missing template names in:\t%s.name\n", filename);
+			exit(1);
+		}
+	}
+	
+	return offsets;
+}
+
+char * nameIndex_get(Qseqs *name, int name_in, long unsigned *offsets, int template) {
+	
+	int len;
+	
+	len = offsets[template] - offsets[template - 1] - 1;
+	if(name->size <= len) {
+		free(name->seq);
+		name->size = len + 1;
+		name->seq = smalloc(name->size);
+	}
+	if(pread(name_in, name->seq, len, offsets[template - 1]) != len) {
+		ERROR();
+	}
+	name->seq[len] = 0;
+	
+	return (char *) name->seq;
+}
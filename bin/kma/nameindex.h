@@ -0,0 +1,29 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include "qseqs.h"
+
+/*
+ * *.name.idx holds the number of names, followed by their end offsets in
+ * *.name (one past the newline), so name t spans [off[t - 1], off[t] - 1).
+ */
+long unsigned * nameIndex_scan(int name_in, int *n);
+void nameIndex_make(char *filename);
+long unsigned * nameIndex_load(char *filename, int name_in, int DB_size);
+char * nameIndex_get(Qseqs *name, int name_in, long unsigned *offsets, int template);
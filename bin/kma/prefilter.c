@@ -0,0 +1,117 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compdna.h"
+#include "hashmapkma.h"
+#include "pherror.h"
+#include "prefilter.h"
+#include "qseqs.h"
+#include "runinput.h"
+
+/* k-mers of the panel, and where passing reads are delivered */
+static HashMapKMA *prefilterDB = 0;
+static int prefilterMin = 1;
+static long unsigned prefilterIn = 0, prefilterOut = 0;
+static void (*prefilterFsa_ptr)(Qseqs*, Qseqs*, CompDNA*);
+static void (*prefilterFsa_pair_ptr)(Qseqs*, Qseqs*, Qseqs*, Qseqs*, CompDNA*);
+
+void prefilter_init(char *filename, int minKmers) {
+	
+	char *dbfilename;
+	FILE *file;
+	
+	/* load k-mers made by kma_index */
+	dbfilename = smalloc(strlen(filename) + 8);
+	sprintf(dbfilename, "%s.comp.b", filename);
+	file = sfopen(dbfilename, "rb");
+	prefilterDB = smalloc(sizeof(HashMapKMA));
+	if(hashMapKMA_load(prefilterDB, file, dbfilename)) {
+		fprintf(stderr, "Wrong format of prefilter DB.\n");
+		exit(2);
+	} else if(prefilterDB->prefix_len != 0 || prefilterDB->prefix != 0) {
+		fprintf(stderr, "Prefilter DB cannot be sparse.\n");
+		exit(2);
+	}
+	fclose(file);
+	free(dbfilename);
+	prefilterMin = minKmers;
+	
+	/* put the filter in front of the delivery */
+	prefilterFsa_ptr = printFsa_ptr;
+	prefilterFsa_pair_ptr = printFsa_pair_ptr;
+	printFsa_ptr = &printFsa_prefilter;
+	printFsa_pair_ptr = &printFsa_pair_prefilter;
+}
+
+void prefilter_report(FILE *out) {
+	fprintf(out, "# Prefilter kept:\t%lu of %lu reads / read pairs.\n", prefilterOut, prefilterIn);
+}
+
+static int prefilter_hits(Qseqs *qseq) {
+	
+	/* count k-mers on either strand shared with the panel */
+	int i, hits, shifter, kmersize, nuc, len;
+	long unsigned kmer, rc, mask;
+	unsigned char *seq;
+	
+	kmersize = prefilterDB->kmersize;
+	mask = prefilterDB->mask;
+	shifter = (kmersize - 1) << 1;
+	seq = qseq->seq;
+	hits = 0;
+	len = 0;
+	kmer = 0;
+	rc = 0;
+	for(i = 0; i < qseq->len; ++i) {
+		if((nuc = seq[i]) < 4) {
+			kmer = ((kmer << 2) | nuc) & mask;
+			rc = (rc >> 2) | ((long unsigned)(3 - nuc) << shifter);
+			if(kmersize <= ++len && (hashMap_get(prefilterDB, kmer) || hashMap_get(prefilterDB, rc))) {
+				if(prefilterMin <= ++hits) {
+					return hits;
+				}
+			}
+		} else {
+			len = 0;
+		}
+	}
+	
+	return hits;
+}
+
+void printFsa_prefilter(Qseqs *header, Qseqs *qseq, CompDNA *compressor) {
+	
+	++prefilterIn;
+	if(prefilterMin <= prefilter_hits(qseq)) {
+		++prefilterOut;
+		prefilterFsa_ptr(header, qseq, compressor);
+	}
+}
+
+void printFsa_pair_prefilter(Qseqs *header, Qseqs *qseq, Qseqs *header_r, Qseqs *qseq_r, CompDNA *compressor) {
+	
+	++prefilterIn;
+	if(prefilterMin <= prefilter_hits(qseq) || prefilterMin <= prefilter_hits(qseq_r)) {
+		++prefilterOut;
+		prefilterFsa_pair_ptr(header, qseq, header_r, qseq_r, compressor);
+	}
+}
@@ -18,42 +18,96 @@
 */
 #define _XOPEN_SOURCE 600
 #include <stdio.h>
+#include <string.h>
 #include "assembly.h"
+#include "filebuff.h"
 #include "printconsensus.h"
 
-void printConsensus(Assem *aligned_assem, char *header, FILE *alignment_out, FILE *consensus_out, int ref_fsa) {
+int alnGz = 0;
+
+static void reserveFileBuff(FileBuff *dest, int size) {
+	
+	if(dest->bytes < size) {
+		writeFileBuff(dest);
+		
+		/* line is too big, reallocate buffer */
+		if(dest->bytes < size) {
+			resetGzFileBuff(dest, size << 1);
+		}
+	}
+}
+
+static unsigned char * alnLine(unsigned char *dest, const char *prefix, void *src, int len) {
+	
+	/* prefix is "%-10s\t" */
+	memcpy(dest, prefix, 11);
+	dest += 11;
+	memcpy(dest, src, len);
+	dest += len;
+	*dest++ = '\n';
+	
+	return dest;
+}
+
+static unsigned char * headerLine(unsigned char *dest, const char *prefix, char *header, int len) {
+	
+	while(*prefix) {
+		*dest++ = *prefix++;
+	}
+	memcpy(dest, header, len);
+	dest += len;
+	*dest++ = '\n';
 	
-	int i, aln_len, bias;
+	return dest;
+}
+
+void printConsensus(Assem *aligned_assem, char *header, FileBuff *alignment_out, FileBuff *consensus_out, int ref_fsa) {
+	
+	int i, len, aln_len, header_len;
+	unsigned char c, *q, *update;
 	
 	/* print alignment */
 	aln_len = aligned_assem->len;
-	fprintf(alignment_out, "# %s\n", header);
+	header_len = strlen(header);
+	reserveFileBuff(alignment_out, header_len + 3);
+	update = headerLine(alignment_out->next, "# ", header, header_len);
+	alignment_out->bytes -= update - alignment_out->next;
+	alignment_out->next = update;
 	for(i = 0; i < aln_len; i += 60) {
-		fprintf(alignment_out, "%-10s\t%.60s\n", "template:", aligned_assem->t + i);
-		fprintf(alignment_out, "%-10s\t%.60s\n", "", aligned_assem->s + i);
-		fprintf(alignment_out, "%-10s\t%.60s\n\n", "query:", aligned_assem->q + i);
+		len = aln_len - i < 60 ? aln_len - i : 60;
+		reserveFileBuff(alignment_out, 3 * len + 37);
+		update = alnLine(alignment_out->next, "template: \t", aligned_assem->t + i, len);
+		update = alnLine(update, "          \t", aligned_assem->s + i, len);
+		update = alnLine(update, "query:    \t", aligned_assem->q + i, len);
+		*update++ = '\n';
+		alignment_out->bytes -= update - alignment_out->next;
+		alignment_out->next = update;
 	}
 	
-	/* Prepare consensus */
-	if(ref_fsa) {
-		for(i = 0; i < aln_len; ++i) {
-			if(aligned_assem->q[i] == '-') {
-				aligned_assem->q[i] = 'n';
+	/* print consensus, with gaps masked or removed */
+	reserveFileBuff(consensus_out, header_len + 2);
+	update = headerLine(consensus_out->next, ">", header, header_len);
+	consensus_out->bytes -= update - consensus_out->next;
+	consensus_out->next = update;
+	q = aligned_assem->q;
+	i = 0;
+	while(i < aln_len) {
+		reserveFileBuff(consensus_out, 61);
+		update = consensus_out->next;
+		len = 0;
+		while(len < 60 && i < aln_len) {
+			if((c = q[i++]) != '-') {
+				*update++ = c;
+				++len;
+			} else if(ref_fsa) {
+				*update++ = 'n';
+				++len;
 			}
 		}
-	} else {
-		for(i = 0, bias = 0; i < aln_len; ++i, ++bias) {
-			aligned_assem->q[bias] = aligned_assem->q[i];
-			if(aligned_assem->q[i] == '-') {
-				--bias;
-			}
+		if(len) {
+			*update++ = '\n';
 		}
-		aln_len = bias;
-		aligned_assem->q[aln_len] = 0;
-	}
-	/* Print consensus */
-	fprintf(consensus_out, ">%s\n", header);
-	for(i = 0; i < aln_len; i += 60) {
-		fprintf(consensus_out, "%.60s\n", aligned_assem->q + i);
+		consensus_out->bytes -= update - consensus_out->next;
+		consensus_out->next = update;
 	}
 }
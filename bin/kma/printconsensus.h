@@ -19,5 +19,8 @@
 #define _XOPEN_SOURCE 600
 #include <stdio.h>
 #include "assembly.h"
+#include "filebuff.h"
 
-void printConsensus(Assem *aligned_assem, char *header, FILE *alignment_out, FILE *consensus_out, int ref_fsa);
+extern int alnGz;
+
+void printConsensus(Assem *aligned_assem, char *header, FileBuff *alignment_out, FileBuff *consensus_out, int ref_fsa);
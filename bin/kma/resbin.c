@@ -0,0 +1,222 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assembly.h"
+#include "pherror.h"
+#include "resbin.h"
+
+/*
+ Columnar result file, *.res.b:
+ int version, int n, long nameLen,
+ followed by one array of n entries per column, in the order of ResBin,
+ and nameLen bytes of null terminated template names.
+*/
+
+static void * resBin_realloc(void *src, size_t size) {
+	
+	void *dest;
+	
+	if(!(dest = realloc(src, size))) {
+		ERROR();
+	}
+	
+	return dest;
+}
+
+static void resBin_alloc(ResBin *dest, int size) {
+	
+	dest->size = size;
+	dest->template = resBin_realloc(dest->template, size * sizeof(int));
+	dest->name = resBin_realloc(dest->name, size * sizeof(long));
+	dest->score = resBin_realloc(dest->score, size * sizeof(long));
+	dest->expected = resBin_realloc(dest->expected, size * sizeof(double));
+	dest->t_len = resBin_realloc(dest->t_len, size * sizeof(int));
+	dest->id = resBin_realloc(dest->id, size * sizeof(double));
+	dest->cover = resBin_realloc(dest->cover, size * sizeof(double));
+	dest->q_id = resBin_realloc(dest->q_id, size * sizeof(double));
+	dest->q_cover = resBin_realloc(dest->q_cover, size * sizeof(double));
+	dest->depth = resBin_realloc(dest->depth, size * sizeof(double));
+	dest->depthVar = resBin_realloc(dest->depthVar, size * sizeof(double));
+	dest->q_value = resBin_realloc(dest->q_value, size * sizeof(double));
+	dest->p_value = resBin_realloc(dest->p_value, size * sizeof(double));
+	dest->readCount = resBin_realloc(dest->readCount, size * sizeof(unsigned));
+	dest->fragmentCount = resBin_realloc(dest->fragmentCount, size * sizeof(unsigned));
+	dest->aln_len = resBin_realloc(dest->aln_len, size * sizeof(unsigned));
+	dest->consensus = resBin_realloc(dest->consensus, size * sizeof(unsigned));
+}
+
+ResBin * resBin_init(FILE *file, int size) {
+	
+	ResBin *dest;
+	
+	dest = smalloc(sizeof(ResBin));
+	memset(dest, 0, sizeof(ResBin));
+	dest->file = file;
+	dest->nameSize = 1024;
+	dest->names = smalloc(dest->nameSize);
+	resBin_alloc(dest, size < 1 ? 1 : size);
+	
+	return dest;
+}
+
+void resBin_add(ResBin *dest, int template, char *name, long score, double expected, int t_len, double q_value, double p_value, Assem *aligned_assem, unsigned readCount, unsigned fragmentCount) {
+	
+	int n, len;
+	double depth;
+	
+	if((n = dest->n) == dest->size) {
+		resBin_alloc(dest, dest->size << 1);
+	}
+	len = strlen(name) + 1;
+	if(dest->nameSize < dest->nameLen + len) {
+		dest->nameSize = (dest->nameLen + len) << 1;
+		dest->names = resBin_realloc(dest->names, dest->nameSize);
+	}
+	
+	dest->template[n] = template;
+	dest->name[n] = dest->nameLen;
+	memcpy(dest->names + dest->nameLen, name, len);
+	dest->nameLen += len;
+	dest->score[n] = score;
+	dest->expected[n] = expected;
+	dest->t_len[n] = t_len;
+	dest->id[n] = 100.0 * aligned_assem->cover / t_len;
+	dest->cover[n] = 100.0 * aligned_assem->aln_len / t_len;
+	dest->q_id[n] = 100.0 * aligned_assem->cover / aligned_assem->aln_len;
+	dest->q_cover[n] = 100.0 * t_len / aligned_assem->aln_len;
+	depth = aligned_assem->depth;
+	depth /= t_len;
+	dest->depth[n] = depth;
+	dest->depthVar[n] = 1.0 * aligned_assem->depthVar / t_len - depth * depth;
+	dest->q_value[n] = q_value;
+	dest->p_value[n] = p_value;
+	dest->readCount[n] = readCount;
+	dest->fragmentCount[n] = fragmentCount;
+	dest->aln_len[n] = aligned_assem->aln_len;
+	dest->consensus[n] = aligned_assem->cover;
+	++dest->n;
+}
+
+void closeResBin(ResBin *src) {
+	
+	int n;
+	FILE *file;
+	
+	/* write columns in bulk */
+	n = src->n;
+	file = src->file;
+	sfwrite(&(int){RESBIN_VERSION}, sizeof(int), 1, file);
+	sfwrite(&n, sizeof(int), 1, file);
+	sfwrite(&src->nameLen, sizeof(long), 1, file);
+	sfwrite(src->template, sizeof(int), n, file);
+	sfwrite(src->name, sizeof(long), n, file);
+	sfwrite(src->score, sizeof(long), n, file);
+	sfwrite(src->expected, sizeof(double), n, file);
+	sfwrite(src->t_len, sizeof(int), n, file);
+	sfwrite(src->id, sizeof(double), n, file);
+	sfwrite(src->cover, sizeof(double), n, file);
+	sfwrite(src->q_id, sizeof(double), n, file);
+	sfwrite(src->q_cover, sizeof(double), n, file);
+	sfwrite(src->depth, sizeof(double), n, file);
+	sfwrite(src->depthVar, sizeof(double), n, file);
+	sfwrite(src->q_value, sizeof(double), n, file);
+	sfwrite(src->p_value, sizeof(double), n, file);
+	sfwrite(src->readCount, sizeof(unsigned), n, file);
+	sfwrite(src->fragmentCount, sizeof(unsigned), n, file);
+	sfwrite(src->aln_len, sizeof(unsigned), n, file);
+	sfwrite(src->consensus, sizeof(unsigned), n, file);
+	sfwrite(src->names, 1, src->nameLen, file);
+	fclose(file);
+	src->file = 0;
+	
+	destroyResBin(src);
+}
+
+ResBin * resBin_load(char *filename) {
+	
+	int n, version;
+	FILE *file;
+	ResBin *dest;
+	
+	file = sfopen(filename, "rb");
+	sfread(&version, sizeof(int), 1, file);
+	if(version != RESBIN_VERSION) {
+		fprintf(stderr, "Unsupported version of \"%s\": %d\n", filename, version);
+		exit(1);
+	}
+	sfread(&n, sizeof(int), 1, file);
+	dest = resBin_init(0, n);
+	dest->n = n;
+	sfread(&dest->nameLen, sizeof(long), 1, file);
+	dest->nameSize = dest->nameLen + 1;
+	free(dest->names);
+	dest->names = smalloc(dest->nameSize);
+	
+	sfread(dest->template, sizeof(int), n, file);
+	sfread(dest->name, sizeof(long), n, file);
+	sfread(dest->score, sizeof(long), n, file);
+	sfread(dest->expected, sizeof(double), n, file);
+	sfread(dest->t_len, sizeof(int), n, file);
+	sfread(dest->id, sizeof(double), n, file);
+	sfread(dest->cover, sizeof(double), n, file);
+	sfread(dest->q_id, sizeof(double), n, file);
+	sfread(dest->q_cover, sizeof(double), n, file);
+	sfread(dest->depth, sizeof(double), n, file);
+	sfread(dest->depthVar, sizeof(double), n, file);
+	sfread(dest->q_value, sizeof(double), n, file);
+	sfread(dest->p_value, sizeof(double), n, file);
+	sfread(dest->readCount, sizeof(unsigned), n, file);
+	sfread(dest->fragmentCount, sizeof(unsigned), n, file);
+	sfread(dest->aln_len, sizeof(unsigned), n, file);
+	sfread(dest->consensus, sizeof(unsigned), n, file);
+	sfread(dest->names, 1, dest->nameLen, file);
+	fclose(file);
+	
+	return dest;
+}
+
+void destroyResBin(ResBin *src) {
+	
+	if(src->file) {
+		fclose(src->file);
+	}
+	free(src->template);
+	free(src->name);
+	free(src->score);
+	free(src->expected);
+	free(src->t_len);
+	free(src->id);
+	free(src->cover);
+	free(src->q_id);
+	free(src->q_cover);
+	free(src->depth);
+	free(src->depthVar);
+	free(src->q_value);
+	free(src->p_value);
+	free(src->readCount);
+	free(src->fragmentCount);
+	free(src->aln_len);
+	free(src->consensus);
+	free(src->names);
+	free(src);
+}
@@ -0,0 +1,58 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include "assembly.h"
+
+#ifndef RESBIN
+typedef struct resBin ResBin;
+struct resBin {
+	int n;
+	int size;
+	long nameLen;
+	long nameSize;
+	int *template;
+	long *name; /* offset in names */
+	long *score;
+	double *expected;
+	int *t_len;
+	double *id;
+	double *cover;
+	double *q_id;
+	double *q_cover;
+	double *depth;
+	double *depthVar;
+	double *q_value;
+	double *p_value;
+	unsigned *readCount;
+	unsigned *fragmentCount;
+	unsigned *aln_len;
+	unsigned *consensus;
+	char *names;
+	FILE *file;
+};
+#define RESBIN 1
+#define RESBIN_VERSION 1
+#endif
+
+ResBin * resBin_init(FILE *file, int size);
+void resBin_add(ResBin *dest, int template, char *name, long score, double expected, int t_len, double q_value, double p_value, Assem *aligned_assem, unsigned readCount, unsigned fragmentCount);
+void closeResBin(ResBin *src);
+ResBin * resBin_load(char *filename);
+void destroyResBin(ResBin *src);
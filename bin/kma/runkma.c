@@ -28,18 +28,25 @@
 #include "ankers.h"
 #include "assembly.h"
 #include "chain.h"
+#include "clust.h"
 #include "compdna.h"
 #include "ef.h"
 #include "filebuff.h"
+#include "fragbin.h"
 #include "frags.h"
 #include "hashmapindex.h"
+#include "nameindex.h"
+#include "indexcache.h"
 #include "kmapipe.h"
 #include "nw.h"
 #include "penalties.h"
 #include "pherror.h"
 #include "printconsensus.h"
 #include "qseqs.h"
+#include "resbin.h"
+#include "sam.h"
 #include "runkma.h"
+#include "seqz.h"
 #include "stdnuc.h"
 #include "stdstat.h"
 #include "updatescores.h"
@@ -59,16 +66,6 @@ typedef int key_t;
 #define nameSkip(infile, c) while((c = fgetc(infile)) != '\n' && c != EOF)
 
 
-unsigned char * ustrdup(unsigned char *src, size_t n) {
-	
-	unsigned char *dest;
-	
-	dest = smalloc(n);
-	memcpy(dest, src, n);
-	
-	return dest;
-}
-
 int load_DBs_KMA(char *templatefilename, long unsigned **alignment_scores, long unsigned **uniq_alignment_scores, int **template_lengths, unsigned shm) {
 	
 	/* load DBs needed for KMA */
@@ -132,28 +129,30 @@ char * nameLoad(Qseqs *name, FILE *infile) {
 	return (char *) name->seq;
 }
 
-int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, Penalties *rewards, int extendedFeatures, double ID_t, int mq, double scoreT, double evalue, int bcd, int ref_fsa, int print_matrix, int print_all, int vcf, unsigned shm, int thread_num) {
+int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, Penalties *rewards, int extendedFeatures, double ID_t, int mq, double scoreT, double evalue, int bcd, int ref_fsa, int print_matrix, int print_all, int print_bin, int vcf, long unsigned memBudget, unsigned shm, int thread_num) {
 	
 	int i, j, tmp_template, tmp_tmp_template, file_len, bestTemplate, tot;
 	int template, bestHits, t_len, start, end, aln_len, status, rand, sparse;
-	int fragCount, fileCount, maxFrag, coverScore, tmp_start, tmp_end, score;
-	int index_in_no, seq_in_no, DB_size, stats[4], *matched_templates;
+	int coverScore, tmp_start, tmp_end, score;
+	int index_in_no, seq_in_no, DB_size, size, stats[4], *matched_templates;
 	int *bestTemplates, *bestTemplates_r, *best_start_pos, *best_end_pos;
 	int *template_lengths;
 	unsigned randScore, *fragmentCounts, *readCounts;
 	long read_score, best_read_score, *index_indexes, *seq_indexes;
-	long unsigned Nhits, template_tot_ulen, bestNum;
-	long unsigned *w_scores, *uniq_alignment_scores, *alignment_scores;
+	long unsigned Nhits, template_tot_ulen, bestNum, seqWords;
+	long unsigned *w_scores, *uniq_alignment_scores, *alignment_scores, *name_offsets;
 	double tmp_score, bestScore, id, q_id, cover, q_cover, p_value;
 	long double depth, expected, q_value;
 	FILE *inputfile, *frag_in_raw, *index_in, *seq_in, *res_out, *name_file;
-	FILE *alignment_out, *consensus_out, *frag_out_raw, **template_fragments;
+	FILE *frag_out_raw;
 	FILE *extendedFeatures_out;
 	time_t t0, t1;
-	FileBuff *frag_out, *frag_out_all, *matrix_out, *vcf_out;
+	FileBuff *alignment_out, *consensus_out, *frag_out, *frag_out_all, *matrix_out, *vcf_out;
 	Aln *aligned, *gap_align;
 	Assem *aligned_assem;
-	Frag **alignFrags, *alignFrag;
+	ResBin *res_bin;
+	FragPool *fragPool;
+	FragIn *template_fragments;
 	CompDNA *qseq_comp, *qseq_r_comp;
 	Qseqs *qseq, *qseq_r, *header, *header_r, *template_name;
 	AssemInfo *matrix;
@@ -181,15 +180,37 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	if(!templates_index) {
 		ERROR();
 	}
+	if(indexCache) {
+		indexCache_setSize(indexCache, DB_size);
+	}
+	if(clustFlag) {
+		templateClust = clust_load(templatefilename, DB_size);
+	}
 	
 	/* load names */
 	template_name = setQseqs(256);
 	strcat(templatefilename, ".name");
 	name_file = sfopen(templatefilename, "rb");
 	templatefilename[file_len] = 0;
-	strcat(templatefilename, ".seq.b");
-	seq_in = sfopen(templatefilename, "rb");
-	seq_in_no = fileno(seq_in);
+	name_offsets = nameIndex_load(templatefilename, fileno(name_file), DB_size);
+	if(templateSeqZ && !(shm & 8)) {
+		/* decode template sequences on demand */
+		strcat(templatefilename, ".seq.b");
+		seq_in = sfopen(templatefilename, "rb");
+		templatefilename[file_len] = 0;
+		fseek(seq_in, 0, SEEK_END);
+		seqWords = ftell(seq_in) / sizeof(long unsigned);
+		fclose(seq_in);
+		strcat(templatefilename, ".seqz.b");
+		seq_in = sfopen(templatefilename, "rb");
+		seq_in_no = fileno(seq_in);
+		seqz_open(templateSeqZ, seq_in_no, seqWords);
+		seqReadPtr = &seqz_pread;
+	} else {
+		strcat(templatefilename, ".seq.b");
+		seq_in = sfopen(templatefilename, "rb");
+		seq_in_no = fileno(seq_in);
+	}
 	templatefilename[file_len] = 0;
 	
 	strcat(templatefilename, ".index.b");
@@ -197,6 +218,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	templatefilename[file_len] = 0;
 	if(!index_in) {
 		alignLoadPtr = &alignLoad_fly_build;
+		minimizerW = 0;
 		index_in = 0;
 		index_in_no = 0;
 		if(kmersize < 4 || 32 < kmersize) {
@@ -207,9 +229,12 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		*templates_index = alignLoad_shm_initial(templatefilename, file_len, seq_in_no, index_in_no, kmersize);
 		alignLoadPtr = &alignLoad_fly_shm;
 		destroyPtr = &alignClean_shm;
+		/* shared indexes are not ours to evict */
+		indexCache_destroy(indexCache);
+		indexCache = 0;
 	} else {
 		index_in_no = fileno(index_in);
-		read(index_in_no, &kmersize, sizeof(int));
+		kmersize = hashMap_index_loadHeader(index_in_no);
 	}
 	
 	/* allocate stuff */
@@ -222,7 +247,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	index_indexes[1] = sizeof(int);
 	seq_indexes[1] = 0;
 	for(i = 2; i < DB_size; ++i) {
-		index_indexes[i] = index_indexes[i - 1] + (template_lengths[i - 1] << 1) * sizeof(int);
+		index_indexes[i] = hashMap_index_next(index_in_no, index_indexes[i - 1], template_lengths[i - 1]);
 		seq_indexes[i] = seq_indexes[i - 1] + ((template_lengths[i - 1] >> 5) + 1) * sizeof(long unsigned);
 	}
 	
@@ -231,15 +256,31 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		strcat(outputfilename, ".res");
 		res_out = sfopen(outputfilename, "w");
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".frag.gz");
-		frag_out = gzInitFileBuff(CHUNK);
-		openFileBuff(frag_out, outputfilename, "wb");
+		if(print_bin) {
+			strcat(outputfilename, ".res.b");
+			res_bin = resBin_init(sfopen(outputfilename, "wb"), 1024);
+			outputfilename[file_len] = 0;
+		} else {
+			res_bin = 0;
+		}
+		if(updateFragsPtr == &updateFragsBin) {
+			strcat(outputfilename, ".frag.b");
+			frag_out = initOutFileBuff(CHUNK, 0);
+			openFileBuff(frag_out, outputfilename, "wb");
+			initFragBin(frag_out);
+		} else {
+			strcat(outputfilename, ".frag.gz");
+			frag_out = gzInitFileBuff(CHUNK);
+			openFileBuff(frag_out, outputfilename, "wb");
+		}
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".aln");
-		alignment_out = sfopen(outputfilename, "w");
+		strcat(outputfilename, alnGz ? ".aln.gz" : ".aln");
+		alignment_out = initOutFileBuff(CHUNK, alnGz);
+		openFileBuff(alignment_out, outputfilename, "wb");
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".fsa");
-		consensus_out = sfopen(outputfilename, "w");
+		strcat(outputfilename, alnGz ? ".fsa.gz" : ".fsa");
+		consensus_out = initOutFileBuff(CHUNK, alnGz);
+		openFileBuff(consensus_out, outputfilename, "wb");
 		outputfilename[file_len] = 0;
 		frag_out_raw = tmpfile();
 		if(!frag_out_raw) {
@@ -269,6 +310,14 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		} else {
 			vcf_out = 0;
 		}
+		if(samFlag) {
+			strcat(outputfilename, ".sam.gz");
+			samOut = samInit(outputfilename, samFlag == 2);
+			outputfilename[file_len] = 0;
+			for(i = 1; i < DB_size; ++i) {
+				samSQ(samOut, nameIndex_get(template_name, fileno(name_file), name_offsets, i), template_lengths[i]);
+			}
+		}
 	} else {
 		fprintf(stderr, " No output file specified!\n");
 		exit(2);
@@ -277,16 +326,17 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	fprintf(stderr, "# Running KMA.\n");
 	t0 = clock();
 	
-	/* allocate stuff */
+	/* allocate stuff, candidate buffers grow with the hits per read */
+	size = (DB_size < 512) ? ((DB_size + 1) << 1) : 1024;
 	i = 1;
 	alnThreads = 0;
 	while(i < thread_num) {
 		/* allocate stuff */
-		matched_templates = smalloc(((DB_size + 1) << 1) * sizeof(int));
-		bestTemplates = smalloc(((DB_size + 1) << 1) * sizeof(int));
-		bestTemplates_r = smalloc(((DB_size + 1) << 1) * sizeof(int));
-		best_start_pos = smalloc((DB_size << 1) * sizeof(int));
-		best_end_pos = smalloc((DB_size << 1) * sizeof(int));
+		matched_templates = smalloc(size * sizeof(int));
+		bestTemplates = smalloc(size * sizeof(int));
+		bestTemplates_r = smalloc(size * sizeof(int));
+		best_start_pos = smalloc(size * sizeof(int));
+		best_end_pos = smalloc(size * sizeof(int));
 		qseq_comp = smalloc(sizeof(CompDNA));
 		qseq_r_comp = smalloc(sizeof(CompDNA));
 		allocComp(qseq_comp, 1024);
@@ -310,6 +360,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		alnThread->bestTemplates_r = bestTemplates_r;
 		alnThread->best_start_pos = best_start_pos;
 		alnThread->best_end_pos = best_end_pos;
+		alnThread->size = size;
 		alnThread->alignment_scores = alignment_scores;
 		alnThread->uniq_alignment_scores = uniq_alignment_scores;
 		alnThread->index_indexes = index_indexes;
@@ -326,6 +377,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		alnThread->header_r = setQseqs(256);
 		alnThread->points = seedPoint_init(1024, rewards);
 		alnThread->NWmatrices = NWmatrices;
+		alnThread->clustAln = templateClust ? clustAln_init(1024) : 0;
 		alnThread->kmersize = kmersize;
 		alnThread->template_lengths = template_lengths;
 		alnThread->templates_index = templates_index;
@@ -349,11 +401,11 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	}
 	
 	/* allocate stuff */
-	matched_templates = smalloc(((DB_size + 1) << 1) * sizeof(int));
-	bestTemplates = smalloc(((DB_size + 1) << 1) * sizeof(int));
-	bestTemplates_r = smalloc(((DB_size + 1) << 1) * sizeof(int));
-	best_start_pos = smalloc((DB_size << 1) * sizeof(int));
-	best_end_pos = smalloc((DB_size << 1) * sizeof(int));
+	matched_templates = smalloc(size * sizeof(int));
+	bestTemplates = smalloc(size * sizeof(int));
+	bestTemplates_r = smalloc(size * sizeof(int));
+	best_start_pos = smalloc(size * sizeof(int));
+	best_end_pos = smalloc(size * sizeof(int));
 	qseq = setQseqs(1024);
 	qseq_r = setQseqs(1024);
 	header = setQseqs(256);
@@ -382,6 +434,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	alnThread->bestTemplates_r = bestTemplates_r;
 	alnThread->best_start_pos = best_start_pos;
 	alnThread->best_end_pos = best_end_pos;
+	alnThread->size = size;
 	alnThread->alignment_scores = alignment_scores;
 	alnThread->uniq_alignment_scores = uniq_alignment_scores;
 	alnThread->index_indexes = index_indexes;
@@ -398,6 +451,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	alnThread->header_r = header_r;
 	alnThread->points = points;
 	alnThread->NWmatrices = NWmatrices;
+	alnThread->clustAln = templateClust ? clustAln_init(1024) : 0;
 	alnThread->kmersize = kmersize;
 	alnThread->mq = mq;
 	alnThread->scoreT = scoreT;
@@ -407,6 +461,13 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	
 	/* Get alignments */
 	alnFrags_threaded(alnThread);
+	matched_templates = alnThread->matched_templates;
+	bestTemplates = alnThread->bestTemplates;
+	bestTemplates_r = alnThread->bestTemplates_r;
+	best_start_pos = alnThread->best_start_pos;
+	best_end_pos = alnThread->best_end_pos;
+	size = alnThread->size;
+	clustAln_destroy(alnThread->clustAln);
 	free(alnThread);
 	
 	/* join threads */
@@ -473,6 +534,17 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 			qseq->seq = smalloc(qseq->size);
 		}
 		
+		/* check candidate buffers */
+		if(size < alnThread->size) {
+			size = alnThread->size;
+			free(bestTemplates);
+			free(best_start_pos);
+			free(best_end_pos);
+			bestTemplates = smalloc(size * sizeof(int));
+			best_start_pos = smalloc(size * sizeof(int));
+			best_end_pos = smalloc(size * sizeof(int));
+		}
+		
 		/* free the rest */
 		free(alnThread->matched_templates);
 		free(alnThread->bestTemplates);
@@ -485,6 +557,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		free(alnThread->qseq_r_comp);
 		destroyQseqs(alnThread->qseq_r);
 		destroyQseqs(alnThread->header_r);
+		clustAln_destroy(alnThread->clustAln);
 		free(alnThread);
 	}
 	
@@ -495,25 +568,18 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	
 	/* Get best template for each mapped read
 	Best hit chosen as: highest mapping score then higest # unique maps */
-	alignFrags = calloc(DB_size, sizeof(Frag*));
 	w_scores = calloc(DB_size, sizeof(long unsigned));
-	if(!alignFrags || !w_scores) {
+	if(!w_scores) {
 		ERROR();
 	}
 	outputfilename[file_len] = 0;
 	frag_in_raw = frag_out_raw;
 	rewind(frag_in_raw);
 	outputfilename[file_len] = 0;
-	template_fragments = calloc(DB_size, sizeof(FILE*));
-	if(!template_fragments) {
-		ERROR();
-	}
-	fragCount = 0;
-	fileCount = 0;
-	maxFrag = 1000000;
+	fragPool = setFragPool(memBudget, DB_size);
 	
 	/* Patricks features */
-	if(extendedFeatures) {
+	if(extendedFeatures || print_bin) {
 		fragmentCounts = calloc(DB_size, sizeof(unsigned));
 		readCounts = calloc(DB_size, sizeof(unsigned));
 		if(!fragmentCounts || !readCounts) {
@@ -613,30 +679,20 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 			if(bestTemplate < 0) {
 				bestTemplate = -bestTemplate;
 				strrc(qseq->seq, qseq->len);
+				/* negative bestHits marks the read as reversed */
+				bestHits = -bestHits;
 			}
 			w_scores[bestTemplate] += read_score;
-			if(extendedFeatures) {
+			if(fragmentCounts) {
 				fragmentCounts[bestTemplate]++;
 				readCounts[bestTemplate]++;
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
-			alignFrag->buffer[0] = qseq->len;
-			alignFrag->buffer[1] = bestHits;
-			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-			alignFrag->buffer[3] = start;
-			alignFrag->buffer[4] = end;
-			alignFrag->buffer[5] = header->len;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
-			alignFrag->next = alignFrags[bestTemplate];
-			alignFrags[bestTemplate] = alignFrag;
-			
-			++fragCount;
+			pushFrag(fragPool, bestTemplate, qseq, header, bestHits, (sparse < 0) ? 0 : read_score, start, end);
 			
 			if(stats[2] < 0) {
-				if(extendedFeatures) {
+				if(readCounts) {
 					readCounts[bestTemplate]++;
 				}
 				fread(stats, sizeof(int), 2, frag_in_raw);
@@ -644,37 +700,10 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 				header->len = stats[1];
 				fread(qseq->seq, 1, qseq->len, frag_in_raw);
 				fread(header->seq, 1, header->len, frag_in_raw);
-				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
-				alignFrag->buffer[0] = qseq->len;
-				alignFrag->buffer[1] = bestHits;
-				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-				alignFrag->buffer[3] = start;
-				alignFrag->buffer[4] = end;
-				alignFrag->buffer[5] = header->len;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
-				alignFrag->next = alignFrags[bestTemplate];
-				alignFrags[bestTemplate] = alignFrag;
-				
-				++fragCount;
-			}
-			
-			if(fragCount >= maxFrag) {
-				template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-				++fileCount;
-				fragCount = 0;
-				/* control fileamount */
-				if(fileCount >= DB_size) {
-					template_fragments = realloc(template_fragments, (fileCount + 1) * sizeof(FILE*));
-					if(!template_fragments) {
-						ERROR();
-					}
-				}
+				/* dump frag info, the mate is stored reverse complemented */
+				pushFrag(fragPool, bestTemplate, qseq, header, -abs(bestHits), (sparse < 0) ? 0 : read_score, start, end);
 			}
 		}
-		template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-		++fileCount;
 	} else if(ConClave == 2) {
 		/* find potential template candidates */
 		while(fread(stats, sizeof(int), 4, frag_in_raw) && stats[0] != 0) {
@@ -840,13 +869,19 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 				}
 				
 				if(tot && 16 <= qseq->len) {
-					/* get seed */
+					/* get seed, on the strand of the first hit */
+					if(*bestTemplates < 0) {
+						strrc(qseq->seq, qseq->len);
+					}
 					rand = qseq->seq[0];
 					i = -1;
 					j = qseq->len;
 					while(++i < 7) {
 						rand = (((rand << 2) | qseq->seq[i]) << 2) | qseq->seq[--j];
 					}
+					if(*bestTemplates < 0) {
+						strrc(qseq->seq, qseq->len);
+					}
 					/* minimal standard */
 					rand = 16807 * (rand % 127773) - 2836 * (rand / 127773);
 					if (rand <= 0) {
@@ -942,30 +977,20 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 			if(bestTemplate < 0) {
 				bestTemplate = -bestTemplate;
 				strrc(qseq->seq, qseq->len);
+				/* negative bestHits marks the read as reversed */
+				bestHits = -bestHits;
 			}
 			w_scores[bestTemplate] += read_score;
-			if(extendedFeatures) {
+			if(fragmentCounts) {
 				fragmentCounts[bestTemplate]++;
 				readCounts[bestTemplate]++;
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
-			alignFrag->buffer[0] = qseq->len;
-			alignFrag->buffer[1] = bestHits;
-			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-			alignFrag->buffer[3] = start;
-			alignFrag->buffer[4] = end;
-			alignFrag->buffer[5] = header->len;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
-			alignFrag->next = alignFrags[bestTemplate];
-			alignFrags[bestTemplate] = alignFrag;
-			
-			++fragCount;
+			pushFrag(fragPool, bestTemplate, qseq, header, bestHits, (sparse < 0) ? 0 : read_score, start, end);
 			
 			if(stats[2] < 0) {
-				if(extendedFeatures) {
+				if(readCounts) {
 					readCounts[bestTemplate]++;
 				}
 				fread(stats, sizeof(int), 2, frag_in_raw);
@@ -973,41 +998,13 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 				header->len = stats[1];
 				fread(qseq->seq, 1, qseq->len, frag_in_raw);
 				fread(header->seq, 1, header->len, frag_in_raw);
-				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
-				alignFrag->buffer[0] = qseq->len;
-				alignFrag->buffer[1] = bestHits;
-				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-				alignFrag->buffer[3] = start;
-				alignFrag->buffer[4] = end;
-				alignFrag->buffer[5] = header->len;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
-				alignFrag->next = alignFrags[bestTemplate];
-				alignFrags[bestTemplate] = alignFrag;
-				
-				++fragCount;
-			}
-			
-			if(fragCount >= maxFrag) {
-				template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-				++fileCount;
-				fragCount = 0;
-				/* control fileamount */
-				if(fileCount >= DB_size) {
-					template_fragments = realloc(template_fragments, (fileCount + 1) * sizeof(FILE*));
-					if(!template_fragments) {
-						ERROR();
-					}
-				}
+				/* dump frag info, the mate is stored reverse complemented */
+				pushFrag(fragPool, bestTemplate, qseq, header, -abs(bestHits), (sparse < 0) ? 0 : read_score, start, end);
 			}
 		}
-		template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-		++fileCount;
 	}
 	
-	fragCount = 0;
-	free(alignFrags);
+	template_fragments = closeFragPool(fragPool);
 	free(best_start_pos);
 	free(best_end_pos);
 	free(matched_templates);
@@ -1081,8 +1078,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		gap_align->q = smalloc((qseq->size + 1) << 1);
 		thread->aligned = aligned;
 		thread->gap_align = gap_align;
-		thread->file_count = fileCount;
-		thread->files = template_fragments;
+		thread->frags = template_fragments;
 		thread->aligned_assem = aligned_assem;
 		thread->matrix = matrix;
 		thread->spin = (sparse < 0) ? 10 : 100;
@@ -1113,8 +1109,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	thread->scoreT = scoreT;
 	thread->evalue = evalue;
 	thread->bcd = bcd;
-	thread->file_count = fileCount;
-	thread->files = template_fragments;
+	thread->frags = template_fragments;
 	thread->frag_out = frag_out;
 	thread->aligned_assem = aligned_assem;
 	thread->aligned = aligned;
@@ -1150,8 +1145,8 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 			}
 			p_value  = p_chisqr(q_value);
 			if(cmp((p_value <= evalue && read_score > expected), (read_score >= scoreT * t_len))) {
-				thread->template_name = nameLoad(template_name, name_file);
-				thread->template_index = templates_index[template];
+				thread->template_name = nameIndex_get(template_name, fileno(name_file), name_offsets, template);
+				thread->template_index = alnFragsLoad(templates_index, template, template_lengths, kmersize, seq_in_no, index_in_no, seq_indexes, index_indexes);
 				/* Do assembly */
 				//status |= assemblyPtr(aligned_assem, template, template_fragments, fileCount, frag_out, aligned, gap_align, qseq, header, matrix, points, NWmatrices);
 				thread->template = template;
@@ -1175,6 +1170,9 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 					/* Output result */
 					fprintf(res_out, "%-12s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n",
 						thread->template_name, read_score, (unsigned) expected, t_len, id, cover, q_id, q_cover, (double) depth, (double) q_value, p_value);
+					if(res_bin) {
+						resBin_add(res_bin, template, thread->template_name, read_score, expected, t_len, q_value, p_value, aligned_assem, readCounts[template], fragmentCounts[template]);
+					}
 					printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
 					/* print matrix */
 					if(matrix_out) {
@@ -1187,11 +1185,8 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 						updateVcf(thread->template_name, templates_index[template]->seq, evalue, t_len, matrix, vcf, vcf_out);
 					}
 				}
-			} else {
-				nameSkip(name_file, end);
+				alnFragsRelease(template);
 			}
-		} else {
-			nameSkip(name_file, end);
 		}
 	}
 	/* join threads */
@@ -1205,15 +1200,28 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	}
 	
 	/* Close files */
+	destroyFragIn(template_fragments);
+	if(res_bin) {
+		closeResBin(res_bin);
+	}
 	if(index_in) {
 		fclose(index_in);
 	}
+	if(indexCache) {
+		fprintf(stderr, "# Template index cache:\t%lu hits, %lu misses, %lu evictions.\n", indexCache->hits, indexCache->misses, indexCache->evictions);
+		indexCache_destroy(indexCache);
+		indexCache = 0;
+	}
 	fclose(seq_in);
+	seqz_destroy(templateSeqZ);
+	templateSeqZ = 0;
+	seqReadPtr = &pread;
 	fclose(res_out);
-	fclose(alignment_out);
-	fclose(consensus_out);
+	destroyOutFileBuff(alignment_out);
+	destroyOutFileBuff(consensus_out);
 	fclose(name_file);
-	destroyGzFileBuff(frag_out);
+	free(name_offsets);
+	destroyOutFileBuff(frag_out);
 	if(matrix_out) {
 		destroyGzFileBuff(matrix_out);
 	}
@@ -1223,6 +1231,10 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	if(vcf) {
 		destroyGzFileBuff(vcf_out);
 	}
+	if(samOut) {
+		samDestroy(samOut);
+		samOut = 0;
+	}
 	
 	t1 = clock();
 	fprintf(stderr, "# Total time used for local assembly: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
@@ -1230,32 +1242,34 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	return status;
 }
 
-int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, Penalties *rewards, int extendedFeatures, double ID_t, int mq, double scoreT, double evalue, int bcd, int ref_fsa, int print_matrix, int print_all, int vcf, unsigned shm, int thread_num) {
+int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, Penalties *rewards, int extendedFeatures, double ID_t, int mq, double scoreT, double evalue, int bcd, int ref_fsa, int print_matrix, int print_all, int print_bin, int vcf, long unsigned memBudget, unsigned shm, int thread_num) {
 	
 	/* runKMA_MEM is a memory saving version of runKMA,
 	   at the cost it chooses best templates based on kmers
 	   instead of alignment score. */
 	
 	int i, j, tmp_template, tmp_tmp_template, file_len, score, rand, sparse;
-	int template, bestHits, t_len, start, end, aln_len, fragCount, maxFrag;
-	int fileCount, coverScore, tmp_start, tmp_end, bestTemplate, status, tot;
-	int rc_flag, progress, seq_in_no, index_in_no, DB_size, delta, stats[4];
+	int template, bestHits, t_len, start, end, aln_len;
+	int coverScore, tmp_start, tmp_end, bestTemplate, status, tot;
+	int rc_flag, progress, seq_in_no, index_in_no, DB_size, size, delta, stats[4];
 	int *matched_templates, *bestTemplates, *best_start_pos, *best_end_pos;
 	int *template_lengths;
 	unsigned randScore, *fragmentCounts, *readCounts;
 	long best_read_score, read_score, seq_seeker, index_seeker;
 	long unsigned Nhits, template_tot_ulen, bestNum, counter;
-	long unsigned *w_scores, *uniq_alignment_scores, *alignment_scores;
+	long unsigned *w_scores, *uniq_alignment_scores, *alignment_scores, *name_offsets;
 	double tmp_score, bestScore, id, cover, q_id, q_cover, p_value;
 	long double depth, q_value, expected;
 	FILE *inputfile, *frag_in_raw, *index_in, *seq_in, *res_out, *name_file;
-	FILE *alignment_out, *consensus_out, *frag_out_raw, **template_fragments;
+	FILE *frag_out_raw;
 	FILE *extendedFeatures_out;
 	time_t t0, t1;
-	FileBuff *frag_out, *frag_out_all, *matrix_out, *vcf_out;
+	FileBuff *alignment_out, *consensus_out, *frag_out, *frag_out_all, *matrix_out, *vcf_out;
 	Aln *aligned, *gap_align;
 	Assem *aligned_assem;
-	Frag **alignFrags, *alignFrag;
+	ResBin *res_bin;
+	FragPool *fragPool;
+	FragIn *template_fragments;
 	CompDNA *qseq_comp, *qseq_r_comp;
 	Qseqs *qseq, *qseq_r, *header, *header_r, *template_name;
 	AssemInfo *matrix;
@@ -1282,9 +1296,10 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	templatefilename[file_len] = 0;
 	if(index_in) {
 		index_in_no = fileno(index_in);
-		read(index_in_no, &kmersize, sizeof(int));
+		kmersize = hashMap_index_loadHeader(index_in_no);
 	} else {
 		alignLoadPtr = &alignLoad_fly_build_mem;
+		minimizerW = 0;
 		index_in = 0;
 		index_in_no = 0;
 		if(kmersize < 4 || 32 < kmersize) {
@@ -1300,6 +1315,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	strcat(templatefilename, ".name");
 	name_file = sfopen(templatefilename, "rb");
 	templatefilename[file_len] = 0;
+	name_offsets = nameIndex_load(templatefilename, fileno(name_file), DB_size);
 	
 	/* allocate stuff */
 	file_len = strlen(outputfilename);
@@ -1323,15 +1339,31 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		strcat(outputfilename, ".res");
 		res_out = sfopen(outputfilename, "w");
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".frag.gz");
-		frag_out = gzInitFileBuff(CHUNK);
-		openFileBuff(frag_out, outputfilename, "wb");
+		if(print_bin) {
+			strcat(outputfilename, ".res.b");
+			res_bin = resBin_init(sfopen(outputfilename, "wb"), 1024);
+			outputfilename[file_len] = 0;
+		} else {
+			res_bin = 0;
+		}
+		if(updateFragsPtr == &updateFragsBin) {
+			strcat(outputfilename, ".frag.b");
+			frag_out = initOutFileBuff(CHUNK, 0);
+			openFileBuff(frag_out, outputfilename, "wb");
+			initFragBin(frag_out);
+		} else {
+			strcat(outputfilename, ".frag.gz");
+			frag_out = gzInitFileBuff(CHUNK);
+			openFileBuff(frag_out, outputfilename, "wb");
+		}
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".aln");
-		alignment_out = sfopen(outputfilename, "w");
+		strcat(outputfilename, alnGz ? ".aln.gz" : ".aln");
+		alignment_out = initOutFileBuff(CHUNK, alnGz);
+		openFileBuff(alignment_out, outputfilename, "wb");
 		outputfilename[file_len] = 0;
-		strcat(outputfilename, ".fsa");
-		consensus_out = sfopen(outputfilename, "w");
+		strcat(outputfilename, alnGz ? ".fsa.gz" : ".fsa");
+		consensus_out = initOutFileBuff(CHUNK, alnGz);
+		openFileBuff(consensus_out, outputfilename, "wb");
 		outputfilename[file_len] = 0;
 		frag_out_raw = tmpfile();
 		if(!frag_out_raw) {
@@ -1361,6 +1393,14 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		} else {
 			vcf_out = 0;
 		}
+		if(samFlag) {
+			strcat(outputfilename, ".sam.gz");
+			samOut = samInit(outputfilename, samFlag == 2);
+			outputfilename[file_len] = 0;
+			for(i = 1; i < DB_size; ++i) {
+				samSQ(samOut, nameIndex_get(template_name, fileno(name_file), name_offsets, i), template_lengths[i]);
+			}
+		}
 	} else {
 		fprintf(stderr, " No output file specified!\n");
 		exit(2);
@@ -1370,7 +1410,8 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	t0 = clock();
 	
 	/* Get alignments */
-	matched_templates = malloc(((DB_size + 1) << 1) * sizeof(int));
+	size = (DB_size + 1) << 1;
+	matched_templates = malloc(size * sizeof(int));
 	best_start_pos = calloc((DB_size << 1), sizeof(int));
 	best_end_pos = malloc((DB_size << 1) * sizeof(int));
 	if(!matched_templates || !best_start_pos || !best_end_pos) {
@@ -1381,11 +1422,11 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	/* consider printPair */
 	t_len = 0;
 	read_score = 0;
-	while((rc_flag = get_ankers(matched_templates, qseq_comp, header, inputfile)) != 0) {
+	while((rc_flag = get_ankers(&matched_templates, &size, qseq_comp, header, inputfile)) != 0) {
 		if(*matched_templates) { // SE
 			read_score = 0;
 		} else { // PE
-			read_score = get_ankers(matched_templates, qseq_r_comp, header_r, inputfile);
+			read_score = get_ankers(&matched_templates, &size, qseq_r_comp, header_r, inputfile);
 			read_score = labs(read_score);
 			qseq_r->len = qseq_r_comp->seqlen;
 		}
@@ -1469,24 +1510,17 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	
 	/* Get best template for each mapped deltamer/read */
 	/* Best hit chosen as: highest mapping score then higest # unique maps */
-	alignFrags = calloc(DB_size, sizeof(Frag*));
 	w_scores = calloc(DB_size, sizeof(long unsigned));
-	if(!alignFrags || !w_scores) {
+	if(!w_scores) {
 		ERROR();
 	}
 	outputfilename[file_len] = 0;
 	frag_in_raw = frag_out_raw;
 	rewind(frag_in_raw);
-	template_fragments = calloc(DB_size, sizeof(FILE*));
-	if(!template_fragments) {
-		ERROR();
-	}
-	fragCount = 0;
-	fileCount = 0;
-	maxFrag = 1000000;
+	fragPool = setFragPool(memBudget, DB_size);
 	
 	/* Patricks features */
-	if(extendedFeatures) {
+	if(extendedFeatures || print_bin) {
 		fragmentCounts = calloc(DB_size, sizeof(unsigned));
 		readCounts = calloc(DB_size, sizeof(unsigned));
 		if(!fragmentCounts || !readCounts) {
@@ -1586,30 +1620,20 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 			if(bestTemplate < 0) {
 				bestTemplate = -bestTemplate;
 				strrc(qseq->seq, qseq->len);
+				/* negative bestHits marks the read as reversed */
+				bestHits = -bestHits;
 			}
 			w_scores[bestTemplate] += read_score;
-			if(extendedFeatures) {
+			if(fragmentCounts) {
 				fragmentCounts[bestTemplate]++;
 				readCounts[bestTemplate]++;
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
-			alignFrag->buffer[0] = qseq->len;
-			alignFrag->buffer[1] = bestHits;
-			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-			alignFrag->buffer[3] = start;
-			alignFrag->buffer[4] = end;
-			alignFrag->buffer[5] = header->len;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
-			alignFrag->next = alignFrags[bestTemplate];
-			alignFrags[bestTemplate] = alignFrag;
-			
-			++fragCount;
+			pushFrag(fragPool, bestTemplate, qseq, header, bestHits, (sparse < 0) ? 0 : read_score, start, end);
 			
 			if(stats[2] < 0) {
-				if(extendedFeatures) {
+				if(readCounts) {
 					readCounts[bestTemplate]++;
 				}
 				fread(stats, sizeof(int), 2, frag_in_raw);
@@ -1617,37 +1641,10 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				header->len = stats[1];
 				fread(qseq->seq, 1, qseq->len, frag_in_raw);
 				fread(header->seq, 1, header->len, frag_in_raw);
-				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
-				alignFrag->buffer[0] = qseq->len;
-				alignFrag->buffer[1] = bestHits;
-				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-				alignFrag->buffer[3] = start;
-				alignFrag->buffer[4] = end;
-				alignFrag->buffer[5] = header->len;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
-				alignFrag->next = alignFrags[bestTemplate];
-				alignFrags[bestTemplate] = alignFrag;
-				
-				++fragCount;
-			}
-			
-			if(fragCount >= maxFrag) {
-				template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-				++fileCount;
-				fragCount = 0;
-				/* control fileamount */
-				if(fileCount >= DB_size) {
-					template_fragments = realloc(template_fragments, (fileCount + 1) * sizeof(FILE*));
-					if(!template_fragments) {
-						ERROR();
-					}
-				}
+				/* dump frag info, the mate is stored reverse complemented */
+				pushFrag(fragPool, bestTemplate, qseq, header, -abs(bestHits), (sparse < 0) ? 0 : read_score, start, end);
 			}
 		}
-		template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-		++fileCount;
 	} else if(ConClave == 2) {
 		/* find potential template candidates */
 		while(fread(stats, sizeof(int), 4, frag_in_raw) && stats[0] != 0) {
@@ -1815,13 +1812,19 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				}
 				
 				if(tot && 16 <= qseq->len) {
-					/* get seed */
+					/* get seed, on the strand of the first hit */
+					if(*bestTemplates < 0) {
+						strrc(qseq->seq, qseq->len);
+					}
 					rand = qseq->seq[0];
 					i = -1;
 					j = qseq->len;
 					while(++i < 7) {
 						rand = (((rand << 2) | qseq->seq[i]) << 2) | qseq->seq[--j];
 					}
+					if(*bestTemplates < 0) {
+						strrc(qseq->seq, qseq->len);
+					}
 					/* minimal standard */
 					rand = 16807 * (rand % 127773) - 2836 * (rand / 127773);
 					if (rand <= 0) {
@@ -1917,30 +1920,20 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 			if(bestTemplate < 0) {
 				bestTemplate = -bestTemplate;
 				strrc(qseq->seq, qseq->len);
+				/* negative bestHits marks the read as reversed */
+				bestHits = -bestHits;
 			}
 			w_scores[bestTemplate] += read_score;
-			if(extendedFeatures) {
+			if(fragmentCounts) {
 				fragmentCounts[bestTemplate]++;
 				readCounts[bestTemplate]++;
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
-			alignFrag->buffer[0] = qseq->len;
-			alignFrag->buffer[1] = bestHits;
-			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-			alignFrag->buffer[3] = start;
-			alignFrag->buffer[4] = end;
-			alignFrag->buffer[5] = header->len;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
-			alignFrag->next = alignFrags[bestTemplate];
-			alignFrags[bestTemplate] = alignFrag;
-			
-			++fragCount;
+			pushFrag(fragPool, bestTemplate, qseq, header, bestHits, (sparse < 0) ? 0 : read_score, start, end);
 			
 			if(stats[2] < 0) {
-				if(extendedFeatures) {
+				if(readCounts) {
 					readCounts[bestTemplate]++;
 				}
 				fread(stats, sizeof(int), 2, frag_in_raw);
@@ -1948,42 +1941,14 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				header->len = stats[1];
 				fread(qseq->seq, 1, qseq->len, frag_in_raw);
 				fread(header->seq, 1, header->len, frag_in_raw);
-				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
-				alignFrag->buffer[0] = qseq->len;
-				alignFrag->buffer[1] = bestHits;
-				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-				alignFrag->buffer[3] = start;
-				alignFrag->buffer[4] = end;
-				alignFrag->buffer[5] = header->len;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
-				alignFrag->next = alignFrags[bestTemplate];
-				alignFrags[bestTemplate] = alignFrag;
-				
-				++fragCount;
-			}
-			
-			if(fragCount >= maxFrag) {
-				template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-				++fileCount;
-				fragCount = 0;
-				/* control fileamount */
-				if(fileCount >= DB_size) {
-					template_fragments = realloc(template_fragments, (fileCount + 1) * sizeof(FILE*));
-					if(!template_fragments) {
-						ERROR();
-					}
-				}
+				/* dump frag info, the mate is stored reverse complemented */
+				pushFrag(fragPool, bestTemplate, qseq, header, -abs(bestHits), (sparse < 0) ? 0 : read_score, start, end);
 			}
 			
 		}
-		template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-		++fileCount;
 	}
 	
-	fragCount = 0;
-	free(alignFrags);
+	template_fragments = closeFragPool(fragPool);
 	free(best_start_pos);
 	free(best_end_pos);
 	free(matched_templates);
@@ -2068,8 +2033,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		thread->evalue = evalue;
 		thread->bcd = bcd;
 		thread->template = -2;
-		thread->file_count = fileCount;
-		thread->files = template_fragments;
+		thread->frags = template_fragments;
 		thread->frag_out = frag_out;
 		thread->aligned_assem = aligned_assem;
 		thread->aligned = aligned;
@@ -2126,8 +2090,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	thread->evalue = evalue;
 	thread->bcd = bcd;
 	thread->template = 0;
-	thread->file_count = fileCount;
-	thread->files = template_fragments;
+	thread->frags = template_fragments;
 	thread->frag_out = frag_out;
 	thread->aligned_assem = aligned_assem;
 	thread->aligned = aligned;
@@ -2190,7 +2153,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				lseek(seq_in_no, seq_seeker, SEEK_CUR);
 				seq_seeker = 0;
 				thread->template_index = alignLoadPtr(thread->template_index, seq_in_no, index_in_no, template_lengths[template], kmersize, 0, 0);
-				thread->template_name = nameLoad(template_name, name_file);
+				thread->template_name = nameIndex_get(template_name, fileno(name_file), name_offsets, template);
 				
 				/* Do assembly */
 				//status |= assemblyPtr(aligned_assem, template, template_fragments, fileCount, frag_out, aligned, gap_align, qseq, header, matrix, points, NWmatrices);
@@ -2215,6 +2178,9 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 					/* Output result */
 					fprintf(res_out, "%-12s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n",
 						thread->template_name, read_score, (unsigned) expected, t_len, id, cover, q_id, q_cover, (double) depth, (double) q_value, p_value);
+					if(res_bin) {
+						resBin_add(res_bin, template, thread->template_name, read_score, expected, t_len, q_value, p_value, aligned_assem, readCounts[template], fragmentCounts[template]);
+					}
 					printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
 					/* print matrix */
 					if(matrix_out) {
@@ -2230,16 +2196,14 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				/* destroy this DB index */
 				destroyPtr(thread->template_index);
 			} else {
-				nameSkip(name_file, end);
 				if(index_in) {
-					index_seeker += (template_lengths[template] << 1);
+					index_seeker = hashMap_index_skip(index_in_no, index_seeker, template_lengths[template]);
 				}
 				seq_seeker += ((template_lengths[template] >> 5) + 1);
 			}
 		} else {
-			nameSkip(name_file, end);
 			if(index_in) {
-				index_seeker += (template_lengths[template] << 1);
+				index_seeker = hashMap_index_skip(index_in_no, index_seeker, template_lengths[template]);
 			}
 			seq_seeker += ((template_lengths[template] >> 5) + 1);
 		}
@@ -2260,15 +2224,20 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	/* Close files */
+	destroyFragIn(template_fragments);
+	if(res_bin) {
+		closeResBin(res_bin);
+	}
 	if(index_in) {
 		fclose(index_in);
 	}
 	fclose(seq_in);
 	fclose(res_out);
-	fclose(alignment_out);
-	fclose(consensus_out);
+	destroyOutFileBuff(alignment_out);
+	destroyOutFileBuff(consensus_out);
 	fclose(name_file);
-	destroyGzFileBuff(frag_out);
+	free(name_offsets);
+	destroyOutFileBuff(frag_out);
 	if(matrix_out) {
 		destroyGzFileBuff(matrix_out);
 	}
@@ -2278,6 +2247,10 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	if(vcf) {
 		destroyGzFileBuff(vcf_out);
 	}
+	if(samOut) {
+		samDestroy(samOut);
+		samOut = 0;
+	}
 	
 	t1 = clock();
 	fprintf(stderr, "# Total time used for local assembly: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
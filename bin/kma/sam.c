@@ -17,116 +17,300 @@
  * limitations under the License.
 */
 
+#define _XOPEN_SOURCE 600
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "filebuff.h"
 #include "nw.h"
 #include "pherror.h"
 #include "qseqs.h"
-#include "runkma.h"
+#include "sam.h"
 
-int makeCigar(Qseqs *Cigar, const Aln *aligned) {
+int samFlag = 0;
+SamBuff *samOut = 0;
+
+static int cmpSamRec(const void *a, const void *b) {
 	
-	int len, cLen, rep, consume;
-	char op, pop, *s, *cigar;
-	unsigned char *t, *q;
+	const SamRec *A = a, *B = b;
 	
-	if(Cigar->size < aligned->len << 1) {
-		Cigar->size <<= 1;
-		free(Cigar->seq);
-		Cigar->seq = smalloc(Cigar->size);
-	} else if(aligned->len == 0) {
-		return 0;
+	if(A->pos != B->pos) {
+		return A->pos < B->pos ? -1 : 1;
 	}
+	return A->offset < B->offset ? -1 : (A->offset != B->offset);
+}
+
+static void samPut(FileBuff *dest, const char *src, int len) {
 	
-	len = aligned->len + 1;
-	t = aligned->t;
-	s = aligned->s;
-	q = aligned->q;
-	cigar = (char *) Cigar->seq;
-	
-	cLen = 0;
-	rep = 1;
-	if(*s == '|') {
-		pop = '=';
-	} else if(*t == '-') {
-		pop = 'I';
-	} else if(*q == '-') {
-		pop = 'D';
+	/* flush buffer */
+	if(dest->bytes < len) {
+		writeGzFileBuff(dest);
+		
+		/* record is too big, reallocate buffer */
+		if(dest->bytes < len) {
+			resetGzFileBuff(dest, len << 1);
+		}
+	}
+	memcpy(dest->next, src, len);
+	dest->next += len;
+	dest->bytes -= len;
+}
+
+static char * samReserve(SamBuff *src, int size) {
+	
+	if(src->size < src->len + size) {
+		src->size = (src->len + size) << 1;
+		src->buffer = realloc(src->buffer, src->size);
+		if(!src->buffer) {
+			ERROR();
+		}
+	}
+	
+	return src->buffer + src->len;
+}
+
+static char samOp(unsigned char t, unsigned char q) {
+	
+	if(t == 5) {
+		return 'I';
+	} else if(q == 5) {
+		return 'D';
+	}
+	return 'M';
+}
+
+SamBuff * samInit(char *filename, int sort) {
+	
+	SamBuff *dest;
+	
+	dest = smalloc(sizeof(SamBuff));
+	dest->len = 0;
+	dest->size = CHUNK;
+	dest->buffer = smalloc(CHUNK);
+	dest->n = 0;
+	if(sort) {
+		dest->recSize = 1024;
+		dest->recs = smalloc(dest->recSize * sizeof(SamRec));
 	} else {
-		pop = 'X';
+		dest->recSize = 0;
+		dest->recs = 0;
 	}
-	if(pop != 'I') {
-		consume = 1;
+	dest->dest = gzInitFileBuff(CHUNK);
+	openFileBuff(dest->dest, filename, "wb");
+	
+	/* templates are assembled in the order of the @SQ lines */
+	if(sort) {
+		samPut(dest->dest, "@HD\tVN:1.6\tSO:coordinate\n", 25);
 	} else {
-		consume = -1;
-	}
-	while(--len) {
-		if(*s == '|') {
-			op = '=';
-		} else if(*t == '-') {
-			op = 'I';
-		} else if(*q == '-') {
-			op = 'D';
-		} else {
-			op = 'X';
-		}
-		if(0 < consume) {
-			--consume;
-			if(op != 'I') {
-				consume = -consume;
-			}
-		}
-		if(op == pop) {
-			++rep;
-		} else {
-			cLen += sprintf(cigar + cLen, "%d%c", rep, pop);
-			rep = 1;
-		}
+		samPut(dest->dest, "@HD\tVN:1.6\tSO:unsorted\n", 23);
 	}
-	Cigar->len = cLen + sprintf(cigar + cLen, "%d%c", rep, pop);
-	consume = consume < 0 ? 0 : consume;
 	
-	return consume;
+	return dest;
 }
 
-void saminit(Qseqs *template_name, FILE *name_file, int *template_lengths, int DB_size) {
+static int samName(char *dest, const char *name) {
+	
+	int c;
+	char *update;
 	
-	while(--DB_size) {
-		fprintf(stdout, "@SQ\tSN:%s\tLN:%d\n", nameLoad(template_name, name_file), *++template_lengths);
+	/* name up to the first white space, with characters SAM forbids in RNAME replaced */
+	update = dest;
+	while((c = *((const unsigned char *) name)) && !isspace(c)) {
+		if(c < '!' || '~' < c || strchr("\\,\"'`()[]{}<>", c) || (update == dest && (c == '*' || c == '='))) {
+			c = '_';
+		}
+		*update++ = c;
+		++name;
+	}
+	if(update == dest) {
+		*update++ = '_';
 	}
-	fseek(name_file, 0, SEEK_SET);
+	
+	return update - dest;
 }
 
-int samwrite(const Qseqs *qseq, const Qseqs *header, const Qseqs *Qual, char *rname, const Aln *aligned, const int *stats, Qseqs *Cigar) {
+void samSQ(SamBuff *dest, char *name, int len) {
 	
-	int flag, pos, mapQ, pnext, tlen;
-	char *qname, *cigar, *rnext, *seq, *qual;
+	char *update, *record;
+	
+	record = samReserve(dest, strlen(name) + 24);
+	update = record + 7;
+	memcpy(record, "@SQ\tSN:", 7);
+	update += samName(update, name);
+	update += sprintf(update, "\tLN:%d\n", len);
+	samPut(dest->dest, record, update - record);
+}
+
+static void samRecord(SamBuff *dest, const Qseqs *qseq, const Qseqs *header, const char *rname, const unsigned char *t, const unsigned char *q, int i, int end, int lead, int pos, int flag, int mapQ, int score) {
 	
+	int rep, qAln;
+	char op, *qname, *update, *record;
 	
+	/* QNAME is the header up to the first white space */
 	qname = (char *) header->seq;
-	seq = (char *) qseq->seq;
-	if(Qual) {
-		qual = (char *) Qual->seq;
-	} else {
-		qual = "*";
+	rep = 0;
+	while(rep < header->len && qname[rep] && !isspace(qname[rep])) {
+		++rep;
+	}
+	
+	/* QNAME, FLAG, RNAME, POS and MAPQ */
+	record = samReserve(dest, rep + strlen(rname) + qseq->len + 11 * (end - i + 2) + 96);
+	memcpy(record, qname, rep);
+	update = record + rep;
+	update += sprintf(update, "\t%d\t", flag);
+	update += samName(update, rname);
+	update += sprintf(update, "\t%d\t%d\t", pos + 1, mapQ);
+	
+	/* CIGAR */
+	if(lead) {
+		update += sprintf(update, "%dS", lead);
 	}
+	qAln = 0;
+	while(i < end) {
+		op = samOp(t[i], q[i]);
+		rep = 0;
+		do {
+			++rep;
+			++i;
+		} while(i < end && samOp(t[i], q[i]) == op);
+		if(op != 'D') {
+			qAln += rep;
+		}
+		update += sprintf(update, "%d%c", rep, op);
+	}
+	if(lead + qAln < qseq->len) {
+		update += sprintf(update, "%dS", qseq->len - lead - qAln);
+	}
+	
+	/* RNEXT, PNEXT, TLEN, SEQ, QUAL and tags */
+	memcpy(update, "\t*\t0\t0\t", 7);
+	update += 7;
+	memcpy(update, qseq->seq, qseq->len);
+	update += qseq->len;
+	update += sprintf(update, "\t*\tAS:i:%d\n", score);
 	
-	if(rname) {
-		mapQ = 254 < aligned->mapQ ? 254 : aligned->mapQ;
-		pos = stats[2] + makeCigar(Cigar, aligned);
-		tlen = stats[3] - pos;
-		flag = stats[4];
-		cigar = (char *) Cigar->seq;
+	if(dest->recs) {
+		/* keep record until template is done */
+		if(dest->n == dest->recSize) {
+			dest->recSize <<= 1;
+			dest->recs = realloc(dest->recs, dest->recSize * sizeof(SamRec));
+			if(!dest->recs) {
+				ERROR();
+			}
+		}
+		dest->recs[dest->n].pos = pos;
+		dest->recs[dest->n].offset = dest->len;
+		dest->recs[dest->n].len = update - record;
+		++dest->n;
+		dest->len += update - record;
 	} else {
-		rname = "*";
-		mapQ = 0;
-		pos = 0;
-		tlen = 0;
-		flag = *stats;
-		cigar = "*";
+		samPut(dest->dest, record, update - record);
 	}
-	rnext = "*";
-	pnext = 0;
+}
+
+void samwrite(SamBuff *dest, const Qseqs *qseq, const Qseqs *header, const char *rname, const Aln *aligned, int start, int t_len, int flag, int score) {
+	
+	int i, end, cut, end1, start2, lead, lead2, pos, pos2, n1, n2, mapQ;
+	unsigned char *t, *q;
+	
+	/* trim gaps at the ends, leading and trailing insertions are clipped */
+	t = aligned->t;
+	q = aligned->q;
+	i = 0;
+	end = aligned->len;
+	lead = aligned->qStart;
+	pos = start;
+	while(i < end && (t[i] == 5 || q[i] == 5)) {
+		if(t[i] == 5) {
+			++lead;
+		} else {
+			++pos;
+		}
+		++i;
+	}
+	while(i < end && (t[end - 1] == 5 || q[end - 1] == 5)) {
+		--end;
+	}
+	if(end <= i) {
+		return;
+	}
+	if(t_len <= pos) {
+		pos -= t_len;
+	}
+	mapQ = 254 < aligned->mapQ ? 254 : aligned->mapQ;
+	
+	/* find where a circular alignment passes the origin */
+	cut = i;
+	pos2 = pos;
+	n1 = 0;
+	while(cut < end && (pos2 < t_len || t[cut] == 5)) {
+		if(t[cut] != 5) {
+			++pos2;
+		}
+		if(q[cut] != 5) {
+			++n1;
+		}
+		++cut;
+	}
+	if(cut == end) {
+		samRecord(dest, qseq, header, rname, t, q, i, end, lead, pos, flag, mapQ, score);
+		return;
+	}
+	
+	/*
+	 * Split the alignment at the origin, and trim the gaps at the split.
+	 * Both parts hold an aligned base, as the ends are trimmed above.
+	 */
+	end1 = cut;
+	while(t[end1 - 1] == 5 || q[end1 - 1] == 5) {
+		--end1;
+	}
+	start2 = cut;
+	lead2 = lead + n1;
+	pos2 = 0;
+	while(t[start2] == 5 || q[start2] == 5) {
+		if(t[start2] == 5) {
+			++lead2;
+		} else {
+			++pos2;
+		}
+		++start2;
+	}
+	n2 = 0;
+	for(cut = start2; cut < end; ++cut) {
+		if(q[cut] != 5) {
+			++n2;
+		}
+	}
+	
+	/* the part aligning the most query bases is the primary record */
+	cut = n1 < n2 ? 2048 : 0;
+	samRecord(dest, qseq, header, rname, t, q, i, end1, lead, pos, flag | cut, mapQ, score);
+	samRecord(dest, qseq, header, rname, t, q, start2, end, lead2, pos2, flag | (cut ^ 2048), mapQ, score);
+}
+
+void samFlush(SamBuff *src) {
+	
+	int i;
+	SamRec *rec;
+	
+	/* write records of template in coordinate order */
+	if(src->n) {
+		qsort(src->recs, src->n, sizeof(SamRec), cmpSamRec);
+		for(i = 0, rec = src->recs; i < src->n; ++i, ++rec) {
+			samPut(src->dest, src->buffer + rec->offset, rec->len);
+		}
+	}
+	src->n = 0;
+	src->len = 0;
+}
+
+void samDestroy(SamBuff *src) {
 	
-	return fprintf(stdout, "%s\t%d\t%s\t%d\t%d\t%s\t%s\t%d\t%d\t%s\t%s\n", qname, flag, rname, pos, mapQ, cigar, rnext, pnext, tlen, seq, qual);
+	samFlush(src);
+	destroyGzFileBuff(src->dest);
+	free(src->buffer);
+	free(src->recs);
+	free(src);
 }
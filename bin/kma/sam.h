@@ -17,10 +17,37 @@
  * limitations under the License.
 */
 
-#include <stdio.h>
+#define _XOPEN_SOURCE 600
+#include "filebuff.h"
 #include "nw.h"
 #include "qseqs.h"
 
-char * makeCigar(Qseqs *Cigar, const Aln aligned);
-void saminit(Qseqs *template_name, FILE *name_file, int *template_lengths, int DB_size);
-int samwrite(const Qseqs *qseq, const Qseqs *header, const Qseqs *qual, const char *template_name, const Aln aligned, const int *stats, Qseqs *Cigar);
+#ifndef SAM
+typedef struct samBuff SamBuff;
+typedef struct samRec SamRec;
+struct samRec {
+	int pos;
+	int offset;
+	int len;
+};
+struct samBuff {
+	int len;
+	int size;
+	int n;
+	int recSize;
+	char *buffer;
+	SamRec *recs;
+	FileBuff *dest;
+};
+#define SAM 1
+#endif
+
+/* 0: no sam, 1: sam, 2: coordinate sorted sam */
+extern int samFlag;
+extern SamBuff *samOut;
+
+SamBuff * samInit(char *filename, int sort);
+void samSQ(SamBuff *dest, char *name, int len);
+void samwrite(SamBuff *dest, const Qseqs *qseq, const Qseqs *header, const char *rname, const Aln *aligned, int start, int t_len, int flag, int score);
+void samFlush(SamBuff *src);
+void samDestroy(SamBuff *src);
@@ -79,11 +79,11 @@ int loadFsa(CompDNA *qseq, Qseqs *header, FILE *inputfile) {
 
 void * save_kmers_threaded(void *arg) {
 	
-	static volatile int excludeIn[1] = {0}, excludeOut[1] = {0};
-	static unsigned readNum = 0;
+	static volatile int excludeIn[1] = {0}, excludeOut[1] = {1};
+	static int readNum = 0;
 	KmerScan_thread *thread = arg;
 	int *Score, *Score_r, *bestTemplates, *bestTemplates_r, *regionTemplates;
-	int *regionScores, *extendScore, go, spltDB, exhaustive;
+	int *regionScores, *extendScore, go, exhaustive;
 	FILE *inputfile;
 	HashMapKMA *templates;
 	CompDNA *qseq, *qseq_r;
@@ -129,7 +129,6 @@ void * save_kmers_threaded(void *arg) {
 	*bestTemplates++ = 0;
 	*bestTemplates_r++ = 0;
 	*regionTemplates++ = 0;
-	spltDB = thread->spltDB;
 	
 	go = 1;
 	while(go != 0) {
@@ -140,11 +139,10 @@ void * save_kmers_threaded(void *arg) {
 			/* PE */
 			loadFsa(qseq_r, header_r, inputfile);
 		}
-		if(spltDB) {
-			bestTemplates[-1] = ++readNum;
-			bestTemplates_r[-1] = readNum;
-			regionTemplates[-1] = readNum;
-		}
+		/* reads are committed in the order they were loaded */
+		bestTemplates[-1] = ++readNum;
+		bestTemplates_r[-1] = readNum;
+		regionTemplates[-1] = readNum;
 		unlock(excludeIn);
 		
 		/* allocate memory */
@@ -159,6 +157,7 @@ void * save_kmers_threaded(void *arg) {
 		} else if(go < 0) {
 			save_kmers_pair(templates, rewards, bestTemplates, bestTemplates_r, Score, Score_r, regionTemplates, regionScores, qseq, qseq_r, header, header_r, extendScore, exhaustive, excludeOut);
 		}
+		unlockTurn(excludeOut, bestTemplates[-1]);
 	}
 	
 	return NULL;
@@ -1442,9 +1441,8 @@ void save_kmers_Sparse(const HashMapKMA *templates, const Penalties *rewards, in
 	
 	if(bestScore) {
 		if(bestScore * kmersize > end) {
-			lock(excludeOut);
+			lockTurn(excludeOut, bestTemplates[-1]);
 			deConPrintPtr(bestTemplates, qseq, bestScore, header);
-			unlock(excludeOut);
 		}
 	}
 }
@@ -1698,9 +1696,8 @@ void save_kmers_pseuodeSparse(const HashMapKMA *templates, const Penalties *rewa
 	
 	if(bestScore) {
 		if(bestScore * kmersize > end) {
-			lock(excludeOut);
+			lockTurn(excludeOut, bestTemplates[-1]);
 			deConPrintPtr(bestTemplates, qseq, bestScore, header);
-			unlock(excludeOut);
 		}
 	}
 }
@@ -2188,22 +2185,23 @@ void save_kmers(const HashMapKMA *templates, const Penalties *rewards, int *best
 		end = qseq->seqlen + 1;
 		if((bestScore >= bestScore_r && bestScore * kmersize > (end - bestScore)) || (bestScore < bestScore_r && bestScore_r * kmersize > (end - bestScore_r))) {
 			if(bestScore > bestScore_r) {
-				lock(excludeOut);
+				lockTurn(excludeOut, bestTemplates[-1]);
 				deConPrintPtr(bestTemplates, qseq, bestScore, header);
-				unlock(excludeOut);
 			} else if(bestScore < bestScore_r) {
-				lock(excludeOut);
-				deConPrintPtr(bestTemplates_r, qseq_r, bestScore_r, header);
-				unlock(excludeOut);
+				/* print the input orientation, with the strand in the signs */
+				for(i = 1; i <= *bestTemplates_r; ++i) {
+					bestTemplates_r[i] = -bestTemplates_r[i];
+				}
+				lockTurn(excludeOut, bestTemplates_r[-1]);
+				deConPrintPtr(bestTemplates_r, qseq, -bestScore_r, header);
 			} else {
 				/* merge */
 				for(i = 1; i <= *bestTemplates_r; ++i) {
 					bestTemplates[0]++;
 					bestTemplates[*bestTemplates] = -bestTemplates_r[i];
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, bestTemplates[-1]);
 				deConPrintPtr(bestTemplates, qseq, -bestScore, header);
-				unlock(excludeOut);
 			}
 		}
 	}
@@ -2489,22 +2487,23 @@ void save_kmers_count(const HashMapKMA *templates, const Penalties *rewards, int
 		end = qseq->seqlen + 1;
 		if((bestScore >= bestScore_r && bestScore * kmersize > (end - bestScore)) || (bestScore < bestScore_r && bestScore_r * kmersize > (end - bestScore_r))) {
 			if(bestScore > bestScore_r) {
-				lock(excludeOut);
+				lockTurn(excludeOut, bestTemplates[-1]);
 				deConPrintPtr(bestTemplates, qseq, bestScore, header);
-				unlock(excludeOut);
 			} else if(bestScore < bestScore_r) {
-				lock(excludeOut);
-				deConPrintPtr(bestTemplates_r, qseq_r, bestScore_r, header);
-				unlock(excludeOut);
+				/* print the input orientation, with the strand in the signs */
+				for(i = 1; i <= *bestTemplates_r; ++i) {
+					bestTemplates_r[i] = -bestTemplates_r[i];
+				}
+				lockTurn(excludeOut, bestTemplates_r[-1]);
+				deConPrintPtr(bestTemplates_r, qseq, -bestScore_r, header);
 			} else {
 				/* merge */
 				for(i = 1; i <= *bestTemplates_r; ++i) {
 					bestTemplates[0]++;
 					bestTemplates[*bestTemplates] = -bestTemplates_r[i];
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, bestTemplates[-1]);
 				deConPrintPtr(bestTemplates, qseq, -bestScore, header);
-				unlock(excludeOut);
 			}
 		}
 	}
@@ -2577,74 +2576,45 @@ void save_kmers_unionPair(const HashMapKMA *templates, const Penalties *rewards,
 					bestScore = -bestScore;
 					bestScore_r = -bestScore_r;
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, regionTemplates[-1]);
 				printPairPtr(regionTemplates, qseq, bestScore, header, qseq_r, bestScore_r, header_r);
-				unlock(excludeOut);
 			} else {
 				comp_rc(qseq_r);
 				for(i = *regionTemplates; i != 0; --i) {
 					regionTemplates[i] = -regionTemplates[i];
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, regionTemplates[-1]);
 				printPairPtr(regionTemplates, qseq_r, bestScore_r, header_r, qseq, bestScore, header);
-				unlock(excludeOut);
 			}
 		} else {
-			if(0 < regionTemplates[1]) {
-				comp_rc(qseq);
-				if(regionTemplates[*regionTemplates] < 0) {
-					bestScore = -bestScore;
-				}
-			} else {
-				for(i = 1; i <= *regionTemplates; ++i) {
-					regionTemplates[i] = -regionTemplates[i];
-				}
+			/* keep the input orientation, the template signs give the strand */
+			comp_rc(qseq);
+			if(regionTemplates[*regionTemplates] < 0) {
+				bestScore = -bestScore;
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, regionTemplates[-1]);
 			deConPrintPtr(regionTemplates, qseq, bestScore, header);
-			unlock(excludeOut);
-			if(0 < bestTemplates[1]) {
-				comp_rc(qseq_r);
-				if(bestTemplates[*bestTemplates] < 0) {
-					bestScore_r = -bestScore_r;
-				}
-			} else {
-				for(i = 1; i <= *bestTemplates; ++i) {
-					bestTemplates[i] = -bestTemplates[i];
-				}
+			comp_rc(qseq_r);
+			if(bestTemplates[*bestTemplates] < 0) {
+				bestScore_r = -bestScore_r;
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, bestTemplates[-1]);
 			deConPrintPtr(bestTemplates, qseq_r, bestScore_r, header_r);
-			unlock(excludeOut);
 		}
 	} else if(bestScore) {
-		if(0 < regionTemplates[1]) {
-			comp_rc(qseq);
-			if(regionTemplates[*regionTemplates] < 0) {
-				bestScore = -bestScore;
-			}
-		} else {
-			for(i = 1; i <= *regionTemplates; ++i) {
-				regionTemplates[i] = -regionTemplates[i];
-			}
+		comp_rc(qseq);
+		if(regionTemplates[*regionTemplates] < 0) {
+			bestScore = -bestScore;
 		}
-		lock(excludeOut);
+		lockTurn(excludeOut, regionTemplates[-1]);
 		deConPrintPtr(regionTemplates, qseq, bestScore, header);
-		unlock(excludeOut);
 	} else if(bestScore_r) {
-		if(0 < regionTemplates[1]) {
-			comp_rc(qseq_r);
-			if(regionTemplates[*regionTemplates] < 0) {
-				bestScore_r = -bestScore_r;
-			}
-		} else {
-			for(i = 1; i <= *regionTemplates; ++i) {
-				regionTemplates[i] = -regionTemplates[i];
-			}
+		comp_rc(qseq_r);
+		if(regionTemplates[*regionTemplates] < 0) {
+			bestScore_r = -bestScore_r;
 		}
-		lock(excludeOut);
+		lockTurn(excludeOut, regionTemplates[-1]);
 		deConPrintPtr(regionTemplates, qseq_r, bestScore_r, header_r);
-		unlock(excludeOut);
 	}
 }
 
@@ -2688,86 +2658,57 @@ void save_kmers_penaltyPair(const HashMapKMA *templates, const Penalties *reward
 						bestScore = -bestScore;
 						bestScore_r = -bestScore_r;
 					}
-					lock(excludeOut);
+					lockTurn(excludeOut, regionTemplates[-1]);
 					printPairPtr(regionTemplates, qseq, bestScore, header, qseq_r, bestScore_r, header_r);
-					unlock(excludeOut);
 				} else {
 					comp_rc(qseq_r);
 					for(i = *regionTemplates; i != 0; --i) {
 						regionTemplates[i] = -regionTemplates[i];
 					}
-					lock(excludeOut);
+					lockTurn(excludeOut, regionTemplates[-1]);
 					printPairPtr(regionTemplates, qseq_r, bestScore_r, header_r, qseq, bestScore, header);
-					unlock(excludeOut);
 				}
 			}
 		} else {
 			hitCounter = MIN(hitCounter, bestScore);
 			if((qseq->seqlen - hitCounter - kmersize) < hitCounter * kmersize) {
-				if(0 < regionTemplates[1]) {
-					comp_rc(qseq);
-					if(regionTemplates[*regionTemplates] < 0) {
-						bestScore = -bestScore;
-					}
-				} else {
-					for(i = *regionTemplates; i != 0; --i) {
-						regionTemplates[i] = -regionTemplates[i];
-					}
+				/* keep the input orientation, the template signs give the strand */
+				comp_rc(qseq);
+				if(regionTemplates[*regionTemplates] < 0) {
+					bestScore = -bestScore;
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, regionTemplates[-1]);
 				deConPrintPtr(regionTemplates, qseq, bestScore, header);
-				unlock(excludeOut);
 			}
 			hitCounter_r = MIN(hitCounter_r, bestScore_r);
 			if((qseq_r->seqlen - hitCounter_r - kmersize) < hitCounter_r * kmersize) {
-				if(0 < bestTemplates[1]) {
-					comp_rc(qseq_r);
-					if(bestTemplates[*bestTemplates] < 0) {
-						bestScore_r = -bestScore_r;
-					}
-				} else {
-					for(i = *bestTemplates; i != 0; --i) {
-						bestTemplates[i] = -bestTemplates[i];
-					}
+				comp_rc(qseq_r);
+				if(bestTemplates[*bestTemplates] < 0) {
+					bestScore_r = -bestScore_r;
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, bestTemplates[-1]);
 				deConPrintPtr(bestTemplates, qseq_r, bestScore_r, header_r);
-				unlock(excludeOut);
 			}
 		}
 	} else if(0 < bestScore) {
 		hitCounter = MIN(hitCounter, bestScore);
 		if((qseq->seqlen - hitCounter - kmersize) < hitCounter * kmersize) {
-			if(0 < regionTemplates[1]) {
-				comp_rc(qseq);
-				if(regionTemplates[*regionTemplates] < 0) {
-					bestScore = -bestScore;
-				}
-			} else {
-				for(i = *regionTemplates; i != 0; --i) {
-					regionTemplates[i] = -regionTemplates[i];
-				}
+			comp_rc(qseq);
+			if(regionTemplates[*regionTemplates] < 0) {
+				bestScore = -bestScore;
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, regionTemplates[-1]);
 			deConPrintPtr(regionTemplates, qseq, bestScore, header);
-			unlock(excludeOut);
 		}
 	} else if(0 < bestScore_r) {
 		hitCounter_r = MIN(hitCounter_r, bestScore_r);
 		if((qseq_r->seqlen - hitCounter_r - kmersize) < hitCounter_r * kmersize) {
-			if(0 < regionTemplates[1]) {
-				comp_rc(qseq_r);
-				if(regionTemplates[*regionTemplates] < 0) {
-					bestScore_r = -bestScore_r;
-				}
-			} else {
-				for(i = 1; i <= *regionTemplates; ++i) {
-					regionTemplates[i] = -regionTemplates[i];
-				}
+			comp_rc(qseq_r);
+			if(regionTemplates[*regionTemplates] < 0) {
+				bestScore_r = -bestScore_r;
 			}
-			lock(excludeOut);
+			lockTurn(excludeOut, regionTemplates[-1]);
 			deConPrintPtr(regionTemplates, qseq_r, bestScore_r, header_r);
-			unlock(excludeOut);
 		}
 	}
 }
@@ -2800,17 +2741,15 @@ void save_kmers_forcePair(const HashMapKMA *templates, const Penalties *rewards,
 			}
 			if(0 < regionTemplates[1]) {
 				comp_rc(qseq);
-				lock(excludeOut);
+				lockTurn(excludeOut, regionTemplates[-1]);
 				printPairPtr(regionTemplates, qseq, bestScore, header, qseq_r, bestScore, header_r);
-				unlock(excludeOut);
 			} else {
 				comp_rc(qseq_r);
 				for(i = *regionTemplates; i != 0; --i) {
 					regionTemplates[i] = -regionTemplates[i];
 				}
-				lock(excludeOut);
+				lockTurn(excludeOut, regionTemplates[-1]);
 				printPairPtr(regionTemplates, qseq_r, bestScore, header_r, qseq, bestScore, header);
-				unlock(excludeOut);
 			}
 		}
 	} else if(hitCounter || hitCounter_r) {
@@ -2906,7 +2845,7 @@ void save_kmers_HMM(const HashMapKMA *templates, const Penalties *rewards, int *
 	regionTemplates = RegionTemplates[*Score];
 	*regionTemplates++ = templates->DB_size;
 	*regionTemplates++ = *Score;
-	*regionTemplates++ = 0;
+	*regionTemplates++ = bestTemplates[-1];
 	VF_scores = tVF_scores[*Score];
 	VR_scores = tVR_scores[*Score];
 	tmpNs = TmpNs[*Score];
@@ -3615,9 +3554,8 @@ void ankerAndClean(int *regionTemplates, int *Score, int *Score_r, int *template
 	tmpQseq.complen = (tmpQseq.seqlen >> 5) + 1;
 	tmpQseq.N[0] = l;
 	
-	lock(excludeOut);
+	lockTurn(excludeOut, regionTemplates[-1]);
 	deConPrintPtr(regionTemplates, &tmpQseq, HIT * bestScore, header);
-	unlock(excludeOut);
 }
 
 void ankerAndClean_MEM(int *regionTemplates, int *Score, int *Score_r, int *template_lengths, unsigned **VF_scores, unsigned **VR_scores, int *tmpNs, CompDNA *qseq, int HIT, int bestScore, int start_cut, int end_cut, const Qseqs *header, volatile int *excludeOut) {
@@ -3700,7 +3638,6 @@ void ankerAndClean_MEM(int *regionTemplates, int *Score, int *Score_r, int *temp
 	tmpQseq.complen = (tmpQseq.seqlen >> 5) + 1;
 	tmpQseq.N[0] = l;
 	
-	lock(excludeOut);
+	lockTurn(excludeOut, regionTemplates[-1]);
 	deConPrintPtr(regionTemplates, &tmpQseq, HIT * bestScore, header);
-	unlock(excludeOut);
 }
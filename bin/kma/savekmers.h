@@ -29,7 +29,6 @@ struct kmerScan_thread {
 	pthread_t id;
 	int num;
 	int exhaustive;
-	int spltDB;
 	int bestScore;
 	int bestScore_r;
 	int *bestTemplates;
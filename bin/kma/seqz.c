@@ -0,0 +1,326 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "pherror.h"
+#include "seqz.h"
+#include "threader.h"
+
+/*
+ Block compressed template sequences, *.seqz.b:
+ unsigned blockWords, unsigned blockNum, unsigned maxComp, long unsigned n,
+ unsigned char codec[blockNum], long unsigned offsets[blockNum + 1],
+ followed by the blocks. Each block holds blockWords words of *.seq.b,
+ so the byte offsets into *.seq.b are kept as they are.
+*/
+
+SeqZ *templateSeqZ = 0;
+
+static void seqz_sread(int seq_in, void *buf, size_t count, off_t offset) {
+	
+	if(pread(seq_in, buf, count, offset) != count) {
+		if(errno) {
+			ERROR();
+		} else {
+			fprintf(stderr, "Reading error.\n");
+			exit(1);
+		}
+	}
+}
+
+void seqz_make(char *filename, unsigned blockWords) {
+	
+	int file_len;
+	unsigned i, blockNum, maxComp, rawLen;
+	long unsigned n, size, *raw;
+	long unsigned *offsets;
+	unsigned char *codec, *comp;
+	uLongf compLen;
+	FILE *seq_in, *out;
+	
+	/* open *.seq.b */
+	file_len = strlen(filename);
+	strcat(filename, ".seq.b");
+	seq_in = sfopen(filename, "rb");
+	filename[file_len] = 0;
+	fseek(seq_in, 0, SEEK_END);
+	n = ftell(seq_in) / sizeof(long unsigned);
+	rewind(seq_in);
+	
+	blockNum = (n + blockWords - 1) / blockWords;
+	codec = smalloc(blockNum + 1);
+	offsets = smalloc((blockNum + 1) * sizeof(long unsigned));
+	raw = smalloc(blockWords * sizeof(long unsigned));
+	size = compressBound(blockWords * sizeof(long unsigned));
+	comp = smalloc(size);
+	
+	/* reserve header, and fill it in when the blocks are known */
+	strcat(filename, ".seqz.b");
+	out = sfopen(filename, "wb");
+	filename[file_len] = 0;
+	*offsets = 3 * sizeof(unsigned) + sizeof(long unsigned) + blockNum + (blockNum + 1) * sizeof(long unsigned);
+	fseek(out, *offsets, SEEK_SET);
+	
+	/* compress blocks, and store those that do not shrink */
+	maxComp = 0;
+	for(i = 0; i < blockNum; ++i) {
+		rawLen = (n - (long unsigned)(i) * blockWords < blockWords ? n - (long unsigned)(i) * blockWords : blockWords) * sizeof(long unsigned);
+		sfread(raw, 1, rawLen, seq_in);
+		compLen = size;
+		if(compress2(comp, &compLen, (unsigned char *) raw, rawLen, Z_BEST_COMPRESSION) == Z_OK && compLen < rawLen) {
+			codec[i] = SEQZ_DEFLATE;
+			sfwrite(comp, 1, compLen, out);
+		} else {
+			codec[i] = SEQZ_STORED;
+			compLen = rawLen;
+			sfwrite(raw, 1, rawLen, out);
+		}
+		offsets[i + 1] = offsets[i] + compLen;
+		if(maxComp < compLen) {
+			maxComp = compLen;
+		}
+	}
+	
+	/* dump header */
+	rewind(out);
+	sfwrite(&blockWords, sizeof(unsigned), 1, out);
+	sfwrite(&blockNum, sizeof(unsigned), 1, out);
+	sfwrite(&maxComp, sizeof(unsigned), 1, out);
+	sfwrite(&n, sizeof(long unsigned), 1, out);
+	sfwrite(codec, 1, blockNum, out);
+	sfwrite(offsets, sizeof(long unsigned), blockNum + 1, out);
+	fclose(out);
+	fclose(seq_in);
+	
+	fprintf(stderr, "# Compressed template sequences from %lu to %lu bytes.\n", n * sizeof(long unsigned), offsets[blockNum]);
+	
+	free(codec);
+	free(offsets);
+	free(raw);
+	free(comp);
+}
+
+SeqZ * seqz_init(long unsigned cacheSize) {
+	
+	SeqZ *dest;
+	
+	dest = smalloc(sizeof(SeqZ));
+	memset(dest, 0, sizeof(SeqZ));
+	dest->seq_in = -1;
+	dest->cacheSize = cacheSize;
+	
+	return dest;
+}
+
+void seqz_open(SeqZ *dest, int seq_in, long unsigned n) {
+	
+	int i;
+	off_t offset;
+	
+	/* load header */
+	dest->seq_in = seq_in;
+	offset = 0;
+	seqz_sread(seq_in, &dest->blockWords, sizeof(unsigned), offset);
+	offset += sizeof(unsigned);
+	seqz_sread(seq_in, &dest->blockNum, sizeof(unsigned), offset);
+	offset += sizeof(unsigned);
+	seqz_sread(seq_in, &dest->maxComp, sizeof(unsigned), offset);
+	offset += sizeof(unsigned);
+	seqz_sread(seq_in, &dest->n, sizeof(long unsigned), offset);
+	offset += sizeof(long unsigned);
+	if(dest->n != n) {
+		/* *.seq.b changed since *.seqz.b was made, e.g. by kma_index -t_db */
+		fprintf(stderr, "*.seqz.b holds %lu words, while *.seq.b holds %lu, rebuild it with kma_index -seqz.\n", dest->n, n);
+		exit(1);
+	}
+	dest->codec = smalloc(dest->blockNum + 1);
+	seqz_sread(seq_in, dest->codec, dest->blockNum, offset);
+	offset += dest->blockNum;
+	dest->offsets = smalloc((dest->blockNum + 1) * sizeof(long unsigned));
+	seqz_sread(seq_in, dest->offsets, (dest->blockNum + 1) * sizeof(long unsigned), offset);
+	
+	/* size cache to the memory limit, at least one block */
+	dest->slots = dest->cacheSize / (dest->blockWords * sizeof(long unsigned));
+	if(dest->slots == 0) {
+		dest->slots = 1;
+	} else if(dest->blockNum < dest->slots) {
+		dest->slots = dest->blockNum;
+	}
+	dest->cache = smalloc((long unsigned)(dest->slots) * dest->blockWords * sizeof(long unsigned));
+	dest->blockSlot = smalloc((dest->blockNum + 1) * sizeof(int));
+	dest->slotBlock = smalloc(dest->slots * sizeof(int));
+	dest->prev = smalloc(dest->slots * sizeof(int));
+	dest->next = smalloc(dest->slots * sizeof(int));
+	dest->slotRef = calloc(dest->slots, sizeof(int));
+	dest->slotReady = calloc(dest->slots, 1);
+	if(!dest->slotRef || !dest->slotReady) {
+		ERROR();
+	}
+	for(i = 0; i < dest->blockNum; ++i) {
+		dest->blockSlot[i] = -1;
+	}
+	for(i = 0; i < dest->slots; ++i) {
+		dest->slotBlock[i] = -1;
+		dest->prev[i] = i - 1;
+		dest->next[i] = i + 1;
+	}
+	dest->next[dest->slots - 1] = -1;
+	dest->head = 0;
+	dest->tail = dest->slots - 1;
+	dest->excludeCache = 0;
+}
+
+static void seqz_decode(SeqZ *src, int block, long unsigned *dest) {
+	
+	int rawLen, compLen;
+	unsigned char *comp;
+	uLongf destLen;
+	
+	rawLen = (src->n - (long unsigned)(block) * src->blockWords < src->blockWords ? src->n - (long unsigned)(block) * src->blockWords : src->blockWords) * sizeof(long unsigned);
+	if(src->codec[block] == SEQZ_STORED) {
+		seqz_sread(src->seq_in, dest, rawLen, src->offsets[block]);
+	} else {
+		/* own input buffer, as other threads may decode at the same time */
+		compLen = src->offsets[block + 1] - src->offsets[block];
+		comp = smalloc(compLen);
+		seqz_sread(src->seq_in, comp, compLen, src->offsets[block]);
+		destLen = rawLen;
+		if(uncompress((unsigned char *) dest, &destLen, comp, compLen) != Z_OK || destLen != rawLen) {
+			fprintf(stderr, "Corrupted *.seqz.b block:\t%d\n", block);
+			exit(1);
+		}
+		free(comp);
+	}
+}
+
+static int seqz_fetch(SeqZ *src, int block) {
+	
+	int slot, decode;
+	
+	/* find the slot of block, or claim the least recently used free slot */
+	decode = 0;
+	lock(&src->excludeCache);
+	while((slot = src->blockSlot[block]) < 0) {
+		slot = src->tail;
+		while(0 <= slot && src->slotRef[slot]) {
+			slot = src->prev[slot];
+		}
+		if(0 <= slot) {
+			if(0 <= src->slotBlock[slot]) {
+				src->blockSlot[src->slotBlock[slot]] = -1;
+			}
+			src->slotBlock[slot] = block;
+			src->blockSlot[block] = slot;
+			src->slotReady[slot] = 0;
+			decode = 1;
+		} else {
+			/* every slot is being read */
+			unlock(&src->excludeCache);
+			usleep(100);
+			lock(&src->excludeCache);
+		}
+	}
+	
+	/* pin slot, and move it to the front */
+	++src->slotRef[slot];
+	if(slot != src->head) {
+		src->next[src->prev[slot]] = src->next[slot];
+		if(slot == src->tail) {
+			src->tail = src->prev[slot];
+		} else {
+			src->prev[src->next[slot]] = src->prev[slot];
+		}
+		src->prev[slot] = -1;
+		src->next[slot] = src->head;
+		src->prev[src->head] = slot;
+		src->head = slot;
+	}
+	unlock(&src->excludeCache);
+	
+	/* decode outside the lock, others wait for the slot to be ready */
+	if(decode) {
+		seqz_decode(src, block, src->cache + (long unsigned)(slot) * src->blockWords);
+		__sync_synchronize();
+		src->slotReady[slot] = 1;
+	} else {
+		while(!src->slotReady[slot]) {
+			usleep(10);
+		}
+		__sync_synchronize();
+	}
+	
+	return slot;
+}
+
+ssize_t seqz_pread(int seq_in, void *buf, size_t count, off_t offset) {
+	
+	int block, slot;
+	long unsigned word, words, start, num, *dest;
+	SeqZ *seqZ;
+	
+	/* same interface as pread, on the words of *.seq.b */
+	seqZ = templateSeqZ;
+	dest = buf;
+	word = offset / sizeof(long unsigned);
+	words = count / sizeof(long unsigned);
+	if(seqZ->n < word + words) {
+		/* the offsets point beyond *.seqz.b */
+		errno = EINVAL;
+		return -1;
+	}
+	count = words * sizeof(long unsigned);
+	
+	while(words) {
+		block = word / seqZ->blockWords;
+		slot = seqz_fetch(seqZ, block);
+		start = word - (long unsigned)(block) * seqZ->blockWords;
+		num = seqZ->blockWords - start;
+		if(words < num) {
+			num = words;
+		}
+		memcpy(dest, seqZ->cache + (long unsigned)(slot) * seqZ->blockWords + start, num * sizeof(long unsigned));
+		__sync_sub_and_fetch(seqZ->slotRef + slot, 1);
+		dest += num;
+		word += num;
+		words -= num;
+	}
+	
+	return count;
+}
+
+void seqz_destroy(SeqZ *dest) {
+	
+	if(!dest) {
+		return;
+	}
+	free(dest->offsets);
+	free(dest->codec);
+	free(dest->cache);
+	free(dest->blockSlot);
+	free(dest->slotBlock);
+	free(dest->prev);
+	free(dest->next);
+	free((int *) dest->slotRef);
+	free((char *) dest->slotReady);
+	free(dest);
+}
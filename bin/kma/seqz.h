@@ -0,0 +1,60 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef SEQZ
+typedef struct seqZ SeqZ;
+struct seqZ {
+	int seq_in;
+	unsigned blockWords;
+	unsigned blockNum;
+	unsigned maxComp;
+	unsigned slots;
+	int head;
+	int tail;
+	long unsigned n;
+	long unsigned cacheSize;
+	long unsigned *offsets;
+	unsigned char *codec;
+	long unsigned *cache;
+	int *blockSlot;
+	int *slotBlock;
+	int *prev;
+	int *next;
+	volatile int *slotRef; /* readers holding the slot */
+	volatile char *slotReady; /* slot holds its decoded block */
+	volatile int excludeCache;
+};
+#define SEQZ 1
+#endif
+
+#define SEQZ_BLOCK 8192
+#define SEQZ_STORED 0
+#define SEQZ_DEFLATE 1
+
+extern SeqZ *templateSeqZ;
+
+void seqz_make(char *filename, unsigned blockWords);
+SeqZ * seqz_init(long unsigned cacheSize);
+void seqz_open(SeqZ *dest, int seq_in, long unsigned n);
+ssize_t seqz_pread(int seq_in, void *buf, size_t count, off_t offset);
+void seqz_destroy(SeqZ *dest);
@@ -30,6 +30,7 @@
 #include "compdna.h"
 #include "ef.h"
 #include "filebuff.h"
+#include "fragbin.h"
 #include "frags.h"
 #include "hashmapindex.h"
 #include "kmapipe.h"
@@ -37,6 +38,7 @@
 #include "pherror.h"
 #include "printconsensus.h"
 #include "qseqs.h"
+#include "resbin.h"
 #include "runkma.h"
 #include "spltdb.h"
 #include "stdnuc.h"
@@ -386,14 +388,14 @@ unsigned get_ankers_spltDB(int *infoSize, int *out_Tem, CompDNA *qseq, Qseqs *he
 	return num;
 }
 
-int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename, int argc, char **argv, int ConClave, int kmersize, Penalties *rewards, int extendedFeatures, double ID_t, int mq, double scoreT, double evalue, int bcd, int ref_fsa, int print_matrix, int print_all, int vcf, unsigned shm, int thread_num) {
+int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename, int argc, char **argv, int ConClave, int kmersize, Penalties *rewards, int extendedFeatures, double ID_t, int mq, double scoreT, double evalue, int bcd, int ref_fsa, int print_matrix, int print_all, int print_bin, int vcf, long unsigned memBudget, unsigned shm, int thread_num) {
 	
 	/* https://www.youtube.com/watch?v=LtXEMwSG5-8 */
 	
 	int i, j, k, tmp_template, tmp_tmp_template, t_len, file_len, score, tot;
-	int template, bestHits, start, end, aln_len, fragCount, maxFrag, sparse;
+	int template, bestHits, start, end, aln_len, sparse;
 	int rc_flag, coverScore, tmp_start, tmp_end, bestTemplate, status, delta;
-	int seq_in_no, index_in_no, progress, DB_size, fileCount, rand, stats[4];
+	int seq_in_no, index_in_no, progress, DB_size, rand, stats[4];
 	int *template_lengths, *bestTargets, (*targetInfo)[6], (*ptrInfo)[6];
 	int *matched_templates, *bestTemplates, *best_start_pos, *best_end_pos;
 	unsigned randScore, num, target, targetScore, bias;
@@ -405,14 +407,16 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	long double depth, q_value, expected;
 	char *templatefilename, Date[11];
 	FILE **inputfiles, *inputfile, *frag_in_raw, *index_in, *seq_in;
-	FILE *res_out, *alignment_out, *consensus_out, *frag_out_raw;
-	FILE *extendedFeatures_out, *name_file, **template_fragments;
+	FILE *res_out, *frag_out_raw;
+	FILE *extendedFeatures_out, *name_file;
 	time_t t0, t1;
 	struct tm *tm;
-	FileBuff *frag_out, *frag_out_all, *matrix_out, *vcf_out;
+	FileBuff *alignment_out, *consensus_out, *frag_out, *frag_out_all, *matrix_out, *vcf_out;
 	Aln *aligned, *gap_align;
 	Assem *aligned_assem;
-	Frag **alignFrags, *alignFrag;
+	ResBin *res_bin;
+	FragPool *fragPool;
+	FragIn *template_fragments;
 	CompDNA *qseq_comp, *qseq_r_comp;
 	Qseqs *qseq, *qseq_r, *header, *header_r, *template_name;
 	AssemInfo *matrix;
@@ -488,15 +492,31 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	strcat(outputfilename, ".res");
 	res_out = sfopen(outputfilename, "w");
 	outputfilename[file_len] = 0;
-	strcat(outputfilename, ".frag.gz");
-	frag_out = gzInitFileBuff(CHUNK);
-	openFileBuff(frag_out, outputfilename, "wb");
+	if(print_bin) {
+		strcat(outputfilename, ".res.b");
+		res_bin = resBin_init(sfopen(outputfilename, "wb"), 1024);
+		outputfilename[file_len] = 0;
+	} else {
+		res_bin = 0;
+	}
+	if(updateFragsPtr == &updateFragsBin) {
+		strcat(outputfilename, ".frag.b");
+		frag_out = initOutFileBuff(CHUNK, 0);
+		openFileBuff(frag_out, outputfilename, "wb");
+		initFragBin(frag_out);
+	} else {
+		strcat(outputfilename, ".frag.gz");
+		frag_out = gzInitFileBuff(CHUNK);
+		openFileBuff(frag_out, outputfilename, "wb");
+	}
 	outputfilename[file_len] = 0;
-	strcat(outputfilename, ".aln");
-	alignment_out = sfopen(outputfilename, "w");
+	strcat(outputfilename, alnGz ? ".aln.gz" : ".aln");
+	alignment_out = initOutFileBuff(CHUNK, alnGz);
+	openFileBuff(alignment_out, outputfilename, "wb");
 	outputfilename[file_len] = 0;
-	strcat(outputfilename, ".fsa");
-	consensus_out = sfopen(outputfilename, "w");
+	strcat(outputfilename, alnGz ? ".fsa.gz" : ".fsa");
+	consensus_out = initOutFileBuff(CHUNK, alnGz);
+	openFileBuff(consensus_out, outputfilename, "wb");
 	outputfilename[file_len] = 0;
 	frag_out_raw = tmpfile();
 	if(!frag_out_raw) {
@@ -744,20 +764,16 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	
 	/* Get best template for each mapped deltamer/read */
 	/* Best hit chosen as: highest mapping score then higest # unique maps */
-	alignFrags = calloc(DB_size, sizeof(Frag*));
 	w_scores = calloc(DB_size, sizeof(long unsigned));
-	template_fragments = calloc(DB_size, sizeof(FILE*));
-	if(!alignFrags || !w_scores || !template_fragments) {
+	if(!w_scores) {
 		ERROR();
 	}
 	frag_in_raw = frag_out_raw;
 	rewind(frag_in_raw);
-	fragCount = 0;
-	fileCount = 0;
-	maxFrag = 1000000;
+	fragPool = setFragPool(memBudget, DB_size);
 	
 	/* Patricks features */
-	if(extendedFeatures) {
+	if(extendedFeatures || print_bin) {
 		fragmentCounts = calloc(DB_size, sizeof(unsigned));
 		readCounts = calloc(DB_size, sizeof(unsigned));
 		if(!fragmentCounts || !readCounts) {
@@ -857,30 +873,20 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 			if(bestTemplate < 0) {
 				bestTemplate = -bestTemplate;
 				strrc(qseq->seq, qseq->len);
+				/* negative bestHits marks the read as reversed */
+				bestHits = -bestHits;
 			}
 			w_scores[bestTemplate] += read_score;
-			if(extendedFeatures) {
+			if(fragmentCounts) {
 				fragmentCounts[bestTemplate]++;
 				readCounts[bestTemplate]++;
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
-			alignFrag->buffer[0] = qseq->len;
-			alignFrag->buffer[1] = bestHits;
-			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-			alignFrag->buffer[3] = start;
-			alignFrag->buffer[4] = end;
-			alignFrag->buffer[5] = header->len;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
-			alignFrag->next = alignFrags[bestTemplate];
-			alignFrags[bestTemplate] = alignFrag;
-			
-			++fragCount;
+			pushFrag(fragPool, bestTemplate, qseq, header, bestHits, (sparse < 0) ? 0 : read_score, start, end);
 			
 			if(stats[2] < 0) {
-				if(extendedFeatures) {
+				if(readCounts) {
 					readCounts[bestTemplate]++;
 				}
 				fread(stats, sizeof(int), 2, frag_in_raw);
@@ -888,37 +894,10 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 				header->len = stats[1];
 				fread(qseq->seq, 1, qseq->len, frag_in_raw);
 				fread(header->seq, 1, header->len, frag_in_raw);
-				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
-				alignFrag->buffer[0] = qseq->len;
-				alignFrag->buffer[1] = bestHits;
-				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-				alignFrag->buffer[3] = start;
-				alignFrag->buffer[4] = end;
-				alignFrag->buffer[5] = header->len;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
-				alignFrag->next = alignFrags[bestTemplate];
-				alignFrags[bestTemplate] = alignFrag;
-				
-				++fragCount;
-			}
-			
-			if(fragCount >= maxFrag) {
-				template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-				++fileCount;
-				fragCount = 0;
-				/* control fileamount */
-				if(fileCount >= DB_size) {
-					template_fragments = realloc(template_fragments, (fileCount + 1) * sizeof(FILE*));
-					if(!template_fragments) {
-						ERROR();
-					}
-				}
+				/* dump frag info, the mate is stored reverse complemented */
+				pushFrag(fragPool, bestTemplate, qseq, header, -abs(bestHits), (sparse < 0) ? 0 : read_score, start, end);
 			}
 		}
-		template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-		++fileCount;
 	} else if(ConClave == 2) {
 		/* find potential template candidates */
 		while(fread(stats, sizeof(int), 4, frag_in_raw) && stats[0] != 0) {
@@ -1086,13 +1065,19 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 				}
 				
 				if(tot && 16 <= qseq->len) {
-					/* get seed */
+					/* get seed, on the strand of the first hit */
+					if(*bestTemplates < 0) {
+						strrc(qseq->seq, qseq->len);
+					}
 					rand = qseq->seq[0];
 					i = -1;
 					j = qseq->len;
 					while(++i < 7) {
 						rand = (((rand << 2) | qseq->seq[i]) << 2) | qseq->seq[--j];
 					}
+					if(*bestTemplates < 0) {
+						strrc(qseq->seq, qseq->len);
+					}
 					/* minimal standard */
 					rand = 16807 * (rand % 127773) - 2836 * (rand / 127773);
 					if (rand <= 0) {
@@ -1188,30 +1173,20 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 			if(bestTemplate < 0) {
 				bestTemplate = -bestTemplate;
 				strrc(qseq->seq, qseq->len);
+				/* negative bestHits marks the read as reversed */
+				bestHits = -bestHits;
 			}
 			w_scores[bestTemplate] += read_score;
-			if(extendedFeatures) {
+			if(fragmentCounts) {
 				fragmentCounts[bestTemplate]++;
 				readCounts[bestTemplate]++;
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
-			alignFrag->buffer[0] = qseq->len;
-			alignFrag->buffer[1] = bestHits;
-			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-			alignFrag->buffer[3] = start;
-			alignFrag->buffer[4] = end;
-			alignFrag->buffer[5] = header->len;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
-			alignFrag->next = alignFrags[bestTemplate];
-			alignFrags[bestTemplate] = alignFrag;
-			
-			++fragCount;
+			pushFrag(fragPool, bestTemplate, qseq, header, bestHits, (sparse < 0) ? 0 : read_score, start, end);
 			
 			if(stats[2] < 0) {
-				if(extendedFeatures) {
+				if(readCounts) {
 					readCounts[bestTemplate]++;
 				}
 				fread(stats, sizeof(int), 2, frag_in_raw);
@@ -1219,42 +1194,14 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 				header->len = stats[1];
 				fread(qseq->seq, 1, qseq->len, frag_in_raw);
 				fread(header->seq, 1, header->len, frag_in_raw);
-				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
-				alignFrag->buffer[0] = qseq->len;
-				alignFrag->buffer[1] = bestHits;
-				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
-				alignFrag->buffer[3] = start;
-				alignFrag->buffer[4] = end;
-				alignFrag->buffer[5] = header->len;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
-				alignFrag->next = alignFrags[bestTemplate];
-				alignFrags[bestTemplate] = alignFrag;
-				
-				++fragCount;
-			}
-			
-			if(fragCount >= maxFrag) {
-				template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-				++fileCount;
-				fragCount = 0;
-				/* control fileamount */
-				if(fileCount >= DB_size) {
-					template_fragments = realloc(template_fragments, (fileCount + 1) * sizeof(FILE*));
-					if(!template_fragments) {
-						ERROR();
-					}
-				}
+				/* dump frag info, the mate is stored reverse complemented */
+				pushFrag(fragPool, bestTemplate, qseq, header, -abs(bestHits), (sparse < 0) ? 0 : read_score, start, end);
 			}
 			
 		}
-		template_fragments[fileCount] = printFrags(alignFrags, DB_size);
-		++fileCount;
 	}
 	
-	fragCount = 0;
-	free(alignFrags);
+	template_fragments = closeFragPool(fragPool);
 	free(best_start_pos);
 	free(best_end_pos);
 	free(matched_templates);
@@ -1336,8 +1283,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 		thread->evalue = evalue;
 		thread->bcd = bcd;
 		thread->template = -2;
-		thread->file_count = fileCount;
-		thread->files = template_fragments;
+		thread->frags = template_fragments;
 		thread->frag_out = frag_out;
 		thread->aligned_assem = aligned_assem;
 		thread->aligned = aligned;
@@ -1394,8 +1340,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	thread->evalue = evalue;
 	thread->bcd = bcd;
 	thread->template = 0;
-	thread->file_count = fileCount;
-	thread->files = template_fragments;
+	thread->frags = template_fragments;
 	thread->frag_out = frag_out;
 	thread->aligned_assem = aligned_assem;
 	thread->aligned = aligned;
@@ -1440,6 +1385,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	templatefilename[file_len] = 0;
 	if(!index_in) {
 		alignLoadPtr = &alignLoad_fly_build_mem;
+		minimizerW = 0;
 		destroyPtr = &alignClean;
 		index_in = 0;
 		index_in_no = 0;
@@ -1455,7 +1401,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 		alignLoadPtr = &alignLoad_fly_mem;
 		destroyPtr = &alignClean;
 		index_in_no = fileno(index_in);
-		read(index_in_no, &kmersize, sizeof(int));
+		kmersize = hashMap_index_loadHeader(index_in_no);
 	}
 	if(extendedFeatures == 2) {
 		getExtendedFeatures(templatefilename, 0, 0, 0, 0, 0, 0, extendedFeatures_out);
@@ -1483,6 +1429,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 			templatefilename[file_len] = 0;
 			if(!index_in) {
 				alignLoadPtr = &alignLoad_fly_build_mem;
+				minimizerW = 0;
 				destroyPtr = &alignClean;
 				index_in = 0;
 				index_in_no = 0;
@@ -1498,7 +1445,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 				alignLoadPtr = &alignLoad_fly_mem;
 				destroyPtr = &alignClean;
 				index_in_no = fileno(index_in);
-				read(index_in_no, &kmersize, sizeof(int));
+				kmersize = hashMap_index_loadHeader(index_in_no);
 			}
 			seq_seeker = 0;
 			index_seeker = 0;
@@ -1564,6 +1511,9 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 					/* Output result */
 					fprintf(res_out, "%-12s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n",
 						thread->template_name, read_score, (unsigned) expected, t_len, id, cover, q_id, q_cover, (double) depth, (double) q_value, p_value);
+					if(res_bin) {
+						resBin_add(res_bin, template, thread->template_name, read_score, expected, t_len, q_value, p_value, aligned_assem, readCounts[template], fragmentCounts[template]);
+					}
 					printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
 					/* print matrix */
 					if(matrix_out) {
@@ -1581,14 +1531,14 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 			} else {
 				nameSkip(name_file, end);
 				if(index_in) {
-					index_seeker += (template_lengths[template] << 1);
+					index_seeker = hashMap_index_skip(index_in_no, index_seeker, template_lengths[template]);
 				}
 				seq_seeker += ((template_lengths[template] >> 5) + 1);
 			}
 		} else {
 			nameSkip(name_file, end);
 			if(index_in) {
-				index_seeker += (template_lengths[template] << 1);
+				index_seeker = hashMap_index_skip(index_in_no, index_seeker, template_lengths[template]);
 			}
 			seq_seeker += ((template_lengths[template] >> 5) + 1);
 		}
@@ -1609,15 +1559,19 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	}
 	
 	/* Close files */
+	destroyFragIn(template_fragments);
+	if(res_bin) {
+		closeResBin(res_bin);
+	}
 	if(index_in) {
 		fclose(index_in);
 	}
 	fclose(seq_in);
 	fclose(res_out);
-	fclose(alignment_out);
-	fclose(consensus_out);
+	destroyOutFileBuff(alignment_out);
+	destroyOutFileBuff(consensus_out);
 	fclose(name_file);
-	destroyGzFileBuff(frag_out);
+	destroyOutFileBuff(frag_out);
 	if(matrix_out) {
 		destroyGzFileBuff(matrix_out);
 	}
@@ -27,6 +27,121 @@ long unsigned getKmer(long unsigned *compressor, unsigned cPos, const unsigned s
 	return (iPos <= shifter) ? ((compressor[cPos] << iPos) >> shifter) : (((compressor[cPos] << iPos) | (compressor[cPos + 1] >> (64-iPos))) >> shifter);
 }
 
+long unsigned getBases(const long unsigned *compressor, int cPos, int len) {
+	
+	/* 32 bases starting at cPos, bases past len are zero */
+	unsigned iPos = (cPos & 31) << 1;
+	cPos >>= 5;
+	
+	if(iPos == 0) {
+		return compressor[cPos];
+	} else if(((cPos + 1) << 5) < len) {
+		return (compressor[cPos] << iPos) | (compressor[cPos + 1] >> (64 - iPos));
+	}
+	return compressor[cPos] << iPos;
+}
+
+long unsigned getBasesRev(const long unsigned *compressor, int cPos, int len) {
+	
+	/* 32 bases ending at cPos, bases before the start are zero */
+	if(31 <= cPos) {
+		return getBases(compressor, cPos - 31, len);
+	}
+	return getBases(compressor, 0, len) >> ((31 - cPos) << 1);
+}
+
+int matchFwd(const long unsigned *qseq, int qPos, int q_len, const long unsigned *tseq, int tPos, int t_len, int max) {
+	
+	int len;
+	long unsigned diff;
+	
+	/* count equal bases forward, 32 at a time */
+	for(len = 0; len < max; len += 32) {
+		if((diff = getBases(qseq, qPos + len, q_len) ^ getBases(tseq, tPos + len, t_len))) {
+			len += __builtin_clzl(diff) >> 1;
+			return len < max ? len : max;
+		}
+	}
+	
+	return max < 0 ? 0 : max;
+}
+
+int matchRev(const long unsigned *qseq, int qPos, int q_len, const long unsigned *tseq, int tPos, int t_len, int max) {
+	
+	int len;
+	long unsigned diff;
+	
+	/* count equal bases backwards from qPos and tPos, 32 at a time */
+	for(len = 0; len < max; len += 32) {
+		if((diff = getBasesRev(qseq, qPos - len, q_len) ^ getBasesRev(tseq, tPos - len, t_len))) {
+			len += __builtin_ctzl(diff) >> 1;
+			return len < max ? len : max;
+		}
+	}
+	
+	return max < 0 ? 0 : max;
+}
+
+long unsigned minimizerHash(long unsigned kmer) {
+	
+	/* invertible mix, avoids low complexity k-mers winning every window */
+	kmer ^= kmer >> 33;
+	kmer *= 0xff51afd7ed558ccdUL;
+	kmer ^= kmer >> 33;
+	
+	return kmer;
+}
+
+void minimizerMark(const long unsigned *seq, int start, int end, int kmersize, int w, unsigned char *mark) {
+	
+	int i, j, r, jr, best;
+	unsigned shifter;
+	long unsigned key, mask, bestHash, hash[MINIMIZER_MAX];
+	
+	/* mark the smallest k-mer of every window of w k-mers starting in [start, end) */
+	if(end <= start) {
+		return;
+	}
+	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (kmersize << 1);
+	mask = 0;
+	mask = (~mask) >> shifter;
+	key = getKmer((long unsigned *)(seq), start, shifter);
+	best = start - w;
+	bestHash = 0;
+	for(i = start, r = 0; i < end; ++i, ++r) {
+		if(r == w) {
+			r = 0;
+		}
+		if(i != start) {
+			key = ((key << 2) | getNuc(seq, (i + kmersize - 1))) & mask;
+		}
+		hash[r] = minimizerHash(key);
+		
+		if(best <= i - w) {
+			/* minimum left the window, rescan the ring */
+			j = (start < i - w + 1) ? i - w + 1 : start;
+			jr = (j - start) % w;
+			best = j;
+			bestHash = hash[jr];
+			while(++j <= i) {
+				if(++jr == w) {
+					jr = 0;
+				}
+				if(hash[jr] < bestHash) {
+					best = j;
+					bestHash = hash[jr];
+				}
+			}
+		} else if(hash[r] < bestHash) {
+			best = i;
+			bestHash = hash[r];
+		}
+		if(start + w <= i + 1 || i == end - 1) {
+			mark[best] = 1;
+		}
+	}
+}
+
 long unsigned makeKmer(const unsigned char *qseq, unsigned pos, unsigned size) {
 	
 	long unsigned key = qseq[pos];
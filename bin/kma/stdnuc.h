@@ -17,12 +17,19 @@
  * limitations under the License.
 */
 
+#define MINIMIZER_MAX 256
 #define getNuc(Comp,pos) ((Comp[pos >> 5] << ((pos & 31) << 1)) >> 62)
 #define setEx(src, pos)(src[pos >> 3] |= (1 << (pos & 7)))
 #define unsetEx(src, pos)(src[pos >> 3] ^= (1 << (pos & 7)))
 #define getEx(src, pos)((src[pos >> 3] >> (pos & 7)) & 1)
 
 long unsigned getKmer(long unsigned *compressor, unsigned cPos, const unsigned shifter);
+long unsigned getBases(const long unsigned *compressor, int cPos, int len);
+long unsigned getBasesRev(const long unsigned *compressor, int cPos, int len);
+int matchFwd(const long unsigned *qseq, int qPos, int q_len, const long unsigned *tseq, int tPos, int t_len, int max);
+int matchRev(const long unsigned *qseq, int qPos, int q_len, const long unsigned *tseq, int tPos, int t_len, int max);
+long unsigned minimizerHash(long unsigned kmer);
+void minimizerMark(const long unsigned *seq, int start, int end, int kmersize, int w, unsigned char *mark);
 long unsigned makeKmer(const unsigned char *qseq, unsigned pos, unsigned size);
 int charpos(const unsigned char *src, unsigned char target, int start, int len);
 void strrc(unsigned char *qseq, int q_len);
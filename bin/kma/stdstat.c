@@ -18,8 +18,13 @@
 */
 
 #include <math.h>
+#include <pthread.h>
 #include "stdstat.h"
 
+/* p-values of McNemar's test, for depths below CHISQR_TABLE */
+static double chisqrTable[(CHISQR_TABLE * (CHISQR_TABLE + 1)) >> 1];
+static pthread_once_t chisqrOnce = PTHREAD_ONCE_INIT;
+
 int cmp_or(int t, int q) {
 	return (t || q);
 }
@@ -28,103 +33,36 @@ int cmp_and(int t, int q) {
 	return (t && q);
 }
 
+/* chi-square quantiles (1 df) and their p-values, in falling order */
+static const double fastpQ[] = {
+	114.5242, 109.9604, 105.3969, 100.8337, 96.27476, 91.71701, 87.16164,
+	82.60901, 78.05917, 73.51245, 68.96954, 64.43048, 59.89615, 55.36699,
+	50.84417, 46.32844, 41.82144, 37.32489, 32.84127, 28.37395, 23.92814,
+	19.51139, 15.13671, 10.82759, 6.634897, 3.841443, 2.705532, 2.072251,
+	1.642374, 1.323304, 1.074194, 0.8734571, 0.7083263, 0.5706519, 0.4549364,
+	0.3573172, 0.2749959, 0.2059001, 0.1484719, 0.1015310, 0.06418475,
+	0.03576578, 0.01579077, 0.00393214
+};
+static const double fastpP[] = {
+	1e-26, 1e-25, 1e-24, 1e-23, 1e-22, 1e-21, 1e-20, 1e-19, 1e-18, 1e-17,
+	1e-16, 1e-15, 1e-14, 1e-13, 1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6,
+	1e-5, 1e-4, 1e-3, 0.01, 0.05, 0.1, 0.15, 0.2, 0.25, 0.3, 0.35, 0.4, 0.45,
+	0.5, 0.55, 0.6, 0.65, 0.7, 0.75, 0.8, 0.85, 0.9, 0.95
+};
+
 double fastp(long double q) {
 	/* P-value from quantile in a chi-square distribution */
-	double p = 1.0;
-	if(q > 114.5242) {
-		p = 1e-26;
-	} else if(q > 109.9604) {
-		p = 1e-25;
-	} else if(q > 105.3969) {
-		p = 1e-24;
-	} else if(q > 100.8337) {
-		p = 1e-23;
-	} else if(q > 96.27476) {
-		p = 1e-22;
-	} else if(q > 91.71701) {
-		p = 1e-21;
-	} else if(q > 87.16164) {
-		p = 1e-20;
-	} else if(q > 82.60901) {
-		p = 1e-19;
-	} else if(q > 78.05917) {
-		p = 1e-18;
-	} else if(q > 73.51245) {
-		p = 1e-17;
-	} else if(q > 68.96954) {
-		p = 1e-16;
-	} else if(q > 64.43048) {
-		p = 1e-15;
-	} else if(q > 59.89615) {
-		p = 1e-14;
-	} else if(q > 55.36699) {
-		p = 1e-13;
-	} else if(q > 50.84417) {
-		p = 1e-12;
-	} else if(q > 46.32844) {
-		p = 1e-11;
-	} else if(q > 41.82144) {
-		p = 1e-10;
-	} else if(q > 37.32489) {
-		p = 1e-9;
-	} else if(q > 32.84127) {
-		p = 1e-8;
-	} else if(q > 28.37395) {
-		p = 1e-7;
-	} else if(q > 23.92814) {
-		p = 1e-6;
-	} else if(q > 19.51139) {
-		p = 1e-5;
-	} else if(q > 15.13671) {
-		p = 1e-4;
-	} else if(q > 10.82759) {
-		p = 1e-3;
-	} else if(q > 6.634897) {
-		p = 0.01;
-	} else if(q > 3.841443) {
-		p = 0.05;
-	} else if(q > 2.705532) {
-		p = 0.1;
-	} else if(q > 2.072251) {
-		p = 0.15;
-	} else if(q > 1.642374) {
-		p = 0.2;
-	} else if(q > 1.323304) {
-		p = 0.25;
-	} else if(q > 1.074194) {
-		p = 0.3;
-	} else if(q > 0.8734571) {
-		p = 0.35;
-	} else if(q > 0.7083263) {
-		p = 0.4;
-	} else if(q > 0.5706519) {
-		p = 0.45;
-	} else if(q > 0.4549364) {
-		p = 0.5;
-	} else if(q > 0.3573172) {
-		p = 0.55;
-	} else if(q > 0.2749959) {
-		p = 0.6;
-	} else if(q > 0.2059001) {
-		p = 0.65;
-	} else if(q > 0.1484719) {
-		p = 0.7;
-	} else if(q > 0.1015310) {
-		p = 0.75;
-	} else if(q > 0.06418475) {
-		p = 0.8;
-	} else if(q > 0.03576578) {
-		p = 0.85;
-	} else if(q > 0.01579077) {
-		p = 0.9;
-	} else if(q > 0.00393214) {
-		p = 0.95;
-	} else if(q >= 0.0) {
-		p = 1.0;
-	} else {
-		p = 1.00 - fastp(-1 * q);
+	int i;
+	
+	if(q < 0) {
+		return 1.00 - fastp(-1 * q);
 	}
-	return p;
+	for(i = 0; i < sizeof(fastpQ) / sizeof(double); ++i) {
+		if(q > fastpQ[i]) {
+			return fastpP[i];
+		}
+	}
+	return 1.0;
 }
 
 double p_chisqr(long double q) {
@@ -140,6 +78,32 @@ double p_chisqr(long double q) {
 	return 1 - 1.772453850 * erf(sqrt(0.5 * q)) / tgamma(0.5);
 }
 
+static void p_chisqr_table_init() {
+	
+	int n, X;
+	double *table;
+	
+	table = chisqrTable;
+	for(n = 0; n < CHISQR_TABLE; ++n) {
+		for(X = 0; X <= n; ++X) {
+			*table++ = p_chisqr(pow(X - (n - X), 2) / n);
+		}
+	}
+}
+
+double p_chisqr_count(int X, int Y) {
+	
+	/* p-value of McNemar's statistic, (X - Y)^2 / (X + Y) */
+	int n;
+	
+	n = X + Y;
+	if(0 < n && n < CHISQR_TABLE && 0 <= X && 0 <= Y) {
+		pthread_once(&chisqrOnce, &p_chisqr_table_init);
+		return chisqrTable[((n * (n + 1)) >> 1) + X];
+	}
+	return p_chisqr(pow(X - Y, 2) / n);
+}
+
 double binP(int n, int k, double p) {
 	
 	int i, j, nk;
@@ -19,11 +19,13 @@
 
 #define MIN(X, Y) ((X < Y) ? X : Y)
 #define MAX(X, Y) ((X < Y) ? Y : X)
+#define CHISQR_TABLE 256
 
 int (*cmp)(int, int);
 int cmp_or(int t, int q);
 int cmp_and(int t, int q);
 double fastp(long double q);
 double p_chisqr(long double q);
+double p_chisqr_count(int X, int Y);
 double binP(int n, int k, double p);
 unsigned minimum(unsigned *src, unsigned n);
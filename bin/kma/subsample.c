@@ -0,0 +1,182 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compdna.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "runinput.h"
+#include "subsample.h"
+
+/* sampling state, reads are taken per fragment to keep mates together */
+static long unsigned subsampleSeed = 1, subsampleIn = 0, subsampleOut = 0;
+static long unsigned subsampleThreshold, subsampleNum = 0;
+static SubsampleRead **reservoir = 0;
+static void (*subsampleFsa_ptr)(Qseqs*, Qseqs*, CompDNA*);
+static void (*subsampleFsa_pair_ptr)(Qseqs*, Qseqs*, Qseqs*, Qseqs*, CompDNA*);
+
+static long unsigned subsample_rand() {
+	
+	/* xorshift64*, deterministic for a given seed */
+	subsampleSeed ^= subsampleSeed >> 12;
+	subsampleSeed ^= subsampleSeed << 25;
+	subsampleSeed ^= subsampleSeed >> 27;
+	return subsampleSeed * 2685821657736338717LU;
+}
+
+void subsample_init(double fraction, long unsigned num, long unsigned seed) {
+	
+	subsampleSeed = seed ? seed : 1;
+	subsampleFsa_ptr = printFsa_ptr;
+	subsampleFsa_pair_ptr = printFsa_pair_ptr;
+	if(num) {
+		/* keep a reservoir of num fragments, delivered by subsample_flush */
+		subsampleNum = num;
+		reservoir = calloc(num, sizeof(SubsampleRead *));
+		if(!reservoir) {
+			ERROR();
+		}
+		printFsa_ptr = &printFsa_reservoir;
+		printFsa_pair_ptr = &printFsa_pair_reservoir;
+	} else {
+		/* keep each fragment with probability fraction */
+		subsampleThreshold = fraction * (1LU << 53);
+		printFsa_ptr = &printFsa_fraction;
+		printFsa_pair_ptr = &printFsa_pair_fraction;
+	}
+}
+
+static int cmpSubsampleRead(const void *a, const void *b) {
+	
+	long unsigned numA, numB;
+	
+	numA = (*((SubsampleRead **) a))->num;
+	numB = (*((SubsampleRead **) b))->num;
+	
+	return (numA > numB) - (numA < numB);
+}
+
+void subsample_flush(FILE *out) {
+	
+	long unsigned i, n;
+	unsigned char *data;
+	Qseqs header, qseq, header_r, qseq_r;
+	CompDNA *compressor;
+	SubsampleRead *read;
+	
+	if(reservoir) {
+		/* deliver the reservoir in input order */
+		n = subsampleIn < subsampleNum ? subsampleIn : subsampleNum;
+		qsort(reservoir, n, sizeof(SubsampleRead *), cmpSubsampleRead);
+		compressor = smalloc(sizeof(CompDNA));
+		allocComp(compressor, 1024);
+		for(i = 0; i < n; ++i) {
+			read = reservoir[i];
+			data = read->data;
+			header.seq = data;
+			header.size = header.len = read->len[0];
+			data += read->len[0] + 1;
+			qseq.seq = data;
+			qseq.size = qseq.len = read->len[1];
+			if(read->len[3] < 0) {
+				subsampleFsa_ptr(&header, &qseq, compressor);
+			} else {
+				data += read->len[1];
+				header_r.seq = data;
+				header_r.size = header_r.len = read->len[2];
+				data += read->len[2] + 1;
+				qseq_r.seq = data;
+				qseq_r.size = qseq_r.len = read->len[3];
+				subsampleFsa_pair_ptr(&header, &qseq, &header_r, &qseq_r, compressor);
+			}
+			free(read);
+		}
+		subsampleOut = n;
+		freeComp(compressor);
+		free(compressor);
+		free(reservoir);
+		reservoir = 0;
+	}
+	
+	fprintf(out, "# Subsampled:\t%lu of %lu reads / read pairs.\n", subsampleOut, subsampleIn);
+}
+
+void printFsa_fraction(Qseqs *header, Qseqs *qseq, CompDNA *compressor) {
+	
+	++subsampleIn;
+	if((subsample_rand() >> 11) < subsampleThreshold) {
+		++subsampleOut;
+		subsampleFsa_ptr(header, qseq, compressor);
+	}
+}
+
+void printFsa_pair_fraction(Qseqs *header, Qseqs *qseq, Qseqs *header_r, Qseqs *qseq_r, CompDNA *compressor) {
+	
+	++subsampleIn;
+	if((subsample_rand() >> 11) < subsampleThreshold) {
+		++subsampleOut;
+		subsampleFsa_pair_ptr(header, qseq, header_r, qseq_r, compressor);
+	}
+}
+
+static void reservoir_add(Qseqs *header, Qseqs *qseq, Qseqs *header_r, Qseqs *qseq_r) {
+	
+	long unsigned pos;
+	unsigned char *data;
+	SubsampleRead *read;
+	
+	/* algorithm R, take the slot of a random earlier pick */
+	pos = subsampleIn++;
+	if(subsampleNum <= pos && subsampleNum <= (pos = subsample_rand() % subsampleIn)) {
+		return;
+	}
+	free(reservoir[pos]);
+	
+	/* headers include their leading '@' / '>' */
+	read = smalloc(sizeof(SubsampleRead) + header->len + qseq->len + 1 + (header_r ? header_r->len + qseq_r->len + 1 : 0));
+	read->num = subsampleIn;
+	read->len[0] = header->len;
+	read->len[1] = qseq->len;
+	data = read->data;
+	memcpy(data, header->seq, header->len + 1);
+	data += header->len + 1;
+	memcpy(data, qseq->seq, qseq->len);
+	if(header_r) {
+		data += qseq->len;
+		read->len[2] = header_r->len;
+		read->len[3] = qseq_r->len;
+		memcpy(data, header_r->seq, header_r->len + 1);
+		data += header_r->len + 1;
+		memcpy(data, qseq_r->seq, qseq_r->len);
+	} else {
+		read->len[2] = 0;
+		read->len[3] = -1;
+	}
+	reservoir[pos] = read;
+}
+
+void printFsa_reservoir(Qseqs *header, Qseqs *qseq, CompDNA *compressor) {
+	reservoir_add(header, qseq, 0, 0);
+}
+
+void printFsa_pair_reservoir(Qseqs *header, Qseqs *qseq, Qseqs *header_r, Qseqs *qseq_r, CompDNA *compressor) {
+	reservoir_add(header, qseq, header_r, qseq_r);
+}
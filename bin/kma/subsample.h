@@ -0,0 +1,39 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include "compdna.h"
+#include "qseqs.h"
+
+#ifndef SUBSAMPLE
+typedef struct subsampleRead SubsampleRead;
+struct subsampleRead {
+	long unsigned num;
+	int len[4]; /* header, seq, header_r, seq_r; seq_r < 0 for single reads */
+	unsigned char data[];
+};
+#define SUBSAMPLE 1
+#endif
+
+void subsample_init(double fraction, long unsigned num, long unsigned seed);
+void subsample_flush(FILE *out);
+void printFsa_fraction(Qseqs *header, Qseqs *qseq, CompDNA *compressor);
+void printFsa_pair_fraction(Qseqs *header, Qseqs *qseq, Qseqs *header_r, Qseqs *qseq_r, CompDNA *compressor);
+void printFsa_reservoir(Qseqs *header, Qseqs *qseq, CompDNA *compressor);
+void printFsa_pair_reservoir(Qseqs *header, Qseqs *qseq, Qseqs *header_r, Qseqs *qseq_r, CompDNA *compressor);
@@ -19,6 +19,7 @@
 
 #define _XOPEN_SOURCE 600
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 
 int usleep(unsigned usec);
@@ -27,3 +28,6 @@ int usleep(unsigned usec);
 #define lockTime(exclude, spin) while(__sync_lock_test_and_set(exclude, 1)) {while(*exclude) {usleep(spin);}}
 #define unlock(exclude) (__sync_lock_release(exclude))
 #define wait_atomic(src) while(src) {usleep(100);}
+/* ordered output, ticket holders write in ticket order and pass on the turn */
+#define lockTurn(turn, ticket) while(*(turn) != (ticket)) {sched_yield();}
+#define unlockTurn(turn, ticket) while(!__sync_bool_compare_and_swap(turn, ticket, (ticket) + 1)) {sched_yield();}
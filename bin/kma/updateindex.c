@@ -156,12 +156,38 @@ void dumpSeq(CompDNA *qseq, int kmerindex, FILE *seq_out, FILE *index_out) {
 void makeIndexing(CompDNA *compressor, int kmerindex, FILE *seq_out, FILE *index_out) {
 	
 	int i, j, end, shifter;
+	unsigned size;
+	unsigned char *mark;
 	HashMap_index *template_index;
 	
+	/* mark the window minimizers, and size their table from the count */
+	compressor->N[0]++;
+	compressor->N[compressor->N[0]] = compressor->seqlen + 1;
+	if(minimizerW) {
+		mark = calloc(compressor->seqlen + 1, 1);
+		if(!mark) {
+			ERROR();
+		}
+		j = 0;
+		for(i = 1; i <= compressor->N[0]; ++i) {
+			end = compressor->N[i] - kmerindex;
+			minimizerMark(compressor->seq, j, end, kmerindex, minimizerW, mark);
+			j = compressor->N[i] + 1;
+		}
+		size = 0;
+		for(j = 0; j < compressor->seqlen; ++j) {
+			size += mark[j];
+		}
+		size = size ? size << 1 : 1;
+	} else {
+		mark = 0;
+		size = compressor->seqlen << 1;
+	}
+	
 	/* allocate index */
 	template_index = smalloc(sizeof(HashMap_index));
 	template_index->len = compressor->seqlen;
-	template_index->size = compressor->seqlen << 1;
+	template_index->size = size;
 	template_index->kmerindex = kmerindex;
 	template_index->index = calloc(template_index->size, sizeof(int));
 	if(!template_index->index) {
@@ -171,19 +197,23 @@ void makeIndexing(CompDNA *compressor, int kmerindex, FILE *seq_out, FILE *index
 	/* load index */
 	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (kmerindex << 1);
 	template_index->seq = compressor->seq;
-	compressor->N[0]++;
-	compressor->N[compressor->N[0]] = compressor->seqlen + 1;
 	j = 0;
 	for(i = 1; i <= compressor->N[0]; ++i) {
 		end = compressor->N[i] - kmerindex;
 		for(;j < end; ++j) {
-			hashMapIndex_add(template_index, getKmer(compressor->seq, j, shifter), j);
+			if(!mark || mark[j]) {
+				hashMapIndex_add(template_index, getKmer(compressor->seq, j, shifter), j);
+			}
 		}
 		j = compressor->N[i] + 1;
 	}
 	compressor->N[0]--;
+	free(mark);
 	
-	/* dump index */
+	/* dump index, minimizer tables lead with their size */
+	if(minimizerW) {
+		cfwrite(&size, sizeof(unsigned), 1, index_out);
+	}
 	hashMap_index_dump(template_index, seq_out, index_out);
 	
 	free(template_index->index);
@@ -93,14 +93,121 @@ void initialiseVcf(FileBuff *fileP, char *templateFilename) {
 	fileP->bytes = avail;
 }
 
+static char * vcfStr(char *dest, const char *src) {
+	
+	while(*src) {
+		*dest++ = *src++;
+	}
+	
+	return dest;
+}
+
+static char * vcfInt(char *dest, long num) {
+	
+	char buff[24], *ptr;
+	
+	/* equivalent with sprintf(dest, "%ld", num) */
+	if(num < 0) {
+		*dest++ = '-';
+		num = -num;
+	}
+	ptr = buff + sizeof(buff);
+	do {
+		*--ptr = '0' + num % 10;
+		num /= 10;
+	} while(num);
+	while(ptr != buff + sizeof(buff)) {
+		*dest++ = *ptr++;
+	}
+	
+	return dest;
+}
+
+static int vcfTie(double frac) {
+	/* rounding may depend on digits lost in scaling */
+	return (0.5 - 1e-6 < frac && frac < 0.5 + 1e-6);
+}
+
+static char * vcfFix2(char *dest, double x) {
+	
+	long n;
+	double r;
+	
+	/* equivalent with sprintf(dest, "%.2f", x) */
+	r = x * 100;
+	if(!(0 <= r && r < 1e15)) {
+		return dest + sprintf(dest, "%.2f", x);
+	}
+	n = r;
+	r -= n;
+	if(vcfTie(r)) {
+		return dest + sprintf(dest, "%.2f", x);
+	} else if(0.5 < r) {
+		++n;
+	}
+	dest = vcfInt(dest, n / 100);
+	*dest++ = '.';
+	*dest++ = '0' + (n / 10) % 10;
+	*dest++ = '0' + n % 10;
+	
+	return dest;
+}
+
+static char * vcfExp(char *dest, double x) {
+	
+	int e;
+	long n;
+	double r;
+	
+	/* equivalent with sprintf(dest, "%4.1e", x) */
+	if(!(1e-300 <= x && x < 1e300)) {
+		return dest + sprintf(dest, "%4.1e", x);
+	}
+	e = floor(log10(x));
+	r = x * pow(10, 1 - e);
+	if(r < 10) {
+		--e;
+		r *= 10;
+	} else if(100 <= r) {
+		++e;
+		r /= 10;
+	}
+	n = r;
+	r -= n;
+	if(vcfTie(r)) {
+		return dest + sprintf(dest, "%4.1e", x);
+	} else if(0.5 < r) {
+		++n;
+	}
+	if(n == 100) {
+		n = 10;
+		++e;
+	}
+	*dest++ = '0' + n / 10;
+	*dest++ = '.';
+	*dest++ = '0' + n % 10;
+	*dest++ = 'e';
+	if(e < 0) {
+		*dest++ = '-';
+		e = -e;
+	} else {
+		*dest++ = '+';
+	}
+	if(e < 10) {
+		*dest++ = '0';
+	}
+	
+	return vcfInt(dest, e);
+}
+
 void updateVcf(char *template_name, long unsigned *template_seq, double evalue, int t_len, AssemInfo *matrix, int filter, FileBuff *fileP) {
 	
 	static const char *PASS = "PASS", *FAIL = "FAIL", *LowQual = "LowQual", *UNKNOWN = ".";
 	int i, j, pos, bestScore, depthUpdate, bestBaseScore, nucNum;
-	int template_name_length, check, avail, DP, AD, DEL, QUAL;
+	int template_name_length, avail, DP, AD, DEL, QUAL;
 	double AF, RAF, Q, P;
 	const double lnConst = -10 / log(10);
-	char *FILTER, **FILTER_ptr, *update;
+	char *FILTER, **FILTER_ptr, *update, *line;
 	unsigned char nuc, bestNuc;
 	const char bases[] = "ACGTN-";
 	Assembly *assembly;
@@ -175,7 +282,7 @@ void updateVcf(char *template_name, long unsigned *template_seq, double evalue,
 				DEL = assembly[pos].counts[5];
 				/* FORMAT */
 				Q = pow(depthUpdate - (bestScore << 1), 2) / depthUpdate;
-				P = p_chisqr(Q);
+				P = p_chisqr_count(bestScore, depthUpdate - bestScore);
 				/* QUAL */
 				//QUAL = lnConst * log(P);
 				QUAL = lnConst * log(binP(DP, AD, 0.25));
@@ -196,48 +303,67 @@ void updateVcf(char *template_name, long unsigned *template_seq, double evalue,
 					update = (char *) fileP->next;
 				}
 				
-				strcpy(update, template_name);
-				update += template_name_length; avail -= template_name_length;
-				*update++ = '\t'; --avail;
+				line = update;
+				memcpy(update, template_name, template_name_length);
+				update += template_name_length;
+				*update++ = '\t';
 				
 				if(nuc != '-') {
-					check = sprintf(update, "%d", i);
-					update += check; avail -= check;
+					update = vcfInt(update, i);
 				} else {
 					*update++ = '0';
-					--avail;
 				}
 				*update++ = '\t';
 				*update++ = '.';
 				*update++ = '\t';
-				avail -= 3;
 				
 				if(nuc != '-') {
 					*update++ = nuc;
-					--avail;
 				} else {
 					*update++ = '<';
 					*update++ = nuc;
 					*update++ = '>';
-					avail -= 3;
 				}
 				*update++ = '\t';
-				--avail;
 				if(nuc != '-' && bestNuc == '-') {
 					*update++ = '<';
 					*update++ = bestNuc;
 					*update++ = '>';
-					avail -= 3;
 				} else {
 					*update++ = bestNuc;
-					--avail;
 				}
-				check = sprintf(update, "\t%d\t%s\tDP=%d;AD=%d;AF=%.2f;RAF=%.2f;DEL=%d;", QUAL, *FILTER_ptr, DP, AD, AF, RAF, DEL);
-				update += check; avail -= check;
-				check = sprintf(update, "AD6=%d,%d,%d,%d,%d,%d\t", assembly[pos].counts[0], assembly[pos].counts[1], assembly[pos].counts[2], assembly[pos].counts[3], assembly[pos].counts[4], assembly[pos].counts[5]);
-				update += check; avail -= check;
-				check = sprintf(update, "Q:P:FT\t%.2f:%4.1e:%s\n", Q, P, FILTER);
-				update += check; avail -= check;
+				*update++ = '\t';
+				update = vcfInt(update, QUAL);
+				*update++ = '\t';
+				update = vcfStr(update, *FILTER_ptr);
+				update = vcfStr(update, "\tDP=");
+				update = vcfInt(update, DP);
+				update = vcfStr(update, ";AD=");
+				update = vcfInt(update, AD);
+				update = vcfStr(update, ";AF=");
+				update = vcfFix2(update, AF);
+				update = vcfStr(update, ";RAF=");
+				update = vcfFix2(update, RAF);
+				update = vcfStr(update, ";DEL=");
+				update = vcfInt(update, DEL);
+				update = vcfStr(update, ";AD6=");
+				for(j = 0; j < 6; ++j) {
+					update = vcfInt(update, assembly[pos].counts[j]);
+					*update++ = ',';
+				}
+				update[-1] = '\t';
+				update = vcfStr(update, "Q:P:FT\t");
+				update = vcfFix2(update, Q);
+				*update++ = ':';
+				update = vcfExp(update, P);
+				*update++ = ':';
+				update = vcfStr(update, FILTER);
+				*update++ = '\n';
+				avail -= update - line;
+				
+				/* equivalent with:
+				fprintf(vcf_out, "%s\t%d\t.\t%c\t%c\t%d\t%s\tDP=%d;AD=%d;AF=%.2f;RAF=%.2f;DEL=%d;AD6=%d,%d,%d,%d,%d,%d\tQ:P:FT\t%.2f:%4.1e:%s\n", ...);
+				*/
 			}
 		} else if(nuc != '-') {
 			FILTER = (char *) FAIL;
@@ -247,12 +373,21 @@ void updateVcf(char *template_name, long unsigned *template_seq, double evalue,
 				avail = fileP->bytes;
 				update = (char *) fileP->next;
 			}
-			check = sprintf(update, "%s\t%d\t.\t%c\t%c\t%d\t%s\t", template_name, i, nuc, '.', 0, *FILTER_ptr);
-			update += check; avail -= check;
-			check = sprintf(update, "DP=%d;AD=%d;AF=%.2f;RAF=%.2f;DEL=%d;AD6=%d,%d,%d,%d,%d,%d\t", 0, 0, 0.0, 0.0, 0, 0, 0, 0, 0, 0, 0);
-			update += check; avail -= check;
-			check = sprintf(update, "Q:P:FT\t%.2f:%4.1e:%s\n", 0.0, 1.0, FILTER);
-			update += check; avail -= check;
+			line = update;
+			memcpy(update, template_name, template_name_length);
+			update += template_name_length;
+			*update++ = '\t';
+			update = vcfInt(update, i);
+			*update++ = '\t';
+			*update++ = '.';
+			*update++ = '\t';
+			*update++ = nuc;
+			update = vcfStr(update, "\t.\t0\t");
+			update = vcfStr(update, *FILTER_ptr);
+			update = vcfStr(update, "\tDP=0;AD=0;AF=0.00;RAF=0.00;DEL=0;AD6=0,0,0,0,0,0\tQ:P:FT\t0.00:1.0e+00:");
+			update = vcfStr(update, FILTER);
+			*update++ = '\n';
+			avail -= update - line;
 		}
 	} while((pos = assembly[pos].next) != 0);
 	